@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "caro-ai-pool.h"
+
+static void heap_swap(AiJob *a, AiJob *b) {
+    AiJob tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void heap_push(AiPool *pool, const AiJob *job) {
+    int i = pool->heap_size++;
+    pool->heap[i] = *job;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (pool->heap[parent].deadline_ms <= pool->heap[i].deadline_ms) {
+            break;
+        }
+        heap_swap(&pool->heap[parent], &pool->heap[i]);
+        i = parent;
+    }
+}
+
+static void heap_remove(AiPool *pool, int i) {
+    pool->heap[i] = pool->heap[--pool->heap_size];
+    // Restore the heap in both directions, the moved job may belong either way
+    while (i > 0 && pool->heap[(i - 1) / 2].deadline_ms > pool->heap[i].deadline_ms) {
+        heap_swap(&pool->heap[(i - 1) / 2], &pool->heap[i]);
+        i = (i - 1) / 2;
+    }
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < pool->heap_size && pool->heap[left].deadline_ms < pool->heap[smallest].deadline_ms) {
+            smallest = left;
+        }
+        if (right < pool->heap_size && pool->heap[right].deadline_ms < pool->heap[smallest].deadline_ms) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        heap_swap(&pool->heap[smallest], &pool->heap[i]);
+        i = smallest;
+    }
+}
+
+static void *ai_worker_main(void *arg) {
+    AiPool *pool = (AiPool *)arg;
+    AiWorker *worker = NULL;
+    Engine engine;
+    AiJob job;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (pthread_equal(pool->workers[i].thread, pthread_self())) {
+            worker = &pool->workers[i];
+        }
+    }
+
+    while (1) {
+        while (!pool->shutdown && pool->heap_size == 0) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+
+        job = pool->heap[0];
+        heap_remove(pool, 0);
+        worker->room = job.room;
+        atomic_store(&worker->stop, 0);
+        pthread_mutex_unlock(&pool->lock);
+
+        // A job that sat in the queue past its deadline still gets a minimal search
+        long long think_ms = job.think_ms;
+        long long waited_ms = engine_now_ms() - job.submitted_ms;
+        if (think_ms - waited_ms < AI_MIN_THINK_MS) {
+            think_ms = AI_MIN_THINK_MS;
+        } else {
+            think_ms -= waited_ms;
+        }
+
+        SearchLimits limits = {0};
+        SearchInfo result;
+        limits.time_ms = think_ms;
+        limits.stop = &worker->stop;
+        engine_setup(&engine, job.board, job.side);
+        int found = engine_search(&engine, &pool->tt, &limits, NULL, NULL, &result);
+
+        if (found && !atomic_load(&worker->stop)) {
+            job.callback(job.room, result.row, result.col, engine_now_ms() - job.submitted_ms);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        worker->room = NULL;
+        pthread_cond_broadcast(&pool->worker_idle);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int ai_pool_init(AiPool *pool, int worker_count, size_t tt_megabytes) {
+    engine_init();
+    if (worker_count <= 0) {
+        worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if (worker_count < 1) {
+            worker_count = 1;
+        }
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    if (!tt_init(&pool->tt, tt_megabytes)) {
+        return 0;
+    }
+    pool->heap_capacity = 64;
+    pool->heap = malloc(pool->heap_capacity * sizeof(AiJob));
+    pool->workers = calloc(worker_count, sizeof(AiWorker));
+    if (pool->heap == NULL || pool->workers == NULL) {
+        free(pool->heap);
+        free(pool->workers);
+        tt_free(&pool->tt);
+        return 0;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->worker_idle, NULL);
+
+    // Workers look themselves up by thread id, so hold the lock until all exist
+    pthread_mutex_lock(&pool->lock);
+    pool->worker_count = worker_count;
+    for (int i = 0; i < worker_count; i++) {
+        atomic_init(&pool->workers[i].stop, 0);
+        pthread_create(&pool->workers[i].thread, NULL, ai_worker_main, pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
+
+int ai_pool_submit(AiPool *pool, void *room, int board[BOARD_SIZE][BOARD_SIZE], int side,
+                   long long clock_left_ms, AiReplyCallback callback) {
+    AiJob job;
+    job.room = room;
+    memcpy(job.board, board, sizeof(job.board));
+    job.side = side;
+    job.submitted_ms = engine_now_ms();
+    job.deadline_ms = job.submitted_ms + clock_left_ms;
+    job.think_ms = clock_left_ms / AI_MOVES_TO_GO;
+    if (job.think_ms < AI_MIN_THINK_MS) {
+        job.think_ms = AI_MIN_THINK_MS;
+    } else if (job.think_ms > AI_MAX_THINK_MS) {
+        job.think_ms = AI_MAX_THINK_MS;
+    }
+    job.callback = callback;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->heap_size == pool->heap_capacity) {
+        AiJob *heap = realloc(pool->heap, 2 * pool->heap_capacity * sizeof(AiJob));
+        if (heap == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return 0;
+        }
+        pool->heap = heap;
+        pool->heap_capacity *= 2;
+    }
+    heap_push(pool, &job);
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
+
+// Drops queued jobs for the room and stops any search running for it. Once
+// this returns the callback will not be called for the room again.
+void ai_pool_cancel(AiPool *pool, void *room) {
+    pthread_mutex_lock(&pool->lock);
+    for (int i = pool->heap_size - 1; i >= 0; i--) {
+        if (pool->heap[i].room == room) {
+            heap_remove(pool, i);
+        }
+    }
+    while (1) {
+        int busy = 0;
+        for (int i = 0; i < pool->worker_count; i++) {
+            if (pool->workers[i].room == room) {
+                atomic_store(&pool->workers[i].stop, 1);
+                busy = 1;
+            }
+        }
+        if (!busy) {
+            break;
+        }
+        pthread_cond_wait(&pool->worker_idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ai_pool_shutdown(AiPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    for (int i = 0; i < pool->worker_count; i++) {
+        atomic_store(&pool->workers[i].stop, 1);
+    }
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->worker_idle);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->heap);
+    tt_free(&pool->tt);
+}
\ No newline at end of file
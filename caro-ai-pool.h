@@ -0,0 +1,50 @@
+#ifndef CARO_AI_POOL_H
+#define CARO_AI_POOL_H
+
+#include <pthread.h>
+#include "caro-engine.h"
+
+#define AI_MIN_THINK_MS 50
+#define AI_MAX_THINK_MS 5000
+#define AI_MOVES_TO_GO 30
+
+// Called on a pool thread with the chosen move and the time the job took
+// from submission, including time spent waiting in the queue.
+typedef void (*AiReplyCallback)(void *room, int row, int col, long long elapsed_ms);
+
+typedef struct {
+    void *room;
+    int board[BOARD_SIZE][BOARD_SIZE];
+    int side;
+    long long submitted_ms;
+    long long deadline_ms;
+    long long think_ms;
+    AiReplyCallback callback;
+} AiJob;
+
+typedef struct {
+    pthread_t thread;
+    void *room;          // room of the job being searched, NULL when idle
+    atomic_int stop;
+} AiWorker;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t worker_idle;
+    AiJob *heap;         // min-heap ordered by deadline
+    int heap_size;
+    int heap_capacity;
+    AiWorker *workers;
+    int worker_count;
+    int shutdown;
+    TransTable tt;       // shared by all workers
+} AiPool;
+
+int ai_pool_init(AiPool *pool, int worker_count, size_t tt_megabytes);
+int ai_pool_submit(AiPool *pool, void *room, int board[BOARD_SIZE][BOARD_SIZE], int side,
+                   long long clock_left_ms, AiReplyCallback callback);
+void ai_pool_cancel(AiPool *pool, void *room);
+void ai_pool_shutdown(AiPool *pool);
+
+#endif
\ No newline at end of file
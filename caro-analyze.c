@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "caro-batch.h"
+
+// Batch analysis front end. Input lines are either
+//   game r,c r,c ...          every position of the game, move by move
+//   board <side> <cells>      one position, cells row by row as . x o
+// Output is one line per PV line: "<position> <rank> <row>,<col> <score> <depth> <nodes>",
+// or with -b a 16-byte little-endian record per PV line.
+
+typedef struct {
+    BatchPosition *items;
+    int count;
+    int capacity;
+} PositionList;
+
+BatchPosition *add_position(PositionList *list) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity > 0 ? 2 * list->capacity : 256;
+        list->items = realloc(list->items, list->capacity * sizeof(BatchPosition));
+        if (list->items == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    return &list->items[list->count++];
+}
+
+int parse_game(PositionList *list, char *moves, int game) {
+    BatchPosition current;
+    memset(&current, 0, sizeof(current));
+    current.side = 1;
+    current.game = game;
+
+    *add_position(list) = current;
+    for (char *token = strtok(moves, " \t\n"); token != NULL; token = strtok(NULL, " \t\n")) {
+        int row, col;
+        if (sscanf(token, "%d,%d", &row, &col) != 2 || row < 0 || row >= BOARD_SIZE ||
+            col < 0 || col >= BOARD_SIZE || current.board[row][col] != 0) {
+            return 0;
+        }
+        current.board[row][col] = current.side;
+        current.side = 3 - current.side;
+        *add_position(list) = current;
+    }
+    return 1;
+}
+
+int parse_board(PositionList *list, const char *text, int game) {
+    BatchPosition position;
+    int offset = 0;
+    memset(&position, 0, sizeof(position));
+    position.game = game;
+
+    // The cells are checked where they are, so no width tied to one board
+    // size is needed
+    if (sscanf(text, "%d %n", &position.side, &offset) != 1 || (position.side != 1 && position.side != 2)) {
+        return 0;
+    }
+    const char *cells = text + offset;
+    if (strcspn(cells, " \t\r\n") != BOARD_CELLS) {
+        return 0;
+    }
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        char c = cells[cell];
+        position.board[cell / BOARD_SIZE][cell % BOARD_SIZE] = (c == 'x' || c == 'X') ? 1 : (c == 'o' || c == 'O') ? 2 : 0;
+    }
+    *add_position(list) = position;
+    return 1;
+}
+
+void write_binary(int position, int rank, const SearchInfo *line) {
+    uint8_t record[16];
+    uint32_t index = (uint32_t)position;
+    uint32_t score = (uint32_t)line->score;
+    uint32_t nodes = line->nodes > UINT32_MAX ? UINT32_MAX : (uint32_t)line->nodes;
+    for (int b = 0; b < 4; b++) {
+        record[b] = (uint8_t)(index >> (8 * b));
+        record[8 + b] = (uint8_t)(score >> (8 * b));
+        record[12 + b] = (uint8_t)(nodes >> (8 * b));
+    }
+    record[4] = (uint8_t)rank;
+    record[5] = (uint8_t)line->row;
+    record[6] = (uint8_t)line->col;
+    record[7] = (uint8_t)line->depth;
+    fwrite(record, sizeof(record), 1, stdout);
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-m multipv] [-d depth] [-t ms] [-j threads] [-H hash_mb] [-c cache] [-C cache_mb] [-b] [input]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    BatchOptions options;
+    PositionList list = {NULL, 0, 0};
+    int binary = 0;
+    int option;
+    char line[8192];
+
+    AnalysisCache cache;
+    const char *cache_path = NULL;
+    size_t cache_megabytes = 256;
+
+    memset(&options, 0, sizeof(options));
+    options.pv_count = 3;
+    options.limits.max_depth = 6;
+    while ((option = getopt(argc, argv, "m:d:t:j:H:c:C:b")) != -1) {
+        switch (option) {
+            case 'm': options.pv_count = atoi(optarg); break;
+            case 'd': options.limits.max_depth = atoi(optarg); break;
+            case 't': options.limits.time_ms = atoll(optarg); break;
+            case 'j': options.threads = atoi(optarg); break;
+            case 'H': options.tt_megabytes = (size_t)atoll(optarg); break;
+            case 'c': cache_path = optarg; break;
+            case 'C': cache_megabytes = (size_t)atoll(optarg); break;
+            case 'b': binary = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (options.pv_count < 1 || options.pv_count > BATCH_MAX_PV) {
+        fprintf(stderr, "Error: multipv must be between 1 and %d\n", BATCH_MAX_PV);
+        return 1;
+    }
+
+    if (cache_path != NULL) {
+        if (!cache_open(&cache, cache_path, cache_megabytes)) {
+            return 1;
+        }
+        options.cache = &cache;
+    }
+
+    FILE *input = optind < argc ? fopen(argv[optind], "r") : stdin;
+    if (input == NULL) {
+        perror("fopen");
+        return 1;
+    }
+    for (int number = 1; fgets(line, sizeof(line), input) != NULL; number++) {
+        int ok = 1;
+        if (strncmp(line, "game ", 5) == 0) {
+            ok = parse_game(&list, line + 5, number);
+        } else if (strncmp(line, "board ", 6) == 0) {
+            ok = parse_board(&list, line + 6, number);
+        } else if (line[0] != '\n' && line[0] != '#') {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Bad input on line %d\n", number);
+            return 1;
+        }
+    }
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    BatchResult *results = calloc(list.count > 0 ? list.count : 1, sizeof(BatchResult));
+    long long start_ms = engine_now_ms();
+    if (results == NULL || !batch_analyze(list.items, list.count, &options, results)) {
+        fprintf(stderr, "Error: Analysis failed\n");
+        return 1;
+    }
+    long long elapsed_ms = engine_now_ms() - start_ms;
+
+    for (int i = 0; i < list.count; i++) {
+        for (int k = 0; k < results[i].line_count; k++) {
+            const SearchInfo *pv = &results[i].lines[k];
+            if (binary) {
+                write_binary(i, k + 1, pv);
+            } else {
+                printf("%d %d %d,%d %d %d %lld\n", i, k + 1, pv->row, pv->col, pv->score, pv->depth, pv->nodes);
+            }
+        }
+    }
+    fprintf(stderr, "%d positions in %lld ms\n", list.count, elapsed_ms);
+
+    if (options.cache != NULL) {
+        cache_close(&cache);
+    }
+    free(results);
+    free(list.items);
+    return 0;
+}
\ No newline at end of file
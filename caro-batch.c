@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "caro-batch.h"
+
+typedef struct {
+    int begin;
+    int end;
+} BatchSegment;
+
+typedef struct {
+    const BatchPosition *positions;
+    BatchResult *results;
+    const BatchOptions *options;
+    TransTable tt;
+    BatchSegment *segments;
+    int segment_count;
+    int next_segment;
+    pthread_mutex_t lock;
+} BatchJob;
+
+// Returns the cell of the single stone that turns previous into next, or -1
+static int single_move_between(const BatchPosition *previous, const BatchPosition *next) {
+    int cell = -1;
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            if (previous->board[i][j] == next->board[i][j]) {
+                continue;
+            }
+            if (cell >= 0 || previous->board[i][j] != 0 || next->board[i][j] != previous->side) {
+                return -1;
+            }
+            cell = i * BOARD_SIZE + j;
+        }
+    }
+    return next->side == 3 - previous->side ? cell : -1;
+}
+
+// Answers a single-line request straight from the cache when the stored
+// search was deep enough; a shallower entry still seeds the table so the
+// search starts from the known best move.
+static int batch_cached(BatchJob *job, Engine *engine, BatchResult *result) {
+    CacheEntry entry;
+    if (job->options->cache == NULL || !cache_probe(job->options->cache, engine, &entry)) {
+        return 0;
+    }
+    int max_depth = job->options->limits.max_depth;
+    if (job->options->pv_count == 1 && max_depth > 0 && entry.depth >= max_depth) {
+        result->line_count = 1;
+        result->lines[0].depth = entry.depth;
+        result->lines[0].row = entry.row;
+        result->lines[0].col = entry.col;
+        result->lines[0].score = entry.score;
+        result->lines[0].nodes = 0;
+        result->lines[0].time_ms = 0;
+        return 1;
+    }
+    engine_hint(engine, &job->tt, entry.row, entry.col, entry.score, entry.depth);
+    return 0;
+}
+
+static void *batch_worker(void *arg) {
+    BatchJob *job = (BatchJob *)arg;
+    Engine engine;
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        int s = job->next_segment < job->segment_count ? job->next_segment++ : -1;
+        pthread_mutex_unlock(&job->lock);
+        if (s < 0) {
+            break;
+        }
+
+        const BatchSegment *segment = &job->segments[s];
+        for (int i = segment->begin; i < segment->end; i++) {
+            const BatchPosition *position = &job->positions[i];
+            int cell = i > segment->begin ? single_move_between(&job->positions[i - 1], position) : -1;
+            if (cell >= 0) {
+                engine_make_move(&engine, cell / BOARD_SIZE, cell % BOARD_SIZE);
+            } else {
+                engine_setup(&engine, (int (*)[BOARD_SIZE])position->board, position->side);
+            }
+            BatchResult *result = &job->results[i];
+            if (batch_cached(job, &engine, result)) {
+                continue;
+            }
+            result->line_count = engine_search_multipv(&engine, &job->tt, &job->options->limits,
+                                                       job->options->pv_count, result->lines);
+            if (job->options->cache != NULL && result->line_count > 0 &&
+                result->lines[0].depth >= CACHE_MIN_DEPTH) {
+                CacheEntry entry = {result->lines[0].row, result->lines[0].col,
+                                    result->lines[0].score, result->lines[0].depth};
+                cache_store(job->options->cache, &engine, &entry);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int batch_analyze(const BatchPosition *positions, int count, const BatchOptions *options, BatchResult *results) {
+    BatchJob job;
+    int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (options->pv_count < 1 || options->pv_count > BATCH_MAX_PV) {
+        return 0;
+    }
+
+    engine_init();
+    memset(&job, 0, sizeof(job));
+    job.positions = positions;
+    job.results = results;
+    job.options = options;
+    if (!tt_init(&job.tt, options->tt_megabytes > 0 ? options->tt_megabytes : BATCH_TT_MB)) {
+        return 0;
+    }
+
+    // Split on game boundaries, and long games into one piece per thread
+    int piece = (count + threads - 1) / threads;
+    job.segments = malloc((count + 1) * sizeof(BatchSegment));
+    if (job.segments == NULL) {
+        tt_free(&job.tt);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        BatchSegment *last = job.segment_count > 0 ? &job.segments[job.segment_count - 1] : NULL;
+        if (last != NULL && positions[i].game == positions[i - 1].game && last->end - last->begin < piece) {
+            last->end = i + 1;
+        } else {
+            job.segments[job.segment_count].begin = i;
+            job.segments[job.segment_count].end = i + 1;
+            job.segment_count++;
+        }
+    }
+
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_t *thread_ids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&thread_ids[t], NULL, batch_worker, &job);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(thread_ids[t], NULL);
+    }
+
+    free(thread_ids);
+    pthread_mutex_destroy(&job.lock);
+    free(job.segments);
+    tt_free(&job.tt);
+    return 1;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef CARO_BATCH_H
+#define CARO_BATCH_H
+
+#include "caro-engine.h"
+#include "caro-cache.h"
+
+#define BATCH_MAX_PV 8
+#define BATCH_TT_MB 128
+
+// A position to analyse. Consecutive positions with the same game id are
+// treated as one game and analysed in order by the same thread, so the
+// engine state and table entries carry over from one move to the next.
+typedef struct {
+    int board[BOARD_SIZE][BOARD_SIZE];
+    int side;
+    int game;
+} BatchPosition;
+
+typedef struct {
+    int line_count;
+    SearchInfo lines[BATCH_MAX_PV];   // best first
+} BatchResult;
+
+typedef struct {
+    int pv_count;
+    int threads;           // 0 uses every core
+    size_t tt_megabytes;   // shared by all threads
+    SearchLimits limits;   // applied to each PV line of each position
+    AnalysisCache *cache;  // optional, consulted before and updated after each search
+} BatchOptions;
+
+int batch_analyze(const BatchPosition *positions, int count, const BatchOptions *options, BatchResult *results);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <time.h>
+#include "caro-engine.h"
+#include "caro-rules.h"
+#include "caro-solved.h"
+#include "caro-cache.h"
+
+#define BRAIN_NAME "caro-brain"
+#define BRAIN_VERSION "1.0"
+#define BRAIN_TT_MB 64
+#define BRAIN_MOVES_TO_GO 20
+#define BRAIN_SAFETY_MS 30
+#define BRAIN_MIN_THINK_MS 5
+#define BRAIN_DEFAULT_TURN_MS 5000
+#define BRAIN_WEIGHTS_FILE "caro-weights.txt"
+#define BRAIN_CACHE_MB 256
+
+// Gomocup "INFO rule" bits for exact five, Renju and Caro
+#define GOMOCUP_RULE_MASK 13
+#if CARO_RULE == RULE_STANDARD
+#define GOMOCUP_RULE 1
+#elif CARO_RULE == RULE_RENJU
+#define GOMOCUP_RULE 4
+#elif CARO_RULE == RULE_CARO
+#define GOMOCUP_RULE 8
+#else
+#define GOMOCUP_RULE 0
+#endif
+#define BENCH_DEPTH 6
+#define BENCH_TT_MB 16
+#define PERFT_DEPTH 3
+#define ORDER_ITERATIONS 20000
+
+// Piskvork/Gomocup brain: reads protocol commands from stdin and answers
+// on stdout. Coordinates on the wire are "x,y", i.e. column then row.
+typedef struct {
+    Engine engine;
+    TransTable tt;
+    size_t tt_megabytes;
+    int started;
+    long long timeout_turn;
+    long long timeout_match;
+    long long time_left;
+    size_t max_memory;
+    SolvedTable solved;   // perfect play on boards small enough to solve
+    AnalysisCache cache;  // results remembered from earlier runs
+} Brain;
+
+Brain brain;
+
+void brain_reply(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    fflush(stdout);
+}
+
+// The table survives between turns and games; it is only reallocated when
+// the manager lowers max_memory below what we hold.
+int brain_prepare_table(void) {
+    size_t megabytes = BRAIN_TT_MB;
+    if (brain.max_memory > 0 && megabytes > brain.max_memory / (2 * 1024 * 1024)) {
+        megabytes = brain.max_memory / (2 * 1024 * 1024);
+        if (megabytes < 1) {
+            megabytes = 1;
+        }
+    }
+    if (brain.tt.entries != NULL && brain.tt_megabytes == megabytes) {
+        return 1;
+    }
+    tt_free(&brain.tt);
+    brain.tt_megabytes = megabytes;
+    return tt_init(&brain.tt, megabytes);
+}
+
+long long brain_budget_ms(void) {
+    // timeout_turn 0 asks for the fastest possible reply
+    long long budget = brain.timeout_turn > 0 ? brain.timeout_turn : 0;
+    if (brain.timeout_match > 0 && brain.time_left > 0 && brain.time_left / BRAIN_MOVES_TO_GO < budget) {
+        budget = brain.time_left / BRAIN_MOVES_TO_GO;
+    }
+    budget -= BRAIN_SAFETY_MS;
+    return budget < BRAIN_MIN_THINK_MS ? BRAIN_MIN_THINK_MS : budget;
+}
+
+void brain_think(long long received_ms) {
+    Engine *engine = &brain.engine;
+    SearchLimits limits = {0};
+    SearchInfo result;
+
+    // Time spent parsing the command counts against the turn
+    limits.time_ms = brain_budget_ms() - (engine_now_ms() - received_ms);
+    if (limits.time_ms < BRAIN_MIN_THINK_MS) {
+        limits.time_ms = BRAIN_MIN_THINK_MS;
+    }
+
+    if (brain.solved.entries != NULL && engine->winner == 0) {
+        int board[BOARD_SIZE][BOARD_SIZE];
+        int row, col;
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            board[cell / BOARD_SIZE][cell % BOARD_SIZE] = engine->cells[cell];
+        }
+        if (solved_best_move(&brain.solved, board, &row, &col)) {
+            engine_make_move(engine, row, col);
+            brain_reply("%d,%d", col, row);
+            return;
+        }
+    }
+
+    CacheEntry entry;
+    if (cache_probe(&brain.cache, engine, &entry)) {
+        engine_hint(engine, &brain.tt, entry.row, entry.col, entry.score, entry.depth);
+    }
+
+    if (!engine_search(engine, &brain.tt, &limits, NULL, NULL, &result)) {
+        // Game already decided; any empty cell keeps the manager happy
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            if (engine->cells[cell] == 0) {
+                result.row = cell / BOARD_SIZE;
+                result.col = cell % BOARD_SIZE;
+                break;
+            }
+        }
+    } else if (result.depth >= CACHE_MIN_DEPTH) {
+        entry = (CacheEntry){result.row, result.col, result.score, result.depth};
+        cache_store(&brain.cache, engine, &entry);
+    }
+
+    brain_reply("MESSAGE depth %d score %d nodes %lld time %lld", result.depth, result.score, result.nodes, result.time_ms);
+    engine_make_move(engine, result.row, result.col);
+    brain_reply("%d,%d", result.col, result.row);
+}
+
+int parse_coords(const char *text, int *row, int *col) {
+    int x, y;
+    if (sscanf(text, "%d,%d", &x, &y) != 2 || x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
+        return 0;
+    }
+    *row = y;
+    *col = x;
+    return 1;
+}
+
+void handle_start(const char *args) {
+    int size = atoi(args);
+    if (size != BOARD_SIZE) {
+        brain_reply("ERROR only %dx%d boards are supported", BOARD_SIZE, BOARD_SIZE);
+        return;
+    }
+    if (!brain_prepare_table()) {
+        brain_reply("ERROR not enough memory");
+        return;
+    }
+    engine_reset(&brain.engine);
+    brain.started = 1;
+    brain_reply("OK");
+}
+
+void handle_info(const char *args) {
+    char key[64];
+    long long value;
+    if (sscanf(args, "%63s %lld", key, &value) != 2) {
+        return;
+    }
+    if (strcasecmp(key, "timeout_turn") == 0) {
+        brain.timeout_turn = value;
+    } else if (strcasecmp(key, "timeout_match") == 0) {
+        brain.timeout_match = value;
+    } else if (strcasecmp(key, "time_left") == 0) {
+        brain.time_left = value;
+    } else if (strcasecmp(key, "max_memory") == 0) {
+        brain.max_memory = (size_t)value;
+        if (brain.started) {
+            brain_prepare_table();
+        }
+    } else if (strcasecmp(key, "rule") == 0 && (value & GOMOCUP_RULE_MASK) != GOMOCUP_RULE) {
+        // The rule variant is fixed at compile time with -DCARO_RULE
+        brain_reply("MESSAGE built for rule %d, not %lld", GOMOCUP_RULE, value & GOMOCUP_RULE_MASK);
+    }
+}
+
+void handle_board(long long received_ms) {
+    int board[BOARD_SIZE][BOARD_SIZE] = {{0}};
+    int own_count = 0;
+    int opponent_count = 0;
+    char line[256];
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (strncasecmp(line, "DONE", 4) == 0) {
+            break;
+        }
+        int x, y, field;
+        if (sscanf(line, "%d,%d,%d", &x, &y, &field) == 3 &&
+            x >= 0 && x < BOARD_SIZE && y >= 0 && y < BOARD_SIZE) {
+            if (field == 1) {
+                board[y][x] = 1;
+                own_count++;
+            } else if (field == 2) {
+                board[y][x] = 2;
+                opponent_count++;
+            }
+        }
+    }
+
+    // Stones are given as own=1/opponent=2; renumber so player 1 moved first
+    int own = opponent_count > own_count ? 2 : 1;
+    if (own == 2) {
+        for (int i = 0; i < BOARD_SIZE; i++) {
+            for (int j = 0; j < BOARD_SIZE; j++) {
+                if (board[i][j] != 0) {
+                    board[i][j] = 3 - board[i][j];
+                }
+            }
+        }
+    }
+    engine_setup(&brain.engine, board, own);
+    brain_think(received_ms);
+}
+
+void handle_takeback(const char *args) {
+    Engine *engine = &brain.engine;
+    int row, col;
+    if (!parse_coords(args, &row, &col) || engine->cells[row * BOARD_SIZE + col] == 0) {
+        brain_reply("ERROR bad takeback");
+        return;
+    }
+
+    int cell = row * BOARD_SIZE + col;
+    if (engine->moves[engine->move_count - 1] == cell) {
+        engine_unmake_move(engine);
+    } else {
+        // Not the last stone: rebuild the position without it
+        int board[BOARD_SIZE][BOARD_SIZE];
+        int side = engine->side;
+        for (int c = 0; c < BOARD_CELLS; c++) {
+            board[c / BOARD_SIZE][c % BOARD_SIZE] = c == cell ? 0 : engine->cells[c];
+        }
+        engine_setup(engine, board, 3 - side);
+    }
+    brain_reply("OK");
+}
+
+// Fixed bench positions as move lists, row,col from the first move on
+static const char *bench_positions[] = {
+    "",
+    "7,7",
+    "7,7 7,8 8,8 6,6",
+    "7,7 8,8 7,8 7,6 6,7 8,7 9,8 8,6",
+    "7,7 6,8 8,8 6,6 6,7 8,9 9,9 5,7 7,9 4,6",
+    "7,7 7,8 6,6 8,8 5,5 4,4 6,8 8,6 6,7 6,9 5,8 4,9",
+    "3,3 3,4 4,4 2,2 5,5 6,6 4,5 4,3 5,3 2,5 5,4 5,6",
+    "11,11 10,10 11,10 11,12 10,11 12,11 9,12 12,9 12,12 8,13 10,12 10,9 9,11 13,13",
+};
+#define BENCH_POSITION_COUNT ((int)(sizeof(bench_positions) / sizeof(bench_positions[0])))
+
+int setup_bench_position(Engine *engine, const char *moves) {
+    char copy[512];
+    engine_reset(engine);
+    strncpy(copy, moves, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+    for (char *token = strtok(copy, " "); token != NULL; token = strtok(NULL, " ")) {
+        int row, col;
+        if (sscanf(token, "%d,%d", &row, &col) != 2 || !engine_is_legal(engine, row, col)) {
+            return 0;
+        }
+        engine_make_move(engine, row, col);
+    }
+    return 1;
+}
+
+// Single-threaded fixed-depth searches with a fresh table per position. The
+// node total is a deterministic signature of the search; any change to it
+// means the search tree changed.
+int run_bench(int depth) {
+    Engine engine;
+    TransTable tt;
+    SearchLimits limits = {0};
+    long long total_nodes = 0;
+
+    limits.max_depth = depth;
+    if (!tt_init(&tt, BENCH_TT_MB)) {
+        return 1;
+    }
+
+    long long start_ms = engine_now_ms();
+    for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+        SearchInfo result;
+        if (!setup_bench_position(&engine, bench_positions[i])) {
+            fprintf(stderr, "Error: Bad bench position %d\n", i);
+            return 1;
+        }
+        tt_clear(&tt);
+        if (engine_search(&engine, &tt, &limits, NULL, NULL, &result)) {
+            printf("Position %d: best %d,%d score %d nodes %lld\n", i + 1, result.row, result.col, result.score, result.nodes);
+            total_nodes += result.nodes;
+        }
+    }
+    long long elapsed_ms = engine_now_ms() - start_ms;
+
+    printf("Nodes: %lld\n", total_nodes);
+    printf("Time: %lld ms\n", elapsed_ms);
+    printf("NPS: %lld\n", elapsed_ms > 0 ? total_nodes * 1000 / elapsed_ms : total_nodes);
+    tt_free(&tt);
+    return 0;
+}
+
+// Counts move sequences of the given length; a finished game has no moves.
+long long perft(Engine *engine, int depth) {
+    if (depth == 0) {
+        return 1;
+    }
+    if (engine->winner != 0) {
+        return 0;
+    }
+
+    long long count = 0;
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        if (engine->cells[cell] != 0) {
+            continue;
+        }
+        if (depth == 1) {
+            count++;
+            continue;
+        }
+        engine_make_move(engine, cell / BOARD_SIZE, cell % BOARD_SIZE);
+        count += perft(engine, depth - 1);
+        engine_unmake_move(engine);
+    }
+    return count;
+}
+
+int run_perft(int depth) {
+    Engine engine;
+    long long total = 0;
+
+    long long start_ms = engine_now_ms();
+    for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+        if (!setup_bench_position(&engine, bench_positions[i])) {
+            fprintf(stderr, "Error: Bad bench position %d\n", i);
+            return 1;
+        }
+        long long count = perft(&engine, depth);
+        printf("Position %d: perft(%d) = %lld\n", i + 1, depth, count);
+        total += count;
+    }
+    long long elapsed_ms = engine_now_ms() - start_ms;
+
+    printf("Total: %lld\n", total);
+    printf("Time: %lld ms\n", elapsed_ms);
+    printf("Leaves per second: %lld\n", elapsed_ms > 0 ? total * 1000 / elapsed_ms : total);
+    return 0;
+}
+
+// Times the scalar and SIMD move ordering scorers on every empty cell of
+// each prefix of the bench games, and checks that they agree exactly.
+long long time_scorer(Engine *positions, int count, int iterations, int scorer, int scores[][BOARD_CELLS]) {
+    int moves[BOARD_CELLS];
+    long long start_ns;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    start_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < count; i++) {
+            int move_count = 0;
+            for (int cell = 0; cell < BOARD_CELLS; cell++) {
+                if (positions[i].cells[cell] == 0) {
+                    moves[move_count++] = cell;
+                }
+            }
+            engine_score_moves(&positions[i], moves, move_count, scores[i], scorer);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec - start_ns;
+}
+
+int run_order_bench(int iterations) {
+    static Engine positions[BOARD_CELLS];
+    static int scalar_scores[BOARD_CELLS][BOARD_CELLS];
+    static int simd_scores[BOARD_CELLS][BOARD_CELLS];
+    int count = 0;
+
+    for (int i = 0; i < BENCH_POSITION_COUNT; i++) {
+        Engine engine;
+        if (!setup_bench_position(&engine, bench_positions[i])) {
+            fprintf(stderr, "Error: Bad bench position %d\n", i);
+            return 1;
+        }
+        // Every prefix of the game, so both sides get scored
+        while (count < BOARD_CELLS) {
+            positions[count++] = engine;
+            if (engine.move_count == 0) {
+                break;
+            }
+            engine_unmake_move(&engine);
+        }
+    }
+
+    long long scalar_ns = time_scorer(positions, count, iterations, ENGINE_SCORER_SCALAR, scalar_scores);
+    long long simd_ns = time_scorer(positions, count, iterations, ENGINE_SCORER_SIMD, simd_scores);
+    if (memcmp(scalar_scores, simd_scores, sizeof(scalar_scores)) != 0) {
+        fprintf(stderr, "Error: SIMD scores differ from scalar scores\n");
+        return 1;
+    }
+
+    long long calls = (long long)count * iterations;
+    printf("Positions: %d\n", count);
+    printf("SIMD: %s\n", engine_has_simd() ? "avx2" : "none");
+    printf("Scalar: %lld ns per position\n", scalar_ns / calls);
+    printf("Vector: %lld ns per position\n", simd_ns / calls);
+    printf("Speedup: %.2fx\n", simd_ns > 0 ? (double)scalar_ns / simd_ns : 0.0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    char line[256];
+
+    engine_init();
+    brain.timeout_turn = BRAIN_DEFAULT_TURN_MS;
+
+    // Benchmarks run with the built-in weights so their output stays stable
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return run_bench(argc > 2 ? atoi(argv[2]) : BENCH_DEPTH);
+    }
+    if (argc > 1 && strcmp(argv[1], "perft") == 0) {
+        return run_perft(argc > 2 ? atoi(argv[2]) : PERFT_DEPTH);
+    }
+    if (argc > 1 && strcmp(argv[1], "order") == 0) {
+        return run_order_bench(argc > 2 ? atoi(argv[2]) : ORDER_ITERATIONS);
+    }
+
+    // Tuned weights are optional; the built-in ones are used without a file
+    const char *weights_path = getenv("CARO_WEIGHTS") != NULL ? getenv("CARO_WEIGHTS") : BRAIN_WEIGHTS_FILE;
+    engine_load_weights(weights_path);
+    if (getenv("CARO_SOLVED") != NULL && !solved_open(&brain.solved, getenv("CARO_SOLVED"))) {
+        fprintf(stderr, "Warning: %s is not a solved table for this board and rule\n", getenv("CARO_SOLVED"));
+    }
+    if (getenv("CARO_CACHE") != NULL && !cache_open(&brain.cache, getenv("CARO_CACHE"), BRAIN_CACHE_MB)) {
+        fprintf(stderr, "Warning: Cannot use %s as an analysis cache\n", getenv("CARO_CACHE"));
+    }
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        long long received_ms = engine_now_ms();
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *args = strchr(line, ' ');
+        if (args != NULL) {
+            *args++ = '\0';
+        } else {
+            args = line + strlen(line);
+        }
+
+        if (strcasecmp(line, "START") == 0) {
+            handle_start(args);
+        } else if (strcasecmp(line, "RECTSTART") == 0) {
+            int width, height;
+            if (sscanf(args, "%d,%d", &width, &height) == 2 && width == BOARD_SIZE && height == BOARD_SIZE) {
+                handle_start(args);
+            } else {
+                brain_reply("ERROR only %dx%d boards are supported", BOARD_SIZE, BOARD_SIZE);
+            }
+        } else if (strcasecmp(line, "END") == 0) {
+            break;
+        } else if (strcasecmp(line, "ABOUT") == 0) {
+            brain_reply("name=\"%s\", version=\"%s\", country=\"Vietnam\"", BRAIN_NAME, BRAIN_VERSION);
+        } else if (strcasecmp(line, "INFO") == 0) {
+            handle_info(args);
+        } else if (!brain.started) {
+            brain_reply("ERROR send START first");
+        } else if (strcasecmp(line, "RESTART") == 0) {
+            engine_reset(&brain.engine);
+            brain_reply("OK");
+        } else if (strcasecmp(line, "BEGIN") == 0) {
+            engine_reset(&brain.engine);
+            brain_think(received_ms);
+        } else if (strcasecmp(line, "TURN") == 0) {
+            int row, col;
+            if (!parse_coords(args, &row, &col) || !engine_is_legal(&brain.engine, row, col)) {
+                brain_reply("ERROR bad move %s", args);
+            } else {
+                engine_make_move(&brain.engine, row, col);
+                brain_think(received_ms);
+            }
+        } else if (strcasecmp(line, "BOARD") == 0) {
+            handle_board(received_ms);
+        } else if (strcasecmp(line, "TAKEBACK") == 0) {
+            handle_takeback(args);
+        } else if (line[0] != '\0') {
+            brain_reply("UNKNOWN %s", line);
+        }
+    }
+
+    tt_free(&brain.tt);
+    solved_close(&brain.solved);
+    cache_close(&brain.cache);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "caro-cache.h"
+#include "caro-rules.h"
+
+#define CACHE_CELL_BITS 10
+#define CACHE_DEPTH_BITS 6
+
+static uint64_t pack_data(int score, int cell, int depth, uint16_t stamp) {
+    return (uint64_t)(uint32_t)score | ((uint64_t)cell << 32) |
+           ((uint64_t)depth << (32 + CACHE_CELL_BITS)) | ((uint64_t)stamp << 48);
+}
+
+static int data_depth(uint64_t data) {
+    return (int)((data >> (32 + CACHE_CELL_BITS)) & ((1 << CACHE_DEPTH_BITS) - 1));
+}
+
+static uint16_t data_stamp(uint64_t data) {
+    return (uint16_t)(data >> 48);
+}
+
+// Opens or creates the cache file. An existing file keeps its own size;
+// nothing is read until a probe touches a bucket.
+int cache_open(AnalysisCache *cache, const char *path, size_t megabytes) {
+    struct stat st;
+
+    memset(cache, 0, sizeof(*cache));
+    engine_init();
+    cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0) {
+        perror("open");
+        return 0;
+    }
+    if (fstat(cache->fd, &st) < 0) {
+        perror("fstat");
+        close(cache->fd);
+        return 0;
+    }
+
+    int created = st.st_size == 0;
+    if (created) {
+        uint64_t buckets = 1;
+        while (buckets * 2 * CACHE_WAYS * sizeof(CacheSlot) <= megabytes * 1024 * 1024) {
+            buckets *= 2;
+        }
+        cache->size = sizeof(CacheHeader) + buckets * CACHE_WAYS * sizeof(CacheSlot);
+        // Sparse file: untouched buckets cost no disk space
+        if (ftruncate(cache->fd, cache->size) < 0) {
+            perror("ftruncate");
+            close(cache->fd);
+            return 0;
+        }
+    } else {
+        cache->size = st.st_size;
+    }
+
+    cache->base = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (cache->base == MAP_FAILED) {
+        perror("mmap");
+        close(cache->fd);
+        cache->base = NULL;
+        return 0;
+    }
+    cache->header = (CacheHeader *)cache->base;
+    cache->slots = (CacheSlot *)(cache->base + sizeof(CacheHeader));
+
+    if (created) {
+        memcpy(cache->header->magic, CACHE_MAGIC, 8);
+        cache->header->version = CACHE_VERSION;
+        cache->header->board_size = BOARD_SIZE;
+        cache->header->ways = CACHE_WAYS;
+        cache->header->rule = CARO_RULE;
+        cache->header->win_length = WIN_LENGTH;
+        cache->header->bucket_count = (cache->size - sizeof(CacheHeader)) / (CACHE_WAYS * sizeof(CacheSlot));
+    } else if (memcmp(cache->header->magic, CACHE_MAGIC, 8) != 0 || cache->header->version != CACHE_VERSION ||
+               cache->header->board_size != BOARD_SIZE || cache->header->ways != CACHE_WAYS ||
+               cache->header->rule != CARO_RULE || cache->header->win_length != WIN_LENGTH ||
+               sizeof(CacheHeader) + cache->header->bucket_count * CACHE_WAYS * sizeof(CacheSlot) > cache->size) {
+        fprintf(stderr, "Error: %s is not a cache for this board and rule\n", path);
+        cache_close(cache);
+        return 0;
+    }
+    cache->bucket_count = cache->header->bucket_count;
+    madvise(cache->base, cache->size, MADV_RANDOM);
+    return 1;
+}
+
+void cache_close(AnalysisCache *cache) {
+    if (cache->base == NULL) {
+        return;
+    }
+    munmap(cache->base, cache->size);
+    close(cache->fd);
+    memset(cache, 0, sizeof(*cache));
+}
+
+static uint16_t next_stamp(AnalysisCache *cache) {
+    return (uint16_t)__atomic_add_fetch(&cache->header->clock, 1, __ATOMIC_RELAXED);
+}
+
+static CacheSlot *bucket_for(AnalysisCache *cache, uint64_t key) {
+    return &cache->slots[(key % cache->bucket_count) * CACHE_WAYS];
+}
+
+int cache_probe(AnalysisCache *cache, const Engine *engine, CacheEntry *entry) {
+    int symmetry;
+    if (cache->slots == NULL) {
+        return 0;
+    }
+    uint64_t key = engine_canonical_hash(engine, &symmetry);
+    CacheSlot *bucket = bucket_for(cache, key);
+
+    for (int w = 0; w < CACHE_WAYS; w++) {
+        uint64_t data = bucket[w].data;
+        if ((bucket[w].key ^ data) != key || data == 0) {
+            continue;
+        }
+        int cell = engine_unmap_cell((int)((data >> 32) & ((1 << CACHE_CELL_BITS) - 1)), symmetry);
+        entry->row = cell / BOARD_SIZE;
+        entry->col = cell % BOARD_SIZE;
+        entry->score = (int32_t)(data & 0xFFFFFFFF);
+        entry->depth = data_depth(data);
+
+        // Refresh the stamp so frequently used positions survive eviction
+        uint64_t refreshed = (data & 0x0000FFFFFFFFFFFFULL) | ((uint64_t)next_stamp(cache) << 48);
+        bucket[w].key = key ^ refreshed;
+        bucket[w].data = refreshed;
+        return 1;
+    }
+    return 0;
+}
+
+// Replaces the same position if the new result is at least as deep,
+// otherwise an empty slot, otherwise the least recently used one.
+void cache_store(AnalysisCache *cache, const Engine *engine, const CacheEntry *entry) {
+    int symmetry;
+    if (cache->slots == NULL || entry->depth < 1) {
+        return;
+    }
+    uint64_t key = engine_canonical_hash(engine, &symmetry);
+    CacheSlot *bucket = bucket_for(cache, key);
+    uint16_t stamp = next_stamp(cache);
+    int victim = -1;
+    int oldest_age = -1;
+
+    for (int w = 0; w < CACHE_WAYS; w++) {
+        uint64_t data = bucket[w].data;
+        if ((bucket[w].key ^ data) == key && data != 0) {
+            if (data_depth(data) > entry->depth) {
+                return;
+            }
+            victim = w;
+            break;
+        }
+        int age = data == 0 ? 0x10000 : (uint16_t)(stamp - data_stamp(data));
+        if (age > oldest_age) {
+            oldest_age = age;
+            victim = w;
+        }
+    }
+
+    int depth = entry->depth < (1 << CACHE_DEPTH_BITS) ? entry->depth : (1 << CACHE_DEPTH_BITS) - 1;
+    int cell = engine_map_cell(entry->row * BOARD_SIZE + entry->col, symmetry);
+    uint64_t data = pack_data(entry->score, cell, depth, stamp);
+    bucket[victim].key = key ^ data;
+    bucket[victim].data = data;
+}
\ No newline at end of file
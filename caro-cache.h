@@ -0,0 +1,55 @@
+#ifndef CARO_CACHE_H
+#define CARO_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "caro-engine.h"
+
+#define CACHE_MAGIC "CAROCACH"
+#define CACHE_VERSION 2
+#define CACHE_WAYS 4
+#define CACHE_MIN_DEPTH 6
+
+// Persistent search results shared across runs and processes. The file is
+// a fixed number of 64-byte buckets of four slots, keyed by the canonical
+// position hash. Slots use the same xor trick as the transposition table,
+// so concurrent writers can only cause misses, never wrong answers.
+typedef struct {
+    uint64_t key;    // canonical hash xor data
+    uint64_t data;   // score, canonical cell, depth and last-use stamp
+} CacheSlot;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint16_t board_size;
+    uint16_t ways;
+    uint64_t bucket_count;
+    uint64_t clock;        // bumped on every store and hit, drives eviction
+    uint8_t rule;          // CARO_RULE and WIN_LENGTH the scores were searched under
+    uint8_t win_length;
+    uint8_t padding[30];
+} CacheHeader;
+
+typedef struct {
+    int fd;
+    uint8_t *base;
+    size_t size;
+    CacheHeader *header;
+    CacheSlot *slots;
+    uint64_t bucket_count;
+} AnalysisCache;
+
+typedef struct {
+    int row;
+    int col;
+    int score;
+    int depth;
+} CacheEntry;
+
+int cache_open(AnalysisCache *cache, const char *path, size_t megabytes);
+void cache_close(AnalysisCache *cache);
+int cache_probe(AnalysisCache *cache, const Engine *engine, CacheEntry *entry);
+void cache_store(AnalysisCache *cache, const Engine *engine, const CacheEntry *entry);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "caro-engine.h"
+#include "caro-dataset.h"
+
+#define DATAGEN_TT_MB 16
+#define DATAGEN_RANDOM_PLIES 4
+#define DATAGEN_RANDOM_RADIUS 3
+
+// Self-play generator for evaluation tuning. Each thread plays whole games
+// with its own engine and table and appends them to the shared writer.
+typedef struct {
+    DatasetWriter writer;
+    int games;
+    int threads;
+    int depth;
+    long long nodes;
+    uint64_t seed;
+    pthread_mutex_t lock;
+    int next_game;
+    int finished;
+} Datagen;
+
+Datagen datagen;
+
+uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// A few random stones near the centre so games do not all repeat
+void random_opening(Engine *engine, uint64_t *state) {
+    int plies = DATAGEN_RANDOM_PLIES;
+    while (plies > 0) {
+        int row = BOARD_SIZE / 2 + (int)(next_random(state) % (2 * DATAGEN_RANDOM_RADIUS + 1)) - DATAGEN_RANDOM_RADIUS;
+        int col = BOARD_SIZE / 2 + (int)(next_random(state) % (2 * DATAGEN_RANDOM_RADIUS + 1)) - DATAGEN_RANDOM_RADIUS;
+        if (engine_is_legal(engine, row, col)) {
+            engine_make_move(engine, row, col);
+            plies--;
+        }
+    }
+}
+
+int play_game(int game, TransTable *tt, PositionRecord *records) {
+    Engine engine;
+    SearchLimits limits = {0};
+    uint64_t state = datagen.seed + 0x9E3779B97F4A7C15ULL * (game + 1);
+    int count = 0;
+
+    limits.max_depth = datagen.depth;
+    limits.max_nodes = datagen.nodes;
+    engine_reset(&engine);
+    random_opening(&engine, &state);
+    tt_clear(tt);
+
+    while (engine.winner == 0 && engine.move_count < BOARD_CELLS) {
+        SearchInfo result;
+        if (!engine_search(&engine, tt, &limits, NULL, NULL, &result)) {
+            break;
+        }
+
+        PositionRecord *record = &records[count++];
+        memset(record, 0, sizeof(*record));
+        dataset_pack_board(engine.cells, record->board);
+        record->side = engine.side;
+        record->ply = engine.move_count > 255 ? 255 : engine.move_count;
+        record->score = result.score > DATASET_SCORE_LIMIT ? DATASET_SCORE_LIMIT :
+                        result.score < -DATASET_SCORE_LIMIT ? -DATASET_SCORE_LIMIT : result.score;
+        engine_make_move(&engine, result.row, result.col);
+    }
+
+    for (int i = 0; i < count; i++) {
+        records[i].result = engine.winner == 0 ? 0 : engine.winner == records[i].side ? 1 : -1;
+    }
+    return count;
+}
+
+void *datagen_worker(void *arg) {
+    (void)arg;
+    PositionRecord records[BOARD_CELLS];
+    TransTable tt;
+
+    if (!tt_init(&tt, DATAGEN_TT_MB)) {
+        fprintf(stderr, "Error: Not enough memory for the transposition table\n");
+        return NULL;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&datagen.lock);
+        int game = datagen.next_game < datagen.games ? datagen.next_game++ : -1;
+        pthread_mutex_unlock(&datagen.lock);
+        if (game < 0) {
+            break;
+        }
+
+        int count = play_game(game, &tt, records);
+        if (!dataset_writer_append(&datagen.writer, records, count)) {
+            fprintf(stderr, "Error: Failed to write positions\n");
+            break;
+        }
+
+        pthread_mutex_lock(&datagen.lock);
+        datagen.finished++;
+        if (datagen.finished % 100 == 0) {
+            fprintf(stderr, "%d games, %llu positions\n", datagen.finished, (unsigned long long)datagen.writer.records);
+        }
+        pthread_mutex_unlock(&datagen.lock);
+    }
+
+    tt_free(&tt);
+    return NULL;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s -o positions.bin [-n games] [-j threads] [-d depth] [-N nodes] [-s seed]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    int option;
+
+    datagen.games = 1000;
+    datagen.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    datagen.depth = 4;
+    datagen.nodes = 0;
+    datagen.seed = 1;
+
+    while ((option = getopt(argc, argv, "o:n:j:d:N:s:")) != -1) {
+        switch (option) {
+            case 'o': path = optarg; break;
+            case 'n': datagen.games = atoi(optarg); break;
+            case 'j': datagen.threads = atoi(optarg); break;
+            case 'd': datagen.depth = atoi(optarg); break;
+            case 'N': datagen.nodes = atoll(optarg); break;
+            case 's': datagen.seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+    }
+    if (datagen.threads < 1) {
+        datagen.threads = 1;
+    }
+
+    engine_init();
+    if (!dataset_writer_open(&datagen.writer, path)) {
+        return 1;
+    }
+    pthread_mutex_init(&datagen.lock, NULL);
+
+    long long start_ms = engine_now_ms();
+    pthread_t *threads = malloc(datagen.threads * sizeof(pthread_t));
+    for (int i = 0; i < datagen.threads; i++) {
+        pthread_create(&threads[i], NULL, datagen_worker, NULL);
+    }
+    for (int i = 0; i < datagen.threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    long long elapsed_ms = engine_now_ms() - start_ms;
+
+    printf("%d games, %llu positions in %lld ms\n", datagen.finished,
+           (unsigned long long)datagen.writer.records, elapsed_ms);
+    int ok = dataset_writer_close(&datagen.writer);
+    pthread_mutex_destroy(&datagen.lock);
+    free(threads);
+    return ok ? 0 : 1;
+}
\ No newline at end of file
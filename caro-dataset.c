@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "caro-dataset.h"
+
+void dataset_pack_board(const int8_t *cells, uint8_t *packed) {
+    memset(packed, 0, DATASET_BOARD_BYTES);
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        packed[cell / 4] |= (uint8_t)(cells[cell] << (2 * (cell % 4)));
+    }
+}
+
+int dataset_cell(const PositionRecord *record, int cell) {
+    return (record->board[cell / 4] >> (2 * (cell % 4))) & 3;
+}
+
+void dataset_unpack_board(const PositionRecord *record, int board[BOARD_SIZE][BOARD_SIZE]) {
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        board[cell / BOARD_SIZE][cell % BOARD_SIZE] = dataset_cell(record, cell);
+    }
+}
+
+static int write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) {
+            return 0;
+        }
+        data += n;
+        size -= n;
+    }
+    return 1;
+}
+
+int dataset_writer_open(DatasetWriter *writer, const char *path) {
+    DatasetHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_MAGIC, 8);
+    header.version = DATASET_VERSION;
+    header.board_size = BOARD_SIZE;
+    header.record_size = sizeof(PositionRecord);
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        perror("open");
+        return 0;
+    }
+    writer->buffer = malloc(DATASET_WRITE_BUFFER);
+    if (writer->buffer == NULL || !write_all(writer->fd, (const uint8_t *)&header, sizeof(header))) {
+        free(writer->buffer);
+        close(writer->fd);
+        return 0;
+    }
+    writer->used = 0;
+    writer->records = 0;
+    pthread_mutex_init(&writer->lock, NULL);
+    return 1;
+}
+
+// Thread-safe; callers should hand over a whole game at a time so the lock
+// is taken once per game rather than once per position.
+int dataset_writer_append(DatasetWriter *writer, const PositionRecord *records, size_t count) {
+    const uint8_t *data = (const uint8_t *)records;
+    size_t size = count * sizeof(PositionRecord);
+    int ok = 1;
+
+    pthread_mutex_lock(&writer->lock);
+    while (size > 0 && ok) {
+        size_t chunk = DATASET_WRITE_BUFFER - writer->used;
+        if (chunk > size) {
+            chunk = size;
+        }
+        memcpy(writer->buffer + writer->used, data, chunk);
+        writer->used += chunk;
+        data += chunk;
+        size -= chunk;
+        if (writer->used == DATASET_WRITE_BUFFER) {
+            ok = write_all(writer->fd, writer->buffer, writer->used);
+            writer->used = 0;
+        }
+    }
+    writer->records += count;
+    pthread_mutex_unlock(&writer->lock);
+    return ok;
+}
+
+int dataset_writer_close(DatasetWriter *writer) {
+    int ok = write_all(writer->fd, writer->buffer, writer->used);
+    ok = close(writer->fd) == 0 && ok;
+    free(writer->buffer);
+    pthread_mutex_destroy(&writer->lock);
+    return ok;
+}
+
+int dataset_reader_open(DatasetReader *reader, const char *path) {
+    struct stat st;
+    const DatasetHeader *header;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        perror("open");
+        return 0;
+    }
+    if (fstat(reader->fd, &st) < 0 || (size_t)st.st_size < sizeof(DatasetHeader)) {
+        fprintf(stderr, "Error: %s is not a dataset\n", path);
+        close(reader->fd);
+        return 0;
+    }
+
+    // The file is only mapped; pages are read in as records are touched
+    reader->size = st.st_size;
+    reader->base = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (reader->base == MAP_FAILED) {
+        perror("mmap");
+        close(reader->fd);
+        return 0;
+    }
+
+    header = (const DatasetHeader *)reader->base;
+    if (memcmp(header->magic, DATASET_MAGIC, 8) != 0 || header->version != DATASET_VERSION ||
+        header->board_size != BOARD_SIZE || header->record_size != sizeof(PositionRecord)) {
+        fprintf(stderr, "Error: %s has an incompatible format\n", path);
+        dataset_reader_close(reader);
+        return 0;
+    }
+    reader->records = (const PositionRecord *)(reader->base + sizeof(DatasetHeader));
+    reader->count = (reader->size - sizeof(DatasetHeader)) / sizeof(PositionRecord);
+    madvise(reader->base, reader->size, MADV_SEQUENTIAL);
+    return 1;
+}
+
+void dataset_reader_close(DatasetReader *reader) {
+    if (reader->base != NULL && reader->base != MAP_FAILED) {
+        munmap(reader->base, reader->size);
+    }
+    close(reader->fd);
+    reader->base = NULL;
+    reader->records = NULL;
+    reader->count = 0;
+}
+
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void dataset_shuffle_init(DatasetShuffle *shuffle, uint64_t count, uint64_t seed) {
+    int bits = 2;
+    while (bits < 64 && (1ULL << bits) < count) {
+        bits += 2;
+    }
+    shuffle->count = count;
+    shuffle->half_bits = bits / 2;
+    shuffle->half_mask = (1ULL << shuffle->half_bits) - 1;
+    for (int r = 0; r < 4; r++) {
+        shuffle->keys[r] = mix64(seed + 0x9E3779B97F4A7C15ULL * (r + 1));
+    }
+}
+
+// Four-round Feistel network over the next even power of two, walking the
+// cycle until the value falls inside [0, count). Needs no memory per record.
+uint64_t dataset_shuffle_index(const DatasetShuffle *shuffle, uint64_t i) {
+    if (shuffle->count == 0) {
+        return 0;
+    }
+    do {
+        uint64_t left = i >> shuffle->half_bits;
+        uint64_t right = i & shuffle->half_mask;
+        for (int r = 0; r < 4; r++) {
+            uint64_t next = left ^ (mix64(right ^ shuffle->keys[r]) & shuffle->half_mask);
+            left = right;
+            right = next;
+        }
+        i = (left << shuffle->half_bits) | right;
+    } while (i >= shuffle->count);
+    return i;
+}
\ No newline at end of file
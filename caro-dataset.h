@@ -0,0 +1,74 @@
+#ifndef CARO_DATASET_H
+#define CARO_DATASET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "caro-engine.h"
+
+#define DATASET_MAGIC "CARODATA"
+#define DATASET_VERSION 1
+#define DATASET_BOARD_BYTES ((2 * BOARD_CELLS + 7) / 8)
+#define DATASET_WRITE_BUFFER (1 << 20)
+#define DATASET_SCORE_LIMIT 32000
+
+// Fixed-size training record. The board is packed two bits per cell in
+// row-major order (0 empty, 1 or 2 for the player); on the default 15x15
+// board a record is exactly 64 bytes.
+typedef struct {
+    int16_t score;       // search score for the side to move, clamped
+    uint8_t board[DATASET_BOARD_BYTES];
+    uint8_t side;        // player to move, 1 or 2
+    int8_t result;       // final result for the side to move: 1, 0 or -1
+    uint8_t ply;         // stones on the board, saturated at 255
+    uint8_t padding[(64 - (DATASET_BOARD_BYTES + 5) % 64) % 64];
+} PositionRecord;
+
+_Static_assert(sizeof(PositionRecord) % 64 == 0, "PositionRecord must fill whole 64-byte lines");
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint16_t board_size;
+    uint16_t record_size;
+} DatasetHeader;
+
+typedef struct {
+    int fd;
+    uint8_t *buffer;
+    size_t used;
+    uint64_t records;
+    pthread_mutex_t lock;
+} DatasetWriter;
+
+typedef struct {
+    int fd;
+    uint8_t *base;
+    size_t size;
+    const PositionRecord *records;
+    uint64_t count;
+} DatasetReader;
+
+// Stateless pseudo-random permutation of [0, count) for shuffled passes
+typedef struct {
+    uint64_t count;
+    uint64_t half_bits;
+    uint64_t half_mask;
+    uint64_t keys[4];
+} DatasetShuffle;
+
+void dataset_pack_board(const int8_t *cells, uint8_t *packed);
+void dataset_unpack_board(const PositionRecord *record, int board[BOARD_SIZE][BOARD_SIZE]);
+int dataset_cell(const PositionRecord *record, int cell);
+
+int dataset_writer_open(DatasetWriter *writer, const char *path);
+int dataset_writer_append(DatasetWriter *writer, const PositionRecord *records, size_t count);
+int dataset_writer_close(DatasetWriter *writer);
+
+int dataset_reader_open(DatasetReader *reader, const char *path);
+void dataset_reader_close(DatasetReader *reader);
+
+void dataset_shuffle_init(DatasetShuffle *shuffle, uint64_t count, uint64_t seed);
+uint64_t dataset_shuffle_index(const DatasetShuffle *shuffle, uint64_t i);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1032 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "caro-engine.h"
+#include "caro-rules.h"
+
+#define TT_EXACT 1
+#define TT_LOWER 2
+#define TT_UPPER 3
+#define NO_MOVE 0xFFFF
+
+// Rows of cell_windows are padded to whole 8-lane vectors with a dummy
+// window whose ordering value is always zero.
+#define CELL_WINDOWS_PADDED ((CELL_WINDOWS + 7) & ~7)
+#define DUMMY_WINDOW WINDOW_COUNT
+#define WINDOW_VECTORS (WINDOW_COUNT & ~7)   // windows the AVX2 scorer takes eight at a time
+
+// Smallest window stone count the threat index tracks: the one that turns
+// into a three when the cell is played
+#define THREAT_MIN_STONES (WIN_LENGTH > 3 ? WIN_LENGTH - 3 : 1)
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define ENGINE_HAVE_AVX2 1
+#endif
+
+#if WIN_LENGTH == 5
+int engine_weights[2][WIN_LENGTH] = {
+    {0, 2, 24, 300, 5000},
+    {0, 2, 20, 240, 3000},
+};
+#else
+// Other line lengths start from a geometric guess filled in by build_tables
+int engine_weights[2][WIN_LENGTH];
+#endif
+
+static int window_cells[WINDOW_COUNT][WIN_LENGTH];
+static int cell_windows[BOARD_CELLS][CELL_WINDOWS_PADDED];
+static int cell_window_count[BOARD_CELLS];
+static uint64_t zobrist[2][BOARD_CELLS];
+static uint64_t zobrist_side;
+static int symmetry_map[8][BOARD_CELLS];
+static int symmetry_unmap[8][BOARD_CELLS];
+static int order_attack[WIN_LENGTH + 1];
+static int order_defend[WIN_LENGTH + 1];
+static int use_avx2;
+static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void add_window(int *count, int row, int col, int drow, int dcol) {
+    int w = (*count)++;
+    for (int k = 0; k < WIN_LENGTH; k++) {
+        int cell = (row + k * drow) * BOARD_SIZE + (col + k * dcol);
+        window_cells[w][k] = cell;
+        cell_windows[cell][cell_window_count[cell]++] = w;
+    }
+}
+
+static void build_tables(void) {
+    int count = 0;
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        for (int k = 0; k < CELL_WINDOWS_PADDED; k++) {
+            cell_windows[cell][k] = DUMMY_WINDOW;
+        }
+    }
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            if (j + WIN_LENGTH <= BOARD_SIZE) {
+                add_window(&count, i, j, 0, 1);
+            }
+            if (i + WIN_LENGTH <= BOARD_SIZE) {
+                add_window(&count, i, j, 1, 0);
+            }
+            if (i + WIN_LENGTH <= BOARD_SIZE && j + WIN_LENGTH <= BOARD_SIZE) {
+                add_window(&count, i, j, 1, 1);
+            }
+            if (i + WIN_LENGTH <= BOARD_SIZE && j - WIN_LENGTH + 1 >= 0) {
+                add_window(&count, i, j, 1, -1);
+            }
+        }
+    }
+
+    uint64_t seed = 0x5EED5EED12345678ULL;
+    for (int p = 0; p < 2; p++) {
+        for (int c = 0; c < BOARD_CELLS; c++) {
+            zobrist[p][c] = splitmix64(&seed);
+        }
+    }
+    zobrist_side = splitmix64(&seed);
+
+    // The 8 symmetries of the square: bit 0 mirrors columns, bit 1 mirrors
+    // rows and bit 2 transposes.
+    for (int s = 0; s < 8; s++) {
+        for (int i = 0; i < BOARD_SIZE; i++) {
+            for (int j = 0; j < BOARD_SIZE; j++) {
+                int r = (s & 2) ? BOARD_SIZE - 1 - i : i;
+                int c = (s & 1) ? BOARD_SIZE - 1 - j : j;
+                int cell = (s & 4) ? c * BOARD_SIZE + r : r * BOARD_SIZE + c;
+                symmetry_map[s][i * BOARD_SIZE + j] = cell;
+                symmetry_unmap[s][cell] = i * BOARD_SIZE + j;
+            }
+        }
+    }
+
+    // Move ordering values: completing a line beats blocking one, which
+    // beats everything else.
+    for (int k = 1; k <= WIN_LENGTH; k++) {
+        order_attack[k] = 1 << (3 * k);
+        order_defend[k] = 1 << (3 * k - 1);
+    }
+    order_attack[WIN_LENGTH - 1] = 1 << 24;
+    order_defend[WIN_LENGTH - 1] = 1 << 22;
+
+#ifdef ENGINE_HAVE_AVX2
+    __builtin_cpu_init();
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+#if WIN_LENGTH != 5
+    for (int k = 1; k < WIN_LENGTH; k++) {
+        engine_weights[0][k] = 1 << (3 * k - 2);
+        engine_weights[1][k] = engine_weights[0][k];
+    }
+#endif
+}
+
+void engine_init(void) {
+    pthread_once(&engine_once, build_tables);
+}
+
+// Weight files hold one line per side: "own" or "opponent" followed by a
+// value for each stone count from 0 to WIN_LENGTH - 1.
+int engine_load_weights(const char *path) {
+    int weights[2][WIN_LENGTH];
+    int seen[2] = {0, 0};
+    char line[256];
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        return 0;
+    }
+    memcpy(weights, engine_weights, sizeof(weights));
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[16];
+        int offset;
+        if (line[0] == '#' || sscanf(line, "%15s%n", name, &offset) != 1) {
+            continue;
+        }
+        int side = strcmp(name, "own") == 0 ? 0 : strcmp(name, "opponent") == 0 ? 1 : -1;
+        if (side < 0) {
+            continue;
+        }
+        char *cursor = line + offset;
+        for (int k = 0; k < WIN_LENGTH; k++) {
+            int consumed;
+            if (sscanf(cursor, "%d%n", &weights[side][k], &consumed) != 1) {
+                fclose(file);
+                return 0;
+            }
+            cursor += consumed;
+        }
+        seen[side] = 1;
+    }
+    fclose(file);
+
+    if (!seen[0] || !seen[1]) {
+        return 0;
+    }
+    memcpy(engine_weights, weights, sizeof(weights));
+    return 1;
+}
+
+int engine_save_weights(const char *path, int weights[2][WIN_LENGTH]) {
+    static const char *names[2] = {"own", "opponent"};
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        return 0;
+    }
+    fprintf(file, "# caro-engine evaluation weights per window stone count\n");
+    for (int side = 0; side < 2; side++) {
+        fprintf(file, "%s", names[side]);
+        for (int k = 0; k < WIN_LENGTH; k++) {
+            fprintf(file, " %d", weights[side][k]);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+long long engine_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long long engine_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int tt_init(TransTable *tt, size_t megabytes) {
+    size_t count = 1;
+    while (count * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024) {
+        count *= 2;
+    }
+    tt->entries = calloc(count, sizeof(TTEntry));
+    if (tt->entries == NULL) {
+        tt->mask = 0;
+        return 0;
+    }
+    tt->mask = count - 1;
+    return 1;
+}
+
+void tt_clear(TransTable *tt) {
+    memset(tt->entries, 0, (tt->mask + 1) * sizeof(TTEntry));
+}
+
+void tt_free(TransTable *tt) {
+    free(tt->entries);
+    tt->entries = NULL;
+    tt->mask = 0;
+}
+
+static int tt_probe(TransTable *tt, uint64_t key, int *score, int *move, int *depth, int *flag) {
+    if (tt == NULL || tt->entries == NULL) {
+        return 0;
+    }
+    TTEntry *entry = &tt->entries[key & tt->mask];
+    uint64_t data = entry->data;
+    if ((entry->key ^ data) != key) {
+        return 0;
+    }
+    *score = (int32_t)(data & 0xFFFFFFFF);
+    *move = (int)((data >> 32) & 0xFFFF);
+    *depth = (int)((data >> 48) & 0xFF);
+    *flag = (int)(data >> 56);
+    return 1;
+}
+
+static void tt_store(TransTable *tt, uint64_t key, int score, int move, int depth, int flag) {
+    if (tt == NULL || tt->entries == NULL) {
+        return;
+    }
+    TTEntry *entry = &tt->entries[key & tt->mask];
+    uint64_t old = entry->data;
+    if ((entry->key ^ old) == key && (int)((old >> 48) & 0xFF) > depth) {
+        return;
+    }
+    uint64_t data = (uint64_t)(uint32_t)score | ((uint64_t)(move & 0xFFFF) << 32) |
+                    ((uint64_t)(depth & 0xFF) << 48) | ((uint64_t)flag << 56);
+    entry->key = key ^ data;
+    entry->data = data;
+}
+
+void engine_reset(Engine *engine) {
+    engine_init();
+    memset(engine, 0, sizeof(*engine));
+    engine->side = 1;
+}
+
+static void update_near(Engine *engine, int cell, int delta) {
+    int row = cell / BOARD_SIZE;
+    int col = cell % BOARD_SIZE;
+    for (int i = row - 2; i <= row + 2; i++) {
+        for (int j = col - 2; j <= col + 2; j++) {
+            if (i >= 0 && i < BOARD_SIZE && j >= 0 && j < BOARD_SIZE) {
+                engine->near[i * BOARD_SIZE + j] += delta;
+            }
+        }
+    }
+}
+
+// Moves every cell of window w between threat index classes for player p.
+// Only the classes engine_threat reads are kept; the rest are skipped so
+// the many nearly empty windows cost nothing.
+static void shift_threat(Engine *engine, int w, int p, int from, int to) {
+    uint8_t (*lines)[WIN_LENGTH] = engine->threat_lines[p];
+    const int *cells = window_cells[w];
+    if (from >= THREAT_MIN_STONES && from < WIN_LENGTH) {
+        for (int k = 0; k < WIN_LENGTH; k++) {
+            lines[cells[k]][from]--;
+        }
+    }
+    if (to >= THREAT_MIN_STONES && to < WIN_LENGTH) {
+        for (int k = 0; k < WIN_LENGTH; k++) {
+            lines[cells[k]][to]++;
+        }
+    }
+}
+
+static const int line_steps[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+// Builds the lines through cell for the rule checks; the cell itself
+// counts as player's stone whether or not it has been played yet.
+static void rule_lines(const Engine *engine, int cell, int player, int8_t lines[4][RULE_LINE]) {
+    int row = cell / BOARD_SIZE;
+    int col = cell % BOARD_SIZE;
+    for (int d = 0; d < 4; d++) {
+        for (int t = -RULE_RADIUS; t <= RULE_RADIUS; t++) {
+            int i = row + t * line_steps[d][0];
+            int j = col + t * line_steps[d][1];
+            int8_t value = LINE_WALL;
+            if (t == 0) {
+                value = LINE_OWN;
+            } else if (i >= 0 && i < BOARD_SIZE && j >= 0 && j < BOARD_SIZE) {
+                int stone = engine->cells[i * BOARD_SIZE + j];
+                value = stone == 0 ? LINE_EMPTY : stone == player ? LINE_OWN : LINE_OTHER;
+            }
+            lines[d][t + RULE_RADIUS] = value;
+        }
+    }
+}
+
+static int rule_wins(const Engine *engine, int cell, int player) {
+    int8_t lines[4][RULE_LINE];
+    rule_lines(engine, cell, player, lines);
+    return rules_is_win(lines, player);
+}
+
+// Would player win by playing the empty cell? Every rule needs a window
+// of four with the cell free, so the threat index rules most cells out.
+static int wins_at(const Engine *engine, int cell, int player) {
+    if (engine->cells[cell] != 0 || engine->threat_lines[player - 1][cell][WIN_LENGTH - 1] == 0) {
+        return 0;
+    }
+    return RULES_WINDOW_WINS || rule_wins(engine, cell, player);
+}
+
+static int has_winning_move(const Engine *engine, int player) {
+    if (engine->window_count[player - 1][WIN_LENGTH - 1] == 0) {
+        return 0;
+    }
+    if (RULES_WINDOW_WINS) {
+        return 1;
+    }
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        if (wins_at(engine, cell, player)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Renju restrictions for black. Overlines, double fours and double threes
+// all need at least two windows of the right stone counts through the
+// cell, which the threat index answers before any line is looked at.
+static int forbidden_at(const Engine *engine, int cell) {
+#if RULES_HAS_FORBIDDEN
+    const uint8_t *counts = engine->threat_lines[0][cell];
+    if (counts[WIN_LENGTH - 1] == 0 && counts[WIN_LENGTH - 2] < 2 && counts[WIN_LENGTH - 3] < 2) {
+        return 0;
+    }
+    int8_t lines[4][RULE_LINE];
+    rule_lines(engine, cell, 1, lines);
+    return rules_forbidden(lines);
+#else
+    (void)engine;
+    (void)cell;
+    return 0;
+#endif
+}
+
+int engine_is_forbidden(const Engine *engine, int row, int col) {
+    int cell = row * BOARD_SIZE + col;
+    return engine->side == 1 && engine->cells[cell] == 0 && forbidden_at(engine, cell);
+}
+
+static void place_stone(Engine *engine, int cell, int player) {
+    int p = player - 1;
+    int o = p ^ 1;
+    int made_five = 0;
+    engine->cells[cell] = player;
+    engine->hash ^= zobrist[p][cell];
+    update_near(engine, cell, 1);
+    for (int k = 0; k < cell_window_count[cell]; k++) {
+        int w = cell_windows[cell][k];
+        uint8_t *stones = engine->window_stones[w];
+        int own = stones[p];
+        int other = stones[o];
+        if (other == 0) {
+            if (own > 0) {
+                engine->window_count[p][own]--;
+            }
+            engine->window_count[p][own + 1]++;
+            shift_threat(engine, w, p, own, own + 1);
+            made_five |= own + 1 == WIN_LENGTH;
+        } else if (own == 0) {
+            engine->window_count[o][other]--;
+            shift_threat(engine, w, o, other, 0);
+        }
+        stones[p]++;
+    }
+    if (made_five && (RULES_WINDOW_WINS || rule_wins(engine, cell, player))) {
+        engine->winner = player;
+    }
+}
+
+static void remove_stone(Engine *engine, int cell) {
+    int player = engine->cells[cell];
+    int p = player - 1;
+    int o = p ^ 1;
+    engine->cells[cell] = 0;
+    engine->hash ^= zobrist[p][cell];
+    update_near(engine, cell, -1);
+    for (int k = 0; k < cell_window_count[cell]; k++) {
+        int w = cell_windows[cell][k];
+        uint8_t *stones = engine->window_stones[w];
+        int own = stones[p];
+        int other = stones[o];
+        if (other == 0) {
+            engine->window_count[p][own]--;
+            if (own > 1) {
+                engine->window_count[p][own - 1]++;
+            }
+            shift_threat(engine, w, p, own, own - 1);
+        } else if (own == 1) {
+            engine->window_count[o][other]++;
+            shift_threat(engine, w, o, 0, other);
+        }
+        stones[p]--;
+    }
+#if RULES_WINDOW_WINS
+    engine->winner = engine->window_count[0][WIN_LENGTH] > 0 ? 1 :
+                     engine->window_count[1][WIN_LENGTH] > 0 ? 2 : 0;
+#else
+    // Full windows need not be wins here, but play stops at the first win,
+    // so the position before any move had none
+    engine->winner = 0;
+#endif
+}
+
+void engine_setup(Engine *engine, int board[BOARD_SIZE][BOARD_SIZE], int side) {
+    engine_reset(engine);
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            if (board[i][j] == 1 || board[i][j] == 2) {
+                place_stone(engine, i * BOARD_SIZE + j, board[i][j]);
+                engine->moves[engine->move_count++] = i * BOARD_SIZE + j;
+            }
+        }
+    }
+    engine->side = side;
+}
+
+int engine_is_legal(const Engine *engine, int row, int col) {
+    if (row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE) {
+        return 0;
+    }
+    return engine->winner == 0 && engine->cells[row * BOARD_SIZE + col] == 0;
+}
+
+void engine_make_move(Engine *engine, int row, int col) {
+    int cell = row * BOARD_SIZE + col;
+    place_stone(engine, cell, engine->side);
+    engine->moves[engine->move_count++] = cell;
+    engine->side = 3 - engine->side;
+}
+
+void engine_unmake_move(Engine *engine) {
+    int cell = engine->moves[--engine->move_count];
+    remove_stone(engine, cell);
+    engine->side = 3 - engine->side;
+}
+
+// Hash that is the same for all 8 rotations and reflections of a position.
+// The symmetry that produced it is returned so moves can be mapped to and
+// from the canonical orientation.
+uint64_t engine_canonical_hash(const Engine *engine, int *symmetry) {
+    uint64_t best = 0;
+    for (int s = 0; s < 8; s++) {
+        uint64_t hash = engine->side == 2 ? zobrist_side : 0;
+        for (int m = 0; m < engine->move_count; m++) {
+            int cell = engine->moves[m];
+            hash ^= zobrist[engine->cells[cell] - 1][symmetry_map[s][cell]];
+        }
+        if (s == 0 || hash < best) {
+            best = hash;
+            *symmetry = s;
+        }
+    }
+    return best;
+}
+
+int engine_map_cell(int cell, int symmetry) {
+    return symmetry_map[symmetry][cell];
+}
+
+int engine_unmap_cell(int cell, int symmetry) {
+    return symmetry_unmap[symmetry][cell];
+}
+
+// Seeds the table with a known result for the current position, e.g. from a
+// persistent cache, so the next search tries that move first.
+void engine_hint(Engine *engine, TransTable *tt, int row, int col, int score, int depth) {
+    tt_store(tt, engine->hash, score, row * BOARD_SIZE + col, depth, TT_EXACT);
+}
+
+int engine_evaluate(const Engine *engine) {
+    int p = engine->side - 1;
+    int o = p ^ 1;
+    int score = 0;
+    for (int k = 1; k < WIN_LENGTH; k++) {
+        score += engine_weights[0][k] * engine->window_count[p][k];
+        score -= engine_weights[1][k] * engine->window_count[o][k];
+    }
+    return score;
+}
+
+// Classifies what playing an empty cell would make for the player, from
+// the windows through it that the opponent has not blocked.
+int engine_threat(const Engine *engine, int cell, int player) {
+    const uint8_t *lines = engine->threat_lines[player - 1][cell];
+    if (engine->cells[cell] != 0) {
+        return THREAT_NONE;
+    }
+    if (lines[WIN_LENGTH - 1] > 0) {
+        return THREAT_FIVE;
+    }
+    if (WIN_LENGTH >= 3 && lines[WIN_LENGTH - 2] > 0) {
+        return lines[WIN_LENGTH - 2] > 1 ? THREAT_DOUBLE_FOUR : THREAT_FOUR;
+    }
+    if (WIN_LENGTH >= 4 && lines[WIN_LENGTH - 3] > 1) {
+        return THREAT_THREE;
+    }
+    return THREAT_NONE;
+}
+
+// Score every empty candidate cell for move ordering by summing the value
+// of each window through it from the side to move's point of view.
+static void score_moves_scalar(const Engine *engine, const int *moves, int count, int *scores) {
+    int p = engine->side - 1;
+    int o = p ^ 1;
+    int window_value[WINDOW_COUNT + 1];
+    for (int w = 0; w < WINDOW_COUNT; w++) {
+        int own = engine->window_stones[w][p];
+        int other = engine->window_stones[w][o];
+        window_value[w] = (other == 0 ? order_attack[own] : 0) + (own == 0 ? order_defend[other] : 0);
+    }
+    window_value[DUMMY_WINDOW] = 0;
+    for (int m = 0; m < count; m++) {
+        int cell = moves[m];
+        int score = 0;
+        for (int k = 0; k < cell_window_count[cell]; k++) {
+            score += window_value[cell_windows[cell][k]];
+        }
+        scores[m] = score;
+    }
+}
+
+#ifdef ENGINE_HAVE_AVX2
+// Same sums as score_moves_scalar, eight windows at a time. Window values
+// come from gathers on the ordering tables, then each candidate gathers
+// its padded row of windows and reduces it. Integer addition is exact in
+// any order, so the result matches the scalar scorer bit for bit.
+__attribute__((target("avx2")))
+static void score_moves_avx2(const Engine *engine, const int *moves, int count, int *scores) {
+    int p = engine->side - 1;
+    int o = p ^ 1;
+    int window_value[WINDOW_COUNT + 8] __attribute__((aligned(32)));
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+
+    // Both bounds are constants, so on small boards, where the windows may
+    // all fit in whole vectors, the compiler can see the tail is empty
+    for (int w = 0; w < WINDOW_VECTORS; w += 8) {
+        // Each window is two bytes, [0] for player 1 and [1] for player 2
+        __m256i pair = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)engine->window_stones[w]));
+        __m256i first = _mm256_and_si256(pair, byte_mask);
+        __m256i second = _mm256_srli_epi32(pair, 8);
+        __m256i own = p == 0 ? first : second;
+        __m256i other = p == 0 ? second : first;
+        __m256i attack = _mm256_i32gather_epi32(order_attack, own, 4);
+        __m256i defend = _mm256_i32gather_epi32(order_defend, other, 4);
+        attack = _mm256_and_si256(attack, _mm256_cmpeq_epi32(other, zero));
+        defend = _mm256_and_si256(defend, _mm256_cmpeq_epi32(own, zero));
+        _mm256_store_si256((__m256i *)&window_value[w], _mm256_add_epi32(attack, defend));
+    }
+    for (int w = WINDOW_VECTORS; w < WINDOW_COUNT; w++) {
+        int own = engine->window_stones[w][p];
+        int other = engine->window_stones[w][o];
+        window_value[w] = (other == 0 ? order_attack[own] : 0) + (own == 0 ? order_defend[other] : 0);
+    }
+    window_value[DUMMY_WINDOW] = 0;
+
+    for (int m = 0; m < count; m++) {
+        const int *windows = cell_windows[moves[m]];
+        __m256i sum = zero;
+        for (int k = 0; k < CELL_WINDOWS_PADDED; k += 8) {
+            __m256i index = _mm256_loadu_si256((const __m256i *)&windows[k]);
+            sum = _mm256_add_epi32(sum, _mm256_i32gather_epi32(window_value, index, 4));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        scores[m] = _mm_cvtsi128_si32(half);
+    }
+}
+#endif
+
+static void score_moves(const Engine *engine, const int *moves, int count, int *scores) {
+#ifdef ENGINE_HAVE_AVX2
+    if (use_avx2) {
+        score_moves_avx2(engine, moves, count, scores);
+        return;
+    }
+#endif
+    score_moves_scalar(engine, moves, count, scores);
+}
+
+int engine_has_simd(void) {
+    engine_init();
+    return use_avx2;
+}
+
+// Exposed for benchmarking and cross-checking the two scorers; the SIMD
+// one quietly falls back to scalar when the CPU lacks AVX2.
+void engine_score_moves(const Engine *engine, const int *moves, int count, int *scores, int scorer) {
+    if (scorer == ENGINE_SCORER_SCALAR) {
+        score_moves_scalar(engine, moves, count, scores);
+    } else {
+        score_moves(engine, moves, count, scores);
+    }
+}
+
+static int generate_moves(Engine *engine, int *moves, int limit, int tt_move, int ply) {
+    int count = 0;
+    int o = 2 - engine->side;
+
+    if (engine->move_count == 0) {
+        moves[0] = (BOARD_SIZE / 2) * BOARD_SIZE + BOARD_SIZE / 2;
+        return 1;
+    }
+
+    if (has_winning_move(engine, o + 1)) {
+        // The opponent threatens to complete a line: only blocks are worth trying.
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            if (wins_at(engine, cell, o + 1)) {
+                moves[count++] = cell;
+            }
+        }
+    } else {
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            if (engine->cells[cell] == 0 && engine->near[cell] > 0) {
+                moves[count++] = cell;
+            }
+        }
+    }
+    if (RULES_HAS_FORBIDDEN && engine->side == 1) {
+        int kept = 0;
+        for (int m = 0; m < count; m++) {
+            if (!forbidden_at(engine, moves[m])) {
+                moves[kept++] = moves[m];
+            }
+        }
+        count = kept;
+    }
+
+    int scores[BOARD_CELLS];
+    score_moves(engine, moves, count, scores);
+    for (int m = 0; m < count; m++) {
+        if (moves[m] == tt_move) {
+            scores[m] = 1 << 30;
+        } else if (ply <= ENGINE_MAX_DEPTH &&
+                   (moves[m] == engine->killers[ply][0] || moves[m] == engine->killers[ply][1])) {
+            scores[m] += 1 << 20;
+        }
+    }
+
+    // Insertion sort, highest score first and lowest cell on ties
+    for (int i = 1; i < count; i++) {
+        int move = moves[i];
+        int score = scores[i];
+        int j = i - 1;
+        while (j >= 0 && scores[j] < score) {
+            moves[j + 1] = moves[j];
+            scores[j + 1] = scores[j];
+            j--;
+        }
+        moves[j + 1] = move;
+        scores[j + 1] = score;
+    }
+
+    return count < limit ? count : limit;
+}
+
+static void check_limits(Engine *engine) {
+    const SearchLimits *limits = engine->limits;
+    if (limits->stop != NULL && atomic_load_explicit(limits->stop, memory_order_relaxed)) {
+        engine->stopped = 1;
+    } else if (limits->time_ms > 0 && engine_now_ms() - engine->start_ms >= limits->time_ms) {
+        engine->stopped = 1;
+    } else if (limits->max_nodes > 0 && engine->nodes >= limits->max_nodes) {
+        engine->stopped = 1;
+    }
+}
+
+static int score_to_tt(int score, int ply) {
+    if (score >= ENGINE_WIN_THRESHOLD) {
+        return score + ply;
+    }
+    if (score <= -ENGINE_WIN_THRESHOLD) {
+        return score - ply;
+    }
+    return score;
+}
+
+static int score_from_tt(int score, int ply) {
+    if (score >= ENGINE_WIN_THRESHOLD) {
+        return score - ply;
+    }
+    if (score <= -ENGINE_WIN_THRESHOLD) {
+        return score + ply;
+    }
+    return score;
+}
+
+static int negamax(Engine *engine, int depth, int ply, int alpha, int beta) {
+    engine->nodes++;
+    if ((engine->nodes & 255) == 0) {
+        check_limits(engine);
+    }
+    if (engine->stopped) {
+        return 0;
+    }
+    if (engine->winner != 0) {
+        return -(ENGINE_WIN_SCORE - ply);
+    }
+    if (engine->move_count == BOARD_CELLS) {
+        return 0;
+    }
+    if (has_winning_move(engine, engine->side)) {
+        return ENGINE_WIN_SCORE - ply - 1;
+    }
+    if (depth <= 0 || ply >= ENGINE_MAX_DEPTH) {
+        return engine_evaluate(engine);
+    }
+
+    int tt_score, tt_move = NO_MOVE, tt_depth, tt_flag;
+    if (tt_probe(engine->tt, engine->hash, &tt_score, &tt_move, &tt_depth, &tt_flag) && tt_depth >= depth) {
+        tt_score = score_from_tt(tt_score, ply);
+        if (tt_flag == TT_EXACT ||
+            (tt_flag == TT_LOWER && tt_score >= beta) ||
+            (tt_flag == TT_UPPER && tt_score <= alpha)) {
+            return tt_score;
+        }
+    }
+
+    int moves[BOARD_CELLS];
+    int count = generate_moves(engine, moves, ENGINE_MAX_CANDIDATES, tt_move, ply);
+    if (count == 0) {
+        // Only forbidden moves left (Renju), so black loses
+        return -(ENGINE_WIN_SCORE - ply - 2);
+    }
+    int original_alpha = alpha;
+    int best_score = -ENGINE_INFINITY;
+    int best_move = moves[0];
+
+    for (int m = 0; m < count; m++) {
+        int cell = moves[m];
+        engine_make_move(engine, cell / BOARD_SIZE, cell % BOARD_SIZE);
+        int score;
+        if (m == 0) {
+            score = -negamax(engine, depth - 1, ply + 1, -beta, -alpha);
+        } else {
+            score = -negamax(engine, depth - 1, ply + 1, -alpha - 1, -alpha);
+            if (score > alpha && score < beta) {
+                score = -negamax(engine, depth - 1, ply + 1, -beta, -alpha);
+            }
+        }
+        engine_unmake_move(engine);
+        if (engine->stopped) {
+            return 0;
+        }
+
+        if (score > best_score) {
+            best_score = score;
+            best_move = cell;
+        }
+        if (score > alpha) {
+            alpha = score;
+        }
+        if (alpha >= beta) {
+            if (engine->killers[ply][0] != cell) {
+                engine->killers[ply][1] = engine->killers[ply][0];
+                engine->killers[ply][0] = cell;
+            }
+            break;
+        }
+    }
+
+    int flag = best_score <= original_alpha ? TT_UPPER : best_score >= beta ? TT_LOWER : TT_EXACT;
+    tt_store(engine->tt, engine->hash, score_to_tt(best_score, ply), best_move, depth, flag);
+    return best_score;
+}
+
+// Iterative deepening over the root moves, skipping any cell marked in
+// excluded (used for multi-PV).
+static int search_root(Engine *engine, TransTable *tt, const SearchLimits *limits,
+                       SearchCallback callback, void *user_data, SearchInfo *result,
+                       const uint8_t *excluded) {
+    int moves[BOARD_CELLS];
+    int tt_score, tt_move = NO_MOVE, tt_depth, tt_flag;
+
+    engine->tt = tt;
+    engine->limits = limits;
+    engine->start_ms = engine_now_ms();
+    engine->nodes = 0;
+    engine->stopped = 0;
+    for (int i = 0; i <= ENGINE_MAX_DEPTH; i++) {
+        engine->killers[i][0] = engine->killers[i][1] = NO_MOVE;
+    }
+
+    if (engine->winner != 0 || engine->move_count == BOARD_CELLS) {
+        return 0;
+    }
+
+    tt_probe(tt, engine->hash, &tt_score, &tt_move, &tt_depth, &tt_flag);
+    int count = generate_moves(engine, moves, ENGINE_ROOT_CANDIDATES, tt_move, 0);
+    if (excluded != NULL) {
+        int kept = 0;
+        for (int m = 0; m < count; m++) {
+            if (!excluded[moves[m]]) {
+                moves[kept++] = moves[m];
+            }
+        }
+        count = kept;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    SearchInfo best;
+    best.depth = 0;
+    best.row = moves[0] / BOARD_SIZE;
+    best.col = moves[0] % BOARD_SIZE;
+    best.score = 0;
+    best.nodes = 0;
+    best.time_ms = 0;
+
+    int max_depth = limits->max_depth > 0 && limits->max_depth < ENGINE_MAX_DEPTH ? limits->max_depth : ENGINE_MAX_DEPTH;
+    for (int depth = 1; depth <= max_depth; depth++) {
+        int alpha = -ENGINE_INFINITY;
+        int beta = ENGINE_INFINITY;
+        int best_index = 0;
+
+        for (int m = 0; m < count; m++) {
+            int cell = moves[m];
+            engine_make_move(engine, cell / BOARD_SIZE, cell % BOARD_SIZE);
+            int score;
+            if (m == 0) {
+                score = -negamax(engine, depth - 1, 1, -beta, -alpha);
+            } else {
+                score = -negamax(engine, depth - 1, 1, -alpha - 1, -alpha);
+                if (score > alpha && !engine->stopped) {
+                    score = -negamax(engine, depth - 1, 1, -beta, -alpha);
+                }
+            }
+            engine_unmake_move(engine);
+            if (engine->stopped) {
+                break;
+            }
+            if (score > alpha) {
+                alpha = score;
+                best_index = m;
+            }
+        }
+        if (engine->stopped) {
+            break;
+        }
+
+        // Keep the best move first so the next iteration searches it first
+        int best_move = moves[best_index];
+        memmove(&moves[1], &moves[0], best_index * sizeof(int));
+        moves[0] = best_move;
+        if (excluded == NULL) {
+            tt_store(tt, engine->hash, alpha, best_move, depth, TT_EXACT);
+        }
+
+        best.depth = depth;
+        best.row = best_move / BOARD_SIZE;
+        best.col = best_move % BOARD_SIZE;
+        best.score = alpha;
+        best.nodes = engine->nodes;
+        best.time_ms = engine_now_ms() - engine->start_ms;
+        if (callback != NULL) {
+            callback(&best, user_data);
+        }
+        if (alpha >= ENGINE_WIN_THRESHOLD || alpha <= -ENGINE_WIN_THRESHOLD || count == 1) {
+            break;
+        }
+    }
+
+    best.nodes = engine->nodes;
+    best.time_ms = engine_now_ms() - engine->start_ms;
+    if (result != NULL) {
+        *result = best;
+    }
+    return 1;
+}
+
+int engine_search(Engine *engine, TransTable *tt, const SearchLimits *limits,
+                  SearchCallback callback, void *user_data, SearchInfo *result) {
+    return search_root(engine, tt, limits, callback, user_data, result, NULL);
+}
+
+// Finds up to pv_count best moves, each searched with the full limits after
+// excluding the ones found before it. Returns the number of lines found.
+int engine_search_multipv(Engine *engine, TransTable *tt, const SearchLimits *limits,
+                          int pv_count, SearchInfo *results) {
+    uint8_t excluded[BOARD_CELLS] = {0};
+    int found = 0;
+
+    while (found < pv_count) {
+        if (!search_root(engine, tt, limits, NULL, NULL, &results[found], found > 0 ? excluded : NULL)) {
+            break;
+        }
+        excluded[results[found].row * BOARD_SIZE + results[found].col] = 1;
+        found++;
+        if (engine->stopped) {
+            break;
+        }
+    }
+    return found;
+}
+
+
+typedef struct {
+    Engine *engine;
+    long long deadline_us;
+    long long nodes;
+    int aborted;
+} VcfSearch;
+
+// Collects the empty cells that would complete a line for player p in the
+// windows through cell, i.e. the replies to the four just made there.
+static int five_cells(const Engine *engine, int cell, int p, int *cells) {
+    int count = 0;
+    for (int k = 0; k < cell_window_count[cell]; k++) {
+        int w = cell_windows[cell][k];
+        if (engine->window_stones[w][p] != WIN_LENGTH - 1 || engine->window_stones[w][p ^ 1] != 0) {
+            continue;
+        }
+        for (int i = 0; i < WIN_LENGTH; i++) {
+            int c = window_cells[w][i];
+            if (wins_at(engine, c, p + 1) && (count == 0 || cells[0] != c)) {
+                cells[count++] = c;
+            }
+        }
+        if (count > 1) {
+            break;
+        }
+    }
+    return count;
+}
+
+// Victory by continuous fours: the side to move makes a four with every
+// move, so the defender's reply is forced, until it has two fives at once.
+static int vcf(VcfSearch *search, int depth, int *win_move) {
+    Engine *engine = search->engine;
+    int p = engine->side - 1;
+    int o = p ^ 1;
+
+    if (has_winning_move(engine, p + 1)) {
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            if (wins_at(engine, cell, p + 1)) {
+                *win_move = cell;
+                return 1;
+            }
+        }
+    }
+    // A four by the defender has to be answered, which ends the sequence
+    if (depth <= 0 || has_winning_move(engine, o + 1)) {
+        return 0;
+    }
+
+    for (int cell = 0; cell < BOARD_CELLS && !search->aborted; cell++) {
+        if (engine->cells[cell] != 0 || engine->threat_lines[p][cell][WIN_LENGTH - 2] == 0) {
+            continue;
+        }
+        if (RULES_HAS_FORBIDDEN && p == 0 && forbidden_at(engine, cell)) {
+            continue;
+        }
+        if ((++search->nodes & 63) == 0 && engine_now_us() >= search->deadline_us) {
+            search->aborted = 1;
+            break;
+        }
+
+        int replies[2];
+        int reply_move;
+        engine_make_move(engine, cell / BOARD_SIZE, cell % BOARD_SIZE);
+        int count = five_cells(engine, cell, p, replies);
+        int won = count > 1;
+        if (count == 1) {
+            engine_make_move(engine, replies[0] / BOARD_SIZE, replies[0] % BOARD_SIZE);
+            won = engine->winner == 0 && vcf(search, depth - 1, &reply_move);
+            engine_unmake_move(engine);
+        }
+        engine_unmake_move(engine);
+        if (won) {
+            *win_move = cell;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Looks for a forced win by continuous fours for the side to move, up to
+// depth of its own moves and within budget_us microseconds. Returns 1 with
+// the first move when one is proven; 0 means none was found in time, not
+// that none exists.
+int engine_vcf(Engine *engine, int depth, long long budget_us, int *row, int *col) {
+    VcfSearch search = {engine, engine_now_us() + budget_us, 0, 0};
+    int move;
+
+    if (engine->winner != 0 || !vcf(&search, depth, &move)) {
+        return 0;
+    }
+    *row = move / BOARD_SIZE;
+    *col = move % BOARD_SIZE;
+    return 1;
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef CARO_ENGINE_H
+#define CARO_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifndef BOARD_SIZE
+#define BOARD_SIZE 15
+#endif
+
+#ifndef WIN_LENGTH
+#define WIN_LENGTH 5
+#endif
+
+#define BOARD_CELLS (BOARD_SIZE * BOARD_SIZE)
+#define WINDOW_SPAN (BOARD_SIZE - WIN_LENGTH + 1)
+#define WINDOW_COUNT (2 * BOARD_SIZE * WINDOW_SPAN + 2 * WINDOW_SPAN * WINDOW_SPAN)
+#define CELL_WINDOWS (4 * WIN_LENGTH)
+
+#define ENGINE_MAX_DEPTH 32
+#define ENGINE_MAX_CANDIDATES 20
+#define ENGINE_ROOT_CANDIDATES 40
+#define ENGINE_INFINITY 1000000
+#define ENGINE_WIN_SCORE 900000
+#define ENGINE_WIN_THRESHOLD (ENGINE_WIN_SCORE - 1000)
+
+// Strongest line threat a player makes by playing a cell
+#define THREAT_NONE 0
+#define THREAT_THREE 1        // two or more threes, which includes an open three
+#define THREAT_FOUR 2         // a single four, the opponent has one reply
+#define THREAT_DOUBLE_FOUR 3  // two or more fours, which includes an open four
+#define THREAT_FIVE 4
+
+#define ENGINE_SCORER_SCALAR 0
+#define ENGINE_SCORER_SIMD 1
+
+// Transposition table entry; the key is stored xor'ed with the data so
+// several threads can share one table without locking.
+typedef struct {
+    uint64_t key;
+    uint64_t data;
+} TTEntry;
+
+typedef struct {
+    TTEntry *entries;
+    size_t mask;
+} TransTable;
+
+typedef struct {
+    int max_depth;
+    long long time_ms;    // 0 means no time limit
+    long long max_nodes;  // 0 means no node limit
+    atomic_int *stop;     // optional, set to non-zero from another thread to abort
+} SearchLimits;
+
+typedef struct {
+    int depth;
+    int row;
+    int col;
+    int score;
+    long long nodes;
+    long long time_ms;
+} SearchInfo;
+
+typedef void (*SearchCallback)(const SearchInfo *info, void *user_data);
+
+typedef struct {
+    int8_t cells[BOARD_CELLS];
+    uint8_t near[BOARD_CELLS];
+    uint8_t window_stones[WINDOW_COUNT][2];
+    int window_count[2][WIN_LENGTH + 1];
+    // Threat index: for each player and cell, how many windows through the
+    // cell hold k of the player's stones and none of the opponent's. Only
+    // the windows through the last move change, so it is kept up to date
+    // in make/unmake and engine_threat is O(1).
+    uint8_t threat_lines[2][BOARD_CELLS][WIN_LENGTH];
+    int side;
+    int winner;
+    int move_count;
+    uint64_t hash;
+    int moves[BOARD_CELLS];
+
+    // Search state
+    TransTable *tt;
+    const SearchLimits *limits;
+    long long start_ms;
+    long long nodes;
+    int stopped;
+    int killers[ENGINE_MAX_DEPTH + 1][2];
+} Engine;
+
+// Evaluation weights per window stone count, [0] for the side to move and
+// [1] for the opponent.
+extern int engine_weights[2][WIN_LENGTH];
+
+void engine_init(void);
+long long engine_now_ms(void);
+long long engine_now_us(void);
+int engine_load_weights(const char *path);
+int engine_save_weights(const char *path, int weights[2][WIN_LENGTH]);
+
+int tt_init(TransTable *tt, size_t megabytes);
+void tt_clear(TransTable *tt);
+void tt_free(TransTable *tt);
+
+void engine_reset(Engine *engine);
+void engine_setup(Engine *engine, int board[BOARD_SIZE][BOARD_SIZE], int side);
+int engine_is_legal(const Engine *engine, int row, int col);
+int engine_is_forbidden(const Engine *engine, int row, int col);
+void engine_make_move(Engine *engine, int row, int col);
+void engine_unmake_move(Engine *engine);
+int engine_evaluate(const Engine *engine);
+int engine_threat(const Engine *engine, int cell, int player);
+uint64_t engine_canonical_hash(const Engine *engine, int *symmetry);
+int engine_map_cell(int cell, int symmetry);
+int engine_unmap_cell(int cell, int symmetry);
+void engine_hint(Engine *engine, TransTable *tt, int row, int col, int score, int depth);
+int engine_has_simd(void);
+void engine_score_moves(const Engine *engine, const int *moves, int count, int *scores, int scorer);
+int engine_search(Engine *engine, TransTable *tt, const SearchLimits *limits,
+                  SearchCallback callback, void *user_data, SearchInfo *result);
+int engine_search_multipv(Engine *engine, TransTable *tt, const SearchLimits *limits,
+                          int pv_count, SearchInfo *results);
+int engine_vcf(Engine *engine, int depth, long long budget_us, int *row, int *col);
+
+#endif
\ No newline at end of file
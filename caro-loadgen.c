@@ -0,0 +1,1031 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define BOARD_SIZE 15
+#define BOARD_CELLS (BOARD_SIZE * BOARD_SIZE)
+#define MAX_EVENTS 1024
+#define CONNECT_BATCH 500
+#define PORTS_PER_ADDRESS 25000
+#define STATE_LENGTH (18 + 1 + 2 * BOARD_CELLS)   // "Player 1|Player 2|" + turn + "|c" per cell
+#define INPUT_BUFFER 4096
+#define LATENCY_BUCKETS 4096                       // 50 us each, the last one catches the rest
+#define LATENCY_BUCKET_US 50
+#define WIRE_BENCH_BOARDS 64
+#define FRAMES_STREAM (1 << 18)                    // bytes recorded per stream
+#define FRAMES_MESSAGES 8192
+#define FRAMES_READ 4096
+#define POOL_BENCH_BATCH 256                       // read tasks in flight, one epoll batch
+
+#include "caro-task-pool.h"
+#include "caro-wire.h"
+
+// Load generator for the game servers: opens many connections, lets each
+// pair play random moves and reports move throughput and latency. Extra
+// connections can watch the featured game as spectators.
+typedef struct {
+    int fd;
+    int spectator;              // watches instead of playing
+    int player;                 // 0 until the server seats us
+    int turn;                   // whose turn the last state said it was
+    int games;                  // games finished on this slot, reconnects included
+    int binary;                 // the server answered our hello
+    int move_number;            // moves on our board, deltas must follow on from it
+    char board[BOARD_CELLS];
+    WireReader in;
+    uint8_t in_buffer[INPUT_BUFFER];
+    long long sent_us;          // when our last move went out, 0 if none pending
+} Client;
+
+typedef struct {
+    long long connects;
+    long long seated;           // clients told their player number at least once
+    long long all_seated_us;    // when every client had been seated, 0 until then
+    long long moves;
+    long long games;
+    long long errors;
+    long long bytes_in;
+    long long bytes_out;
+    long long resyncs;
+    long long updates;          // boards and moves spectators were sent
+    long long watched;          // games spectators saw to the end
+    long long unwatched;        // spectators told there was nothing to watch
+    long long spectator_bytes;
+    long long latency[LATENCY_BUCKETS];
+} Stats;
+
+Client *clients;
+int client_count;
+int spectator_count = 0;  // -S: connections after the players that watch
+int epoll_fd;
+struct sockaddr_in server_address;
+int reconnect = 0;
+int rating_spread = -1;   // -R: announce a rating within this distance of 1500, -1 sends none
+int use_binary = 0;       // -b: ask for the binary protocol
+int wire_version = WIRE_VERSION;   // -V: highest binary version to ask for
+Stats stats;
+unsigned int seed = 12345;
+
+long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The server reads one text message per read, and nothing else is sent
+// before we are seated, so the rating arrives on its own. In binary it is
+// a frame right behind the hello. A spectator asks to watch instead.
+// Returns 0 while the connection is not up yet.
+int send_greeting(int index) {
+    Client *client = &clients[index];
+    uint8_t buffer[32];
+    size_t len = 0;
+
+    if (use_binary) {
+        len = wire_hello(buffer, wire_version);
+    }
+    if (client->spectator) {
+        if (use_binary) {
+            len += wire_frame(buffer + len, WIRE_WATCH, NULL, 0);
+        } else {
+            len = (size_t)sprintf((char *)buffer, "WATCH\n");
+        }
+    } else if (rating_spread >= 0) {
+        int rating = 1500 - rating_spread + rand_r(&seed) % (2 * rating_spread + 1);
+        if (use_binary) {
+            uint8_t payload[2] = {(uint8_t)(rating >> 8), (uint8_t)rating};
+            len += wire_frame(buffer + len, WIRE_RATING, payload, 2);
+        } else {
+            len = (size_t)sprintf((char *)buffer, "RATING %d\n", rating);
+        }
+    }
+    if (send(client->fd, buffer, len, MSG_NOSIGNAL) < 0) {
+        return errno != EAGAIN && errno != ENOTCONN;
+    }
+    stats.bytes_out += (long long)len;
+    return 1;
+}
+
+int open_client(int index) {
+    Client *client = &clients[index];
+    struct sockaddr_in local;
+    int one = 1;
+    int games = client->games;
+
+    memset(client, 0, sizeof(*client));
+    client->games = games;
+    client->spectator = index >= client_count;
+    wire_reader_init(&client->in, client->in_buffer, sizeof(client->in_buffer), 1);
+    client->in.binary = use_binary ? -1 : 0;
+    client->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (client->fd < 0) {
+        perror("socket");
+        return 0;
+    }
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Loopback has one address per 127.x.y.z, so spread the source
+    // addresses to get past the ephemeral port range
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(0x7F000001 + index / PORTS_PER_ADDRESS);
+    setsockopt(client->fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+    bind(client->fd, (struct sockaddr *)&local, sizeof(local));
+
+    if (connect(client->fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0 && errno != EINPROGRESS) {
+        perror("connect");
+        close(client->fd);
+        client->fd = -1;
+        return 0;
+    }
+
+    // The hello and the rating go out as soon as the connection is up. On
+    // loopback it usually is by the time connect returns, otherwise once it
+    // turns writable; the server only waits a moment for the hello.
+    struct epoll_event event;
+    int greet = (rating_spread >= 0 || use_binary || client->spectator) && !send_greeting(index);
+    event.events = EPOLLIN | EPOLLRDHUP | (greet ? EPOLLOUT : 0);
+    event.data.u32 = (unsigned int)index;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd, &event);
+    stats.connects++;
+    return 1;
+}
+
+void close_client(int index) {
+    Client *client = &clients[index];
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+}
+
+void record_latency(long long us) {
+    long long bucket = us / LATENCY_BUCKET_US;
+    stats.latency[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+}
+
+long long latency_percentile(double fraction) {
+    long long total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        total += stats.latency[i];
+    }
+    long long target = (long long)(total * fraction);
+    long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += stats.latency[i];
+        if (seen > target) {
+            return (long long)(i + 1) * LATENCY_BUCKET_US;
+        }
+    }
+    return 0;
+}
+
+void play_move(Client *client) {
+    char buffer[16];
+    int len;
+    int empty = 0;
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        empty += client->board[cell] == 0;
+    }
+    if (empty == 0) {
+        return;
+    }
+    int pick = rand_r(&seed) % empty;
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        if (client->board[cell] == 0 && pick-- == 0) {
+            if (client->binary) {
+                uint8_t payload = (uint8_t)cell;
+                len = (int)wire_frame((uint8_t *)buffer, WIRE_MOVE, &payload, 1);
+            } else {
+                len = sprintf(buffer, "%d,%d\n", cell / BOARD_SIZE, cell % BOARD_SIZE);
+            }
+            if (send(client->fd, buffer, len, MSG_NOSIGNAL) == len) {
+                client->sent_us = now_us();
+                stats.bytes_out += len;
+            }
+            return;
+        }
+    }
+}
+
+void seat_client(Client *client, int player) {
+    // The ramp is over once every slot has been seated for its first game
+    if (client->games == 0 && client->player == 0 && ++stats.seated == client_count) {
+        stats.all_seated_us = now_us();
+    }
+    client->player = player;
+}
+
+// Call once the new board is in
+void state_received(Client *client) {
+    stats.updates += client->spectator;
+    if (client->sent_us > 0) {
+        record_latency(now_us() - client->sent_us);
+        client->sent_us = 0;
+        stats.moves++;
+    }
+}
+
+// A move that does not follow on from our board means we missed one; the
+// board the server sends back replaces ours
+void request_resync(Client *client) {
+    uint8_t frame[2];
+    size_t len = wire_frame(frame, WIRE_RESYNC, NULL, 0);
+    if (send(client->fd, frame, len, MSG_NOSIGNAL) > 0) {
+        stats.bytes_out += (long long)len;
+    }
+    stats.resyncs++;
+}
+
+// Returns 0 on a frame we do not understand
+int parse_frame(Client *client, const WireFrame *frame, int *game_over) {
+    int cells[BOARD_CELLS];
+    int cell, player, move_number;
+
+    switch (frame->type) {
+        case WIRE_HELLO:
+            client->binary = 1;
+            break;
+        case WIRE_SEAT:
+            seat_client(client, frame->len == 1 ? frame->payload[0] : 0);
+            break;
+        case WIRE_STATE:
+            if (!wire_decode_state(frame, cells, &client->turn)) {
+                return 0;
+            }
+            // Every move adds a stone, so the board says how many were played
+            client->move_number = 0;
+            for (int c = 0; c < BOARD_CELLS; c++) {
+                client->board[c] = (char)cells[c];
+                client->move_number += cells[c] != 0;
+            }
+            state_received(client);
+            break;
+        case WIRE_DELTA:
+            if (!wire_decode_delta(frame, &cell, &player, &move_number)) {
+                return 0;
+            }
+            if (move_number != client->move_number + 1) {
+                request_resync(client);
+                break;
+            }
+            client->board[cell] = (char)player;
+            client->turn = 3 - player;
+            client->move_number = move_number;
+            state_received(client);
+            break;
+        case WIRE_WIN:
+        case WIRE_LOSE:
+            *game_over = 1;
+            break;
+        case WIRE_TIMEOUT:
+            *game_over = 2;
+            break;
+        case WIRE_OVER:
+            *game_over = frame->len == 1 && frame->payload[0] != 0 ? 3 : 2;
+            break;
+        case WIRE_INVALID:
+            break;
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+// Handles one message the reader split off. Returns 0 on one we do not
+// understand, and sets *game_over to 1 for WIN/LOSE, 2 for TIMEOUT or
+// nothing to watch and 3 for the end of a watched game.
+int parse_message(Client *client, const WireFrame *message, int *game_over) {
+    const uint8_t *data = message->payload;
+
+    if (message->type != WIRE_TEXT) {
+        return parse_frame(client, message, game_over);
+    }
+    if (message->len == 1) {
+        seat_client(client, data[0] - '0');
+    } else if (data[0] == 'P' && message->len == STATE_LENGTH) {
+        client->turn = data[18] - '0';
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            client->board[cell] = (char)(data[20 + 2 * cell] - '0');
+        }
+        state_received(client);
+    } else if (wire_text_is(message, "WIN") || wire_text_is(message, "LOSE")) {
+        *game_over = 1;
+    } else if (wire_text_is(message, "TIMEOUT") || wire_text_is(message, "OVER 0")) {
+        *game_over = 2;
+    } else if (wire_text_is(message, "OVER 1") || wire_text_is(message, "OVER 2")) {
+        *game_over = 3;
+    } else if (!wire_text_is(message, "INVALID_MOVE") && !wire_text_is(message, "WAIT") &&
+               !wire_text_is(message, "START")) {
+        return 0;
+    }
+    return 1;
+}
+
+// Returns 0 when the connection is finished
+int read_client(int index) {
+    Client *client = &clients[index];
+    WireFrame message;
+    size_t space;
+    int game_over = 0;
+    int got = 0;
+
+    uint8_t *to = wire_reader_space(&client->in, &space);
+    ssize_t received = recv(client->fd, to, space, 0);
+    if (received <= 0) {
+        return received < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+    wire_reader_filled(&client->in, (size_t)received);
+    if (client->spectator) {
+        stats.spectator_bytes += received;
+    } else {
+        stats.bytes_in += received;
+    }
+
+    while (!game_over && (got = wire_reader_next(&client->in, &message)) > 0) {
+        if (!parse_message(client, &message, &game_over)) {
+            got = -1;
+            break;
+        }
+    }
+    if (got < 0) {
+        stats.errors++;
+        return 0;
+    }
+
+    if (game_over) {
+        stats.games += game_over == 1;
+        client->games += game_over == 1;
+        stats.watched += game_over == 3;
+        stats.unwatched += game_over == 2 && client->spectator;
+        return 0;
+    }
+    if (client->player != 0 && client->turn == client->player && client->sent_us == 0) {
+        play_move(client);
+    }
+    return 1;
+}
+
+void raise_file_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Board encodings as the servers and clients did them before the binary
+// protocol: sprintf for every cell, and strtok/atoi to read it back
+size_t encode_text_sprintf(const int *cells, int current_player, char *buffer) {
+    sprintf(buffer, "%s|%s|%d", "Player 1", "Player 2", current_player);
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        sprintf(buffer + strlen(buffer), "|%d", cells[cell]);
+    }
+    return strlen(buffer);
+}
+
+size_t encode_text(const int *cells, int current_player, char *buffer) {
+    int len = sprintf(buffer, "Player 1|Player 2|%d", current_player);
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        buffer[len++] = '|';
+        buffer[len++] = (char)('0' + cells[cell]);
+    }
+    buffer[len] = '\0';
+    return (size_t)len;
+}
+
+int decode_text(char *buffer, int *cells, int *current_player) {
+    char *token = strtok(buffer, "|");
+    token = strtok(NULL, "|");
+    token = strtok(NULL, "|");
+    if (token == NULL) {
+        return 0;
+    }
+    *current_player = atoi(token);
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        token = strtok(NULL, "|");
+        if (token == NULL) {
+            return 0;
+        }
+        cells[cell] = atoi(token);
+    }
+    return 1;
+}
+
+long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ./caro-loadgen wire [iterations]: times encoding and decoding boards in
+// each protocol over positions from random games, checks that both decode
+// back to the same board, and prints the bytes a move costs on the wire
+int run_wire_bench(int iterations) {
+    static int boards[WIRE_BENCH_BOARDS][BOARD_CELLS];
+    static char texts[WIRE_BENCH_BOARDS][STATE_LENGTH + 64];
+    static char copies[WIRE_BENCH_BOARDS][STATE_LENGTH + 64];
+    static uint8_t frames[WIRE_BENCH_BOARDS][WIRE_MAX_FRAME];
+    int cells[BOARD_CELLS];
+    int turn;
+    size_t text_bytes = 0;
+    size_t frame_bytes = 0;
+    long long check = 0;
+
+    // Random games cut off at every fill level
+    for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+        int stones = b * BOARD_CELLS / WIRE_BENCH_BOARDS;
+        for (int n = 0; n < stones; n++) {
+            int cell = rand_r(&seed) % BOARD_CELLS;
+            while (boards[b][cell] != 0) {
+                cell = (cell + 1) % BOARD_CELLS;
+            }
+            boards[b][cell] = 1 + n % 2;
+        }
+    }
+
+    long long start = now_ns();
+    for (int n = 0; n < iterations; n++) {
+        for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+            check += (long long)encode_text_sprintf(boards[b], 1 + b % 2, texts[b]);
+        }
+    }
+    long long sprintf_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int n = 0; n < iterations; n++) {
+        for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+            text_bytes = encode_text(boards[b], 1 + b % 2, texts[b]);
+            check += (long long)text_bytes;
+        }
+    }
+    long long text_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int n = 0; n < iterations; n++) {
+        for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+            frame_bytes = wire_encode_state(frames[b], boards[b], 1 + b % 2);
+            check += (long long)frame_bytes;
+        }
+    }
+    long long frame_ns = now_ns() - start;
+
+    // strtok writes into the text, so every pass decodes fresh copies
+    long long text_decode_ns = 0;
+    for (int n = 0; n < iterations; n++) {
+        memcpy(copies, texts, sizeof(copies));
+        start = now_ns();
+        for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+            if (!decode_text(copies[b], cells, &turn) || memcmp(cells, boards[b], sizeof(cells)) != 0) {
+                fprintf(stderr, "Error: Text board %d did not decode back\n", b);
+                return 1;
+            }
+        }
+        text_decode_ns += now_ns() - start;
+    }
+
+    start = now_ns();
+    for (int n = 0; n < iterations; n++) {
+        for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+            WireFrame frame;
+            wire_next_frame(frames[b], frame_bytes, &frame);
+            if (!wire_decode_state(&frame, cells, &turn) || turn != 1 + b % 2 ||
+                memcmp(cells, boards[b], sizeof(cells)) != 0) {
+                fprintf(stderr, "Error: Binary board %d did not decode back\n", b);
+                return 1;
+            }
+        }
+    }
+    long long frame_decode_ns = now_ns() - start;
+
+    // A delta per stone of each board, in the order they were numbered
+    uint8_t delta[WIRE_DELTA_FRAME];
+    long long deltas = 0;
+    start = now_ns();
+    for (int n = 0; n < iterations; n++) {
+        for (int b = 0; b < WIRE_BENCH_BOARDS; b++) {
+            for (int c = 0; c < BOARD_CELLS; c++) {
+                if (boards[b][c] == 0) {
+                    continue;
+                }
+                WireFrame frame;
+                int cell, player, move_number;
+                wire_encode_delta(delta, c, boards[b][c], (int)deltas);
+                wire_next_frame(delta, sizeof(delta), &frame);
+                if (!wire_decode_delta(&frame, &cell, &player, &move_number) || cell != c) {
+                    fprintf(stderr, "Error: Delta did not decode back\n");
+                    return 1;
+                }
+                cells[cell] = player;
+                deltas++;
+            }
+        }
+    }
+    long long delta_ns = now_ns() - start;
+
+    long long calls = (long long)iterations * WIRE_BENCH_BOARDS;
+    printf("Boards: %d x %d (check %lld)\n", WIRE_BENCH_BOARDS, iterations, check);
+    printf("Encode: sprintf text %lld ns  text %lld ns  binary %lld ns\n",
+           sprintf_ns / calls, text_ns / calls, frame_ns / calls);
+    printf("Decode: strtok text %lld ns  binary %lld ns\n", text_decode_ns / calls, frame_decode_ns / calls);
+    printf("Delta: %lld ns to encode and apply\n", deltas > 0 ? delta_ns / deltas : 0);
+    // A move goes up once and the new board, or just the move from version
+    // 2 on, comes down to both players
+    printf("Board: text %zu bytes  binary %zu bytes  delta %d bytes\n", text_bytes, frame_bytes, WIRE_DELTA_FRAME);
+    printf("Per move: text %zu bytes  binary v1 %d bytes  v2 %d bytes\n", 5 + 2 * text_bytes,
+           3 + 2 * (int)frame_bytes, 3 + 2 * WIRE_DELTA_FRAME);
+    return 0;
+}
+
+// A recorded stream of one side's messages and where each ends
+typedef struct {
+    const char *name;
+    int from_server;            // whose messages, as wire_reader_init takes it
+    int binary;
+    uint8_t data[FRAMES_STREAM];
+    size_t len;
+    size_t ends[FRAMES_MESSAGES];
+    int count;
+} FrameStream;
+
+typedef struct {
+    long long messages;
+    long long mismatches;       // a message that is not the next one recorded
+    long long out_of_bounds;    // a view outside the bytes it came from
+    long long rejected;         // streams the reader gave up on as garbage
+} FeedResult;
+
+void stream_add(FrameStream *stream, const void *message, size_t len) {
+    memcpy(stream->data + stream->len, message, len);
+    stream->len += len;
+    stream->ends[stream->count++] = stream->len;
+}
+
+void stream_add_frame(FrameStream *stream, int type, const uint8_t *payload, size_t len) {
+    uint8_t frame[WIRE_MAX_FRAME];
+    stream_add(stream, frame, wire_frame(frame, type, payload, len));
+}
+
+// Random games as both protocols carry them, in both directions: the text
+// and binary server streams, then the text and binary client streams
+void record_streams(FrameStream *streams) {
+    static const char *ends[] = {"WIN", "LOSE", "TIMEOUT"};
+    FrameStream *text = &streams[0], *binary = &streams[1], *moves = &streams[2], *frames = &streams[3];
+    char buffer[STATE_LENGTH + 64];
+    uint8_t hello[WIRE_HELLO_LENGTH];
+    uint8_t frame[WIRE_MAX_FRAME];
+    int games = 0;
+
+    wire_hello(hello, WIRE_VERSION);
+    stream_add(moves, hello, sizeof(hello));
+    stream_add(frames, hello, sizeof(hello));
+    uint8_t version = WIRE_VERSION;
+    stream_add_frame(binary, WIRE_HELLO, &version, 1);
+
+    // Each game fits in what is left, as long as it has room for one more
+    // board than it can play
+    while (text->len + (BOARD_CELLS + 4) * (STATE_LENGTH + 16) < FRAMES_STREAM &&
+           text->count + 2 * BOARD_CELLS + 8 < FRAMES_MESSAGES) {
+        int cells[BOARD_CELLS] = {0};
+        int length = 5 + rand_r(&seed) % 60;
+        uint8_t seat = (uint8_t)(1 + games % 2);
+        int rating = 1000 + rand_r(&seed) % 1000;
+        uint8_t rating_payload[2] = {(uint8_t)(rating >> 8), (uint8_t)rating};
+
+        stream_add(text, buffer, (size_t)sprintf(buffer, "%d", seat));
+        stream_add_frame(binary, WIRE_SEAT, &seat, 1);
+        stream_add(text, buffer, encode_text(cells, 1, buffer));
+        stream_add(binary, frame, wire_encode_state(frame, cells, 1));
+        stream_add(moves, buffer, (size_t)sprintf(buffer, "RATING %d\n", rating));
+        stream_add_frame(frames, WIRE_RATING, rating_payload, 2);
+
+        for (int m = 0; m < length; m++) {
+            int cell = rand_r(&seed) % BOARD_CELLS;
+            while (cells[cell] != 0) {
+                cell = (cell + 1) % BOARD_CELLS;
+            }
+            cells[cell] = 1 + m % 2;
+            uint8_t move = (uint8_t)cell;
+            stream_add(moves, buffer, (size_t)sprintf(buffer, "%d,%d\n", cell / BOARD_SIZE, cell % BOARD_SIZE));
+            stream_add_frame(frames, WIRE_MOVE, &move, 1);
+            if (rand_r(&seed) % 8 == 0) {
+                stream_add(text, "INVALID_MOVE", 12);
+                stream_add_frame(binary, WIRE_INVALID, NULL, 0);
+                stream_add_frame(frames, WIRE_RESYNC, NULL, 0);
+                stream_add(binary, frame, wire_encode_state(frame, cells, 2 - m % 2));
+            }
+            stream_add(text, buffer, encode_text(cells, 2 - m % 2, buffer));
+            stream_add(binary, frame, wire_encode_delta(frame, cell, cells[cell], m + 1));
+        }
+        stream_add(text, ends[games % 3], strlen(ends[games % 3]));
+        stream_add_frame(binary, WIRE_WIN + games % 3 * (WIRE_TIMEOUT - WIRE_WIN) / 2, NULL, 0);
+        games++;
+    }
+}
+
+// Length of the next read at the given offset, up to max bytes. Until a
+// text client has ended a line, each read is taken as one message, so the
+// line after the hello must not be cut; it goes in one send on the wire
+// too. Everything after it may be cut anywhere.
+size_t next_read(const FrameStream *stream, size_t at, size_t max) {
+    size_t len = 1 + (size_t)rand_r(&seed) % max;
+    if (len > stream->len - at) {
+        len = stream->len - at;
+    }
+    if (!stream->from_server && !stream->binary && at < stream->ends[1] && at + len > stream->ends[0] &&
+        at + len < stream->ends[1]) {
+        len = stream->ends[1] - at;
+    }
+    return len;
+}
+
+// Checks one message handed out, lying within [low, high). A binary client
+// starts with the hello in text, as the server reads it.
+void take_message(const FrameStream *stream, WireReader *reader, const WireFrame *message,
+                  const uint8_t *low, const uint8_t *high, int check, int *next, FeedResult *result) {
+    result->messages++;
+    if (message->payload < low || message->payload + message->len > high) {
+        result->out_of_bounds++;
+        return;
+    }
+    if (message->type == WIRE_TEXT && stream->binary && !stream->from_server &&
+        wire_read_hello(message->payload, message->len) > 0) {
+        reader->binary = 1;
+    }
+    if (message->type == WIRE_STATE) {
+        int cells[BOARD_CELLS], turn;
+        wire_decode_state(message, cells, &turn);
+    }
+    if (!check) {
+        return;
+    }
+    if (*next >= stream->count) {
+        result->mismatches++;
+        return;
+    }
+    size_t begin = *next == 0 ? 0 : stream->ends[*next - 1];
+    size_t end = stream->ends[*next];
+    size_t header = message->type == WIRE_TEXT ? 0 : 2;
+    // Client lines come without their '\n'
+    size_t trailer = message->type == WIRE_TEXT && !stream->from_server && stream->data[end - 1] == '\n';
+    if (begin + header + message->len + trailer != end ||
+        memcmp(message->payload, stream->data + begin + header, message->len) != 0) {
+        result->mismatches++;
+    }
+    (*next)++;
+}
+
+// Feeds data, the stream's own or a spoiled copy, through a fresh reader
+// in reads of random sizes, the way TCP cuts and merges them. With
+// in_place, whole messages are split straight from each read while the
+// reader is empty, as the io_uring server does. With check, every message
+// must be the next one recorded.
+void feed_stream(const FrameStream *stream, const uint8_t *data, size_t max, int in_place, int check,
+                 FeedResult *result) {
+    uint8_t buffer[2 * WIRE_TEXT_MAX];
+    WireReader reader;
+    WireFrame message;
+    size_t at = 0;
+    int next = 0;
+    int got = 0;
+
+    wire_reader_init(&reader, buffer, sizeof(buffer), stream->from_server);
+    reader.binary = stream->from_server && stream->binary ? -1 : 0;
+    while (at < stream->len && got >= 0) {
+        // Like recv, a read never brings more than there is room for
+        size_t space;
+        wire_reader_space(&reader, &space);
+        size_t len = next_read(stream, at, max < space ? max : space);
+        const uint8_t *piece = data + at;
+        const uint8_t *piece_end = piece + len;
+        at += len;
+
+        if (in_place && reader.start == reader.end) {
+            while ((got = wire_reader_split(&reader, piece, (size_t)(piece_end - piece), &message)) > 0) {
+                take_message(stream, &reader, &message, piece, piece_end, check, &next, result);
+                piece += got;
+            }
+            if (got < 0) {
+                break;
+            }
+        }
+        if (!wire_reader_append(&reader, piece, (size_t)(piece_end - piece))) {
+            got = -1;
+            break;
+        }
+        while ((got = wire_reader_next(&reader, &message)) > 0) {
+            take_message(stream, &reader, &message, buffer, buffer + reader.end, check, &next, result);
+        }
+    }
+    if (got < 0) {
+        result->rejected++;
+    }
+    if (check && (got < 0 || next != stream->count)) {
+        result->mismatches++;
+    }
+}
+
+// Client text as it can arrive: lines merged into one read or cut across
+// reads, and an old client's messages without line ends, one a read.
+// Returns how many messages did not come out as they were sent.
+int check_client_lines(int *cases) {
+    static const struct {
+        const char *reads[3];
+        const char *messages[3];
+    } checks[] = {
+        {{"7,1\n2,3\n"}, {"7,1", "2,3"}},
+        {{"7,1\n2", ",3\r\n"}, {"7,1", "2,3"}},
+        {{"RATING 1500\n7,12", "\n"}, {"RATING 1500", "7,12"}},
+        {{"WATCH\nWATCH 0:12\n"}, {"WATCH", "WATCH 0:12"}},
+        {{"7,1", "2,3"}, {"7,1", "2,3"}},
+        {{"RATING 1500", "7,12"}, {"RATING 1500", "7,12"}},
+    };
+    int mismatches = 0;
+
+    *cases = (int)(sizeof(checks) / sizeof(checks[0]));
+    for (int c = 0; c < *cases; c++) {
+        uint8_t buffer[WIRE_TEXT_MAX];
+        WireReader reader;
+        WireFrame message;
+        int next = 0;
+
+        wire_reader_init(&reader, buffer, sizeof(buffer), 0);
+        for (int r = 0; r < 3 && checks[c].reads[r] != NULL; r++) {
+            wire_reader_append(&reader, (const uint8_t *)checks[c].reads[r], strlen(checks[c].reads[r]));
+            while (wire_reader_next(&reader, &message) > 0) {
+                const char *expected = next < 3 ? checks[c].messages[next++] : NULL;
+                mismatches += expected == NULL || !wire_text_is(&message, expected);
+            }
+        }
+        for (; next < 3 && checks[c].messages[next] != NULL; next++) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+// ./caro-loadgen frames [iterations]: cuts and merges recorded streams of
+// every kind at random and checks the readers hand back exactly the
+// messages that were sent, feeds them random and spoiled bytes and checks
+// no view ever leaves the data, then times how many messages a second
+// each kind splits
+int run_frames_bench(int iterations) {
+    static FrameStream streams[4] = {
+        {.name = "server text", .from_server = 1, .binary = 0},
+        {.name = "server binary", .from_server = 1, .binary = 1},
+        {.name = "client text", .from_server = 0, .binary = 0},
+        {.name = "client binary", .from_server = 0, .binary = 1},
+    };
+    static uint8_t spoiled[FRAMES_STREAM];
+    FeedResult chunked = {0};
+    FeedResult garbage = {0};
+    int line_cases;
+    int line_mismatches = check_client_lines(&line_cases);
+
+    record_streams(streams);
+    for (int n = 0; n < iterations; n++) {
+        for (int s = 0; s < 4; s++) {
+            size_t max = n % 4 == 0 ? 2 * STATE_LENGTH : 16;
+            feed_stream(&streams[s], streams[s].data, max, n % 2, 1, &chunked);
+        }
+    }
+
+    // Spoil a few bytes of a stream, or all of them
+    for (int n = 0; n < iterations; n++) {
+        FrameStream *stream = &streams[n % 4];
+        memcpy(spoiled, stream->data, stream->len);
+        int flips = n % 8 == 0 ? (int)stream->len : 1 + rand_r(&seed) % 8;
+        for (int f = 0; f < flips; f++) {
+            spoiled[n % 8 == 0 ? (size_t)f : (size_t)rand_r(&seed) % stream->len] = (uint8_t)rand_r(&seed);
+        }
+        feed_stream(stream, spoiled, 2 * STATE_LENGTH, n % 2, 0, &garbage);
+    }
+
+    printf("Chunked: %d runs of %d streams, %lld messages, %lld mismatches, %lld out of bounds\n", iterations, 4,
+           chunked.messages, chunked.mismatches, chunked.out_of_bounds);
+    printf("Garbage: %d runs, %lld messages, %lld rejected, %lld out of bounds\n", iterations, garbage.messages,
+           garbage.rejected, garbage.out_of_bounds);
+    printf("Lines: %d cases of client text, %d mismatches\n", line_cases, line_mismatches);
+
+    // Reads of up to a few kilobytes, each copied in as recv would
+    for (int s = 0; s < 4; s++) {
+        FeedResult timed = {0};
+        long long start = now_ns();
+        for (int n = 0; n < iterations; n++) {
+            feed_stream(&streams[s], streams[s].data, FRAMES_READ, 0, 0, &timed);
+        }
+        double seconds = (now_ns() - start) / 1e9;
+        printf("Split: %-13s %6.1f M messages/s  %6.0f MB/s  (%d messages, %zu bytes)\n", streams[s].name,
+               timed.messages / seconds / 1e6, (double)iterations * streams[s].len / seconds / 1e6, streams[s].count,
+               streams[s].len);
+    }
+    return chunked.mismatches + chunked.out_of_bounds + garbage.out_of_bounds + line_mismatches > 0;
+}
+
+TaskPool pool_bench;
+atomic_long pool_bench_left;   // tasks not run yet
+int pool_bench_board[BOARD_CELLS];
+
+// Stands in for the opponent's send of a move
+void pool_send_task(void *arg) {
+    char buffer[STATE_LENGTH + 64];
+    (void)arg;
+    encode_text(pool_bench_board, 1, buffer);
+    atomic_fetch_sub(&pool_bench_left, 1);
+}
+
+// Stands in for a read with a move in it: the board is written out and
+// the opponent's share handed back to the pool, as server-caro-1 does
+void pool_read_task(void *arg) {
+    char buffer[STATE_LENGTH + 64];
+    encode_text(pool_bench_board, 1, buffer);
+    if (!task_pool_submit(&pool_bench, pool_send_task, arg)) {
+        pool_send_task(arg);
+    }
+    atomic_fetch_sub(&pool_bench_left, 1);
+}
+
+// ./caro-loadgen pool [tasks] [workers]: feeds the task pool of
+// server-caro-1 read tasks the way its poller does, never more than one
+// epoll batch ahead of the workers, first through the shared queue and
+// then from an attached deque. Every read task only reaches a worker by
+// being stolen from the attached deque, so that run fails if nothing was
+// stolen.
+int run_pool_bench(int tasks, int workers) {
+    static const char *paths[] = {"shared queue", "poller deque"};
+    long long executed = 0, stolen = 0;
+
+    for (int attach = 0; attach < 2; attach++) {
+        if (!task_pool_init(&pool_bench, workers) || (attach && !task_pool_attach(&pool_bench))) {
+            fprintf(stderr, "Error: Could not start the worker pool\n");
+            return 1;
+        }
+        atomic_store(&pool_bench_left, 2L * tasks);
+        long long start = now_ns();
+        for (int sent = 0; sent < tasks; sent++) {
+            while (atomic_load(&pool_bench_left) - 2L * (tasks - sent) > 2 * POOL_BENCH_BATCH) {
+                sched_yield();
+            }
+            while (!task_pool_submit(&pool_bench, pool_read_task, NULL)) {
+                sched_yield();
+            }
+        }
+        while (atomic_load(&pool_bench_left) > 0) {
+            sched_yield();
+        }
+        double seconds = (now_ns() - start) / 1e9;
+        task_pool_stats(&pool_bench, &executed, &stolen);
+        printf("%-12s %d workers: %6.2f M tasks/s  %lld run, %lld stolen\n", paths[attach], pool_bench.worker_count,
+               2.0 * tasks / seconds / 1e6, executed, stolen);
+        task_pool_shutdown(&pool_bench);
+    }
+    return stolen == 0;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-c connections] [-d seconds] [-p port] [-H host] [-r] [-R rating_spread] [-b] [-V version] [-S spectators]\n", program);
+    fprintf(stderr, "       %s wire [iterations]\n", program);
+    fprintf(stderr, "       %s frames [iterations]\n", program);
+    fprintf(stderr, "       %s pool [tasks] [workers]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    struct epoll_event events[MAX_EVENTS];
+    const char *host = "127.0.0.1";
+    int port = 8888;
+    int seconds = 10;
+    int option;
+
+    if (argc > 1 && strcmp(argv[1], "wire") == 0) {
+        return run_wire_bench(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    if (argc > 1 && strcmp(argv[1], "frames") == 0) {
+        return run_frames_bench(argc > 2 ? atoi(argv[2]) : 1000);
+    }
+    if (argc > 1 && strcmp(argv[1], "pool") == 0) {
+        return run_pool_bench(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? atoi(argv[3]) : 0);
+    }
+
+    client_count = 1000;
+    while ((option = getopt(argc, argv, "c:d:p:H:rR:bV:S:")) != -1) {
+        switch (option) {
+            case 'c': client_count = atoi(optarg); break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'H': host = optarg; break;
+            case 'r': reconnect = 1; break;
+            case 'R': rating_spread = atoi(optarg); break;
+            case 'b': use_binary = 1; break;
+            case 'V': use_binary = 1; wire_version = atoi(optarg); break;
+            case 'S': spectator_count = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (client_count < 2 || spectator_count < 0) {
+        usage(argv[0]);
+    }
+    int total = client_count + spectator_count;
+
+    signal(SIGPIPE, SIG_IGN);
+    raise_file_limit();
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+    server_address.sin_addr.s_addr = inet_addr(host);
+
+    clients = calloc(total, sizeof(Client));
+    epoll_fd = epoll_create1(0);
+    if (clients == NULL || epoll_fd < 0) {
+        perror("setup");
+        return 1;
+    }
+
+    long long start_us = now_us();
+    long long end_us = start_us + (long long)seconds * 1000000;
+    long long report_us = start_us + 1000000;
+    long long last_moves = 0;
+    long long last_updates = 0;
+    int opened = 0;
+    int open_count = 0;
+
+    while (now_us() < end_us) {
+        // Ramp up in batches so the listen backlog is not flooded
+        for (int n = 0; n < CONNECT_BATCH && opened < total; n++, opened++) {
+            open_count += open_client(opened);
+        }
+
+        // Do not sleep between batches, so the ramp measures the server
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, opened < total ? 0 : 10);
+        for (int i = 0; i < count; i++) {
+            int index = (int)events[i].data.u32;
+            if (clients[index].fd >= 0 && (events[i].events & EPOLLOUT) && send_greeting(index)) {
+                struct epoll_event event;
+                event.events = EPOLLIN | EPOLLRDHUP;
+                event.data.u32 = (unsigned int)index;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, clients[index].fd, &event);
+            }
+            if (clients[index].fd >= 0 && (events[i].events & ~EPOLLOUT) && !read_client(index)) {
+                close_client(index);
+                open_count--;
+                if (reconnect) {
+                    open_count += open_client(index);
+                }
+            }
+        }
+
+        long long now = now_us();
+        if (now >= report_us) {
+            printf("%3llds  open %d  moves/s %lld  games %lld", (now - start_us) / 1000000, open_count,
+                   stats.moves - last_moves, stats.games);
+            if (spectator_count > 0) {
+                printf("  spectator updates/s %lld", stats.updates - last_updates);
+            }
+            printf("\n");
+            fflush(stdout);
+            last_moves = stats.moves;
+            last_updates = stats.updates;
+            report_us += 1000000;
+        }
+    }
+
+    double elapsed = (now_us() - start_us) / 1e6;
+    printf("Connections: %d requested, %lld opened, %d open at the end\n", total, stats.connects, open_count);
+    if (stats.all_seated_us > 0) {
+        double ramp = (stats.all_seated_us - start_us) / 1e6;
+        printf("Ramp: %d seated in %.0f ms (%.0f/s)\n", client_count, ramp * 1000, client_count / ramp);
+    } else {
+        printf("Ramp: %lld of %d seated\n", stats.seated, client_count);
+    }
+    printf("Moves: %lld (%.0f/s)\n", stats.moves, stats.moves / elapsed);
+    printf("Games: %lld (%.0f/s)\n", stats.games, stats.games / elapsed);
+    printf("Latency: p50 %lld us  p99 %lld us  p99.9 %lld us\n",
+           latency_percentile(0.5), latency_percentile(0.99), latency_percentile(0.999));
+    if (stats.moves > 0) {
+        printf("Bytes per move: %.1f in  %.1f out\n", (double)stats.bytes_in / stats.moves,
+               (double)stats.bytes_out / stats.moves);
+    }
+    if (spectator_count > 0) {
+        printf("Spectators: %d, %lld updates (%.0f/s), %.1f bytes each, %lld games watched to the end, %lld found nothing\n",
+               spectator_count, stats.updates, stats.updates / elapsed,
+               stats.updates > 0 ? (double)stats.spectator_bytes / stats.updates : 0.0, stats.watched, stats.unwatched);
+    }
+    if (stats.resyncs > 0) {
+        printf("Resyncs: %lld\n", stats.resyncs);
+    }
+    if (stats.errors > 0) {
+        printf("Protocol errors: %lld\n", stats.errors);
+    }
+    return 0;
+}
\ No newline at end of file
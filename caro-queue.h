@@ -0,0 +1,98 @@
+#ifndef CARO_QUEUE_H
+#define CARO_QUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+// Bounded multi-producer multi-consumer queue of pointers (Vyukov).
+// Every cell carries a sequence number that tells producers and consumers
+// whether it is free for the current lap, so push and pop are one CAS on
+// the shared index and never take a lock. Capacity is a power of two.
+typedef struct {
+    atomic_size_t sequence;
+    void *data;
+} QueueCell;
+
+typedef struct {
+    QueueCell *cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t head;   // next cell to push into
+    _Alignas(64) atomic_size_t tail;   // next cell to pop from
+} MpmcQueue;
+
+static inline int queue_init(MpmcQueue *queue, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    queue->cells = malloc(size * sizeof(QueueCell));
+    if (queue->cells == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].data = NULL;
+    }
+    queue->mask = size - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 1;
+}
+
+static inline void queue_free(MpmcQueue *queue) {
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// Returns 0 when the queue is full
+static inline int queue_push(MpmcQueue *queue, void *data) {
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    QueueCell *cell;
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+    cell->data = data;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+// Returns NULL when the queue is empty
+static inline void *queue_pop(MpmcQueue *queue) {
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    QueueCell *cell;
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+    void *data = cell->data;
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return data;
+}
+
+#endif
\ No newline at end of file
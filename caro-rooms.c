@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "caro-rooms.h"
+
+// Ids keep the slot index in the low 22 bits and the generation above it
+#define ROOM_INDEX_BITS 22
+#define ROOM_INDEX_MASK ((1u << ROOM_INDEX_BITS) - 1)
+#define SLOT_ALIGN 64
+
+static RoomSlot *slot_at(RoomTable *table, uint32_t index) {
+    return (RoomSlot *)(table->chunks[index / ROOMS_CHUNK] + (size_t)(index % ROOMS_CHUNK) * table->slot_size);
+}
+
+int rooms_init(RoomTable *table, size_t room_size) {
+    memset(table, 0, sizeof(*table));
+    pthread_mutex_init(&table->lock, NULL);
+    table->room_size = room_size;
+    table->slot_size = (sizeof(RoomSlot) + room_size + SLOT_ALIGN - 1) & ~(size_t)(SLOT_ALIGN - 1);
+    table->free_head = ROOM_NONE;
+    return 1;
+}
+
+void rooms_destroy(RoomTable *table) {
+    for (uint32_t c = 0; c < table->chunk_count; c++) {
+        free(table->chunks[c]);
+    }
+    pthread_mutex_destroy(&table->lock);
+    memset(table, 0, sizeof(*table));
+}
+
+// Returns a zeroed room, or NULL when memory or the id space runs out
+void *rooms_acquire(RoomTable *table, uint32_t *id) {
+    RoomSlot *slot;
+    uint32_t index;
+
+    pthread_mutex_lock(&table->lock);
+    if (table->free_head != ROOM_NONE) {
+        index = table->free_head;
+        slot = slot_at(table, index);
+        table->free_head = slot->next_free;
+        if (slot->generation > 0) {
+            table->stats.recycled++;
+        } else {
+            table->stats.created++;
+        }
+    } else {
+        if (table->chunk_count == ROOMS_MAX_CHUNKS) {
+            pthread_mutex_unlock(&table->lock);
+            return NULL;
+        }
+        uint8_t *chunk = aligned_alloc(SLOT_ALIGN, ROOMS_CHUNK * table->slot_size);
+        if (chunk == NULL) {
+            pthread_mutex_unlock(&table->lock);
+            return NULL;
+        }
+        // Thread the new slots onto the free list, lowest index first
+        uint32_t first = table->chunk_count * ROOMS_CHUNK;
+        table->chunks[table->chunk_count++] = chunk;
+        for (uint32_t i = ROOMS_CHUNK; i-- > 0;) {
+            RoomSlot *fresh = slot_at(table, first + i);
+            fresh->index = first + i;
+            fresh->generation = 0;
+            fresh->in_use = 0;
+            fresh->next_free = table->free_head;
+            if (i > 0) {
+                table->free_head = first + i;
+            }
+        }
+        index = first;
+        slot = slot_at(table, index);
+        table->stats.created++;
+    }
+    slot->next_free = ROOM_NONE;
+    slot->in_use = 1;
+    if (++table->stats.active > table->stats.peak) {
+        table->stats.peak = table->stats.active;
+    }
+    *id = (slot->generation << ROOM_INDEX_BITS) | index;
+    pthread_mutex_unlock(&table->lock);
+
+    memset(slot + 1, 0, table->room_size);
+    return slot + 1;
+}
+
+void rooms_release(RoomTable *table, void *room) {
+    RoomSlot *slot = (RoomSlot *)room - 1;
+
+    pthread_mutex_lock(&table->lock);
+    // A new generation invalidates every id handed out for this use; it
+    // wraps after 1024 uses of the same slot
+    slot->generation = (slot->generation + 1) & (0xFFFFFFFFu >> ROOM_INDEX_BITS);
+    slot->in_use = 0;
+    slot->next_free = table->free_head;
+    table->free_head = slot->index;
+    table->stats.active--;
+    pthread_mutex_unlock(&table->lock);
+}
+
+// O(1): the id holds the slot index directly
+void *rooms_lookup(RoomTable *table, uint32_t id) {
+    uint32_t index = id & ROOM_INDEX_MASK;
+    void *room = NULL;
+
+    pthread_mutex_lock(&table->lock);
+    if (index / ROOMS_CHUNK < table->chunk_count) {
+        RoomSlot *slot = slot_at(table, index);
+        if (slot->in_use && slot->generation == id >> ROOM_INDEX_BITS) {
+            room = slot + 1;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return room;
+}
+
+uint32_t rooms_id(RoomTable *table, const void *room) {
+    const RoomSlot *slot = (const RoomSlot *)room - 1;
+    (void)table;
+    return (slot->generation << ROOM_INDEX_BITS) | slot->index;
+}
+
+void rooms_stats(RoomTable *table, RoomStats *stats) {
+    pthread_mutex_lock(&table->lock);
+    *stats = table->stats;
+    pthread_mutex_unlock(&table->lock);
+}
\ No newline at end of file
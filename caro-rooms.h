@@ -0,0 +1,49 @@
+#ifndef CARO_ROOMS_H
+#define CARO_ROOMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ROOMS_CHUNK 1024          // rooms allocated at a time
+#define ROOMS_MAX_CHUNKS 4096     // up to 4M rooms
+#define ROOM_NONE 0xFFFFFFFFu
+
+// Slab of fixed-size rooms. Finished rooms go on a free list and are
+// handed out again, so a busy server stops calling malloc once it has
+// reached its peak room count. Rooms are named by an id that packs the
+// slot index with a generation counter: a stale id held after the room
+// was recycled looks up as NULL instead of someone else's game.
+typedef struct {
+    uint32_t index;
+    uint32_t generation;
+    uint32_t next_free;
+    uint32_t in_use;
+} RoomSlot;
+
+typedef struct {
+    long long active;
+    long long peak;
+    long long created;         // acquisitions of a slot never used before
+    long long recycled;        // acquisitions of a slot a finished room gave back
+} RoomStats;
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t room_size;          // caller's room struct
+    size_t slot_size;          // RoomSlot header plus room, cache-line aligned
+    uint8_t *chunks[ROOMS_MAX_CHUNKS];
+    uint32_t chunk_count;
+    uint32_t free_head;
+    RoomStats stats;
+} RoomTable;
+
+int rooms_init(RoomTable *table, size_t room_size);
+void rooms_destroy(RoomTable *table);
+void *rooms_acquire(RoomTable *table, uint32_t *id);
+void rooms_release(RoomTable *table, void *room);
+void *rooms_lookup(RoomTable *table, uint32_t id);
+uint32_t rooms_id(RoomTable *table, const void *room);
+void rooms_stats(RoomTable *table, RoomStats *stats);
+
+#endif
\ No newline at end of file
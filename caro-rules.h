@@ -0,0 +1,159 @@
+#ifndef CARO_RULES_H
+#define CARO_RULES_H
+
+#include <stdint.h>
+
+#ifndef WIN_LENGTH
+#define WIN_LENGTH 5
+#endif
+
+// Rule variants, picked at compile time with -DCARO_RULE=...
+#define RULE_FREESTYLE 0   // five or more in a row wins
+#define RULE_STANDARD 1    // exactly five wins, an overline does not
+#define RULE_CARO 2        // five or more, unless the opponent blocks both ends
+#define RULE_RENJU 3       // black (player 1) needs exactly five and may not
+                           // play overlines, double fours or double threes
+
+#ifndef CARO_RULE
+#define CARO_RULE RULE_FREESTYLE
+#endif
+
+// Under freestyle any full window is a win, so callers can skip the line
+// checks altogether; only Renju has forbidden moves.
+#define RULES_WINDOW_WINS (CARO_RULE == RULE_FREESTYLE)
+#define RULES_HAS_FORBIDDEN (CARO_RULE == RULE_RENJU)
+
+// A line is the 2 * WIN_LENGTH + 1 cells along one direction centred on
+// the cell being checked, which is always treated as the player's stone.
+#define RULE_RADIUS WIN_LENGTH
+#define RULE_LINE (2 * RULE_RADIUS + 1)
+#define LINE_EMPTY 0
+#define LINE_OWN 1
+#define LINE_OTHER 2
+#define LINE_WALL 3
+
+// Length of the run of own stones through the centre; start receives the
+// index of its first cell.
+static inline int rules_run(const int8_t *line, int *start) {
+    int first = RULE_RADIUS;
+    int last = RULE_RADIUS;
+    while (first > 0 && line[first - 1] == LINE_OWN) {
+        first--;
+    }
+    while (last < RULE_LINE - 1 && line[last + 1] == LINE_OWN) {
+        last++;
+    }
+    *start = first;
+    return last - first + 1;
+}
+
+// Does the run through the centre of this line win for player?
+static inline int rules_five(const int8_t *line, int player) {
+    int start;
+    int length = rules_run(line, &start);
+    (void)player;
+#if CARO_RULE == RULE_FREESTYLE
+    return length >= WIN_LENGTH;
+#elif CARO_RULE == RULE_STANDARD
+    return length == WIN_LENGTH;
+#elif CARO_RULE == RULE_CARO
+    int before = start > 0 ? line[start - 1] : LINE_WALL;
+    int after = start + length < RULE_LINE ? line[start + length] : LINE_WALL;
+    return length >= WIN_LENGTH && !(before == LINE_OTHER && after == LINE_OTHER);
+#else
+    return player == 1 ? length == WIN_LENGTH : length >= WIN_LENGTH;
+#endif
+}
+
+static inline int rules_is_win(int8_t lines[4][RULE_LINE], int player) {
+    return rules_five(lines[0], player) || rules_five(lines[1], player) ||
+           rules_five(lines[2], player) || rules_five(lines[3], player);
+}
+
+#if RULES_HAS_FORBIDDEN
+// Cells of the line where one more black stone makes exactly five through
+// the centre, with the first cell of each resulting five in starts.
+static inline int rules_completions(int8_t *line, int *starts) {
+    int count = 0;
+    for (int i = RULE_RADIUS - WIN_LENGTH + 1; i < RULE_RADIUS + WIN_LENGTH; i++) {
+        if (line[i] != LINE_EMPTY) {
+            continue;
+        }
+        line[i] = LINE_OWN;
+        int start;
+        if (rules_run(line, &start) == WIN_LENGTH) {
+            starts[count++] = start;
+        }
+        line[i] = LINE_EMPTY;
+    }
+    return count;
+}
+
+// Number of fours through the centre in one line. An open four has two
+// completions one cell apart and counts once; completions further apart
+// (e.g. X_XXX_X) are two fours in the same line.
+static inline int rules_fours(int8_t *line) {
+    int starts[2 * WIN_LENGTH];
+    int count = rules_completions(line, starts);
+    if (count == 0) {
+        return 0;
+    }
+    int low = starts[0];
+    int high = starts[0];
+    for (int k = 1; k < count; k++) {
+        low = starts[k] < low ? starts[k] : low;
+        high = starts[k] > high ? starts[k] : high;
+    }
+    return high - low > 1 ? 2 : 1;
+}
+
+// An open three is one move away from a straight four: two completions
+// whose fives start one cell apart.
+static inline int rules_open_three(int8_t *line) {
+    for (int i = RULE_RADIUS - WIN_LENGTH + 1; i < RULE_RADIUS + WIN_LENGTH; i++) {
+        if (line[i] != LINE_EMPTY) {
+            continue;
+        }
+        int starts[2 * WIN_LENGTH];
+        line[i] = LINE_OWN;
+        int start;
+        int count = rules_run(line, &start) < WIN_LENGTH ? rules_completions(line, starts) : 0;
+        line[i] = LINE_EMPTY;
+        if (count == 2 && (starts[1] - starts[0] == 1 || starts[0] - starts[1] == 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Renju restrictions for black playing the centre. A move that makes
+// exactly five is always allowed. Threes are counted without checking
+// whether the move that would make them straight fours is itself
+// forbidden, the usual simplification for engines.
+static inline int rules_forbidden(int8_t lines[4][RULE_LINE]) {
+    int fours = 0;
+    int threes = 0;
+    int overline = 0;
+    for (int d = 0; d < 4; d++) {
+        int start;
+        int length = rules_run(lines[d], &start);
+        if (length == WIN_LENGTH) {
+            return 0;
+        }
+        overline |= length > WIN_LENGTH;
+    }
+    if (overline) {
+        return 1;
+    }
+    for (int d = 0; d < 4; d++) {
+        int line_fours = rules_fours(lines[d]);
+        fours += line_fours;
+        if (line_fours == 0) {
+            threes += rules_open_three(lines[d]);
+        }
+    }
+    return fours >= 2 || threes >= 2;
+}
+#endif
+
+#endif
\ No newline at end of file
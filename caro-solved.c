@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "caro-solved.h"
+
+static uint64_t pow3[BOARD_CELLS + 1];
+static int symmetry[8][BOARD_CELLS];
+static pthread_once_t solved_once = PTHREAD_ONCE_INIT;
+
+static void build_symmetries(void) {
+    pow3[0] = 1;
+    for (int c = 1; c <= BOARD_CELLS; c++) {
+        pow3[c] = pow3[c - 1] * 3;
+    }
+    for (int s = 0; s < 8; s++) {
+        for (int i = 0; i < BOARD_SIZE; i++) {
+            for (int j = 0; j < BOARD_SIZE; j++) {
+                int r = i, c = j;
+                if (s & 1) {
+                    c = BOARD_SIZE - 1 - c;
+                }
+                if (s & 2) {
+                    r = BOARD_SIZE - 1 - r;
+                }
+                if (s & 4) {
+                    int t = r;
+                    r = c;
+                    c = t;
+                }
+                symmetry[s][i * BOARD_SIZE + j] = r * BOARD_SIZE + c;
+            }
+        }
+    }
+}
+
+void solved_init(void) {
+    pthread_once(&solved_once, build_symmetries);
+}
+
+uint64_t solved_index(const int8_t *cells) {
+    uint64_t index = 0;
+    for (int c = BOARD_CELLS - 1; c >= 0; c--) {
+        index = index * 3 + cells[c];
+    }
+    return index;
+}
+
+uint64_t solved_canonical(const int8_t *cells) {
+    uint64_t best = UINT64_MAX;
+    for (int s = 0; s < 8; s++) {
+        uint64_t index = 0;
+        for (int c = BOARD_CELLS - 1; c >= 0; c--) {
+            index = index * 3 + cells[symmetry[s][c]];
+        }
+        if (index < best) {
+            best = index;
+        }
+    }
+    return best;
+}
+
+int solved_open(SolvedTable *table, const char *path) {
+    struct stat st;
+    const SolvedHeader *header;
+
+    solved_init();
+    memset(table, 0, sizeof(*table));
+    table->fd = open(path, O_RDONLY);
+    if (table->fd < 0) {
+        return 0;
+    }
+    if (fstat(table->fd, &st) < 0 || (size_t)st.st_size < sizeof(SolvedHeader)) {
+        close(table->fd);
+        return 0;
+    }
+    table->size = st.st_size;
+    table->base = mmap(NULL, table->size, PROT_READ, MAP_SHARED, table->fd, 0);
+    if (table->base == MAP_FAILED) {
+        table->base = NULL;
+        close(table->fd);
+        return 0;
+    }
+
+    header = (const SolvedHeader *)table->base;
+    if (memcmp(header->magic, SOLVED_MAGIC, 8) != 0 || header->board_size != BOARD_SIZE ||
+        header->win_length != WIN_LENGTH || header->rule != CARO_RULE || BOARD_SIZE > SOLVED_MAX_SIZE ||
+        header->entry_count != pow3[BOARD_CELLS] ||
+        table->size < sizeof(SolvedHeader) + header->entry_count) {
+        solved_close(table);
+        return 0;
+    }
+    table->entries = table->base + sizeof(SolvedHeader);
+    table->entry_count = header->entry_count;
+    return 1;
+}
+
+void solved_close(SolvedTable *table) {
+    if (table->base != NULL) {
+        munmap(table->base, table->size);
+        close(table->fd);
+    }
+    memset(table, 0, sizeof(*table));
+}
+
+// O(1): one symmetry reduction and one byte read
+uint8_t solved_probe(const SolvedTable *table, int board[BOARD_SIZE][BOARD_SIZE]) {
+    int8_t cells[BOARD_CELLS];
+    if (table->entries == NULL) {
+        return SOLVED_UNKNOWN;
+    }
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        cells[c] = (int8_t)board[c / BOARD_SIZE][c % BOARD_SIZE];
+    }
+    return table->entries[solved_canonical(cells)];
+}
+
+// Picks the move with the best proven outcome: the fastest win, else a
+// draw, else the slowest loss. Returns 0 if the position is not in the table.
+int solved_best_move(const SolvedTable *table, int board[BOARD_SIZE][BOARD_SIZE], int *row, int *col) {
+    int stones[3] = {0, 0, 0};
+    int best_rank = -1;
+
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        stones[board[c / BOARD_SIZE][c % BOARD_SIZE]]++;
+    }
+    int side = stones[1] == stones[2] ? 1 : 2;
+    if (SOLVED_RESULT(solved_probe(table, board)) == SOLVED_UNKNOWN) {
+        return 0;
+    }
+
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        int i = c / BOARD_SIZE;
+        int j = c % BOARD_SIZE;
+        if (board[i][j] != 0) {
+            continue;
+        }
+        board[i][j] = side;
+        uint8_t entry = solved_probe(table, board);
+        board[i][j] = 0;
+
+        // The child's result is from the opponent's point of view
+        int rank;
+        switch (SOLVED_RESULT(entry)) {
+            case SOLVED_LOSS: rank = 300 - SOLVED_DISTANCE(entry); break;
+            case SOLVED_DRAW: rank = 200; break;
+            case SOLVED_WIN: rank = 100 + SOLVED_DISTANCE(entry); break;
+            default: rank = 0; break;
+        }
+        if (rank > best_rank) {
+            best_rank = rank;
+            *row = i;
+            *col = j;
+        }
+    }
+    return best_rank > 0;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef CARO_SOLVED_H
+#define CARO_SOLVED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "caro-engine.h"
+#include "caro-rules.h"
+
+#define SOLVED_MAGIC "CAROSOLV"
+#define SOLVED_MAX_SIZE 4
+
+// Each entry is one byte: the result for the side to move in the low two
+// bits and the number of plies to the end of perfect play in the upper six.
+#define SOLVED_UNKNOWN 0
+#define SOLVED_WIN 1
+#define SOLVED_LOSS 2
+#define SOLVED_DRAW 3
+#define SOLVED_ENTRY(result, distance) ((uint8_t)((result) | ((distance) << 2)))
+#define SOLVED_RESULT(entry) ((entry) & 3)
+#define SOLVED_DISTANCE(entry) ((entry) >> 2)
+
+typedef struct {
+    char magic[8];
+    uint16_t board_size;
+    uint16_t win_length;
+    uint32_t rule;           // CARO_RULE; tables from before it was kept are freestyle's 0
+    uint64_t entry_count;
+} SolvedHeader;
+
+typedef struct {
+    int fd;
+    uint8_t *base;
+    size_t size;
+    const uint8_t *entries;
+    uint64_t entry_count;
+} SolvedTable;
+
+// Positions are indexed in base 3, cell 0 being the lowest digit. Only the
+// smallest index among the 8 board symmetries is stored.
+void solved_init(void);
+uint64_t solved_index(const int8_t *cells);
+uint64_t solved_canonical(const int8_t *cells);
+
+int solved_open(SolvedTable *table, const char *path);
+void solved_close(SolvedTable *table);
+uint8_t solved_probe(const SolvedTable *table, int board[BOARD_SIZE][BOARD_SIZE]);
+int solved_best_move(const SolvedTable *table, int board[BOARD_SIZE][BOARD_SIZE], int *row, int *col);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "caro-solved.h"
+
+#if BOARD_SIZE > SOLVED_MAX_SIZE
+#error "caro-solver needs a small board, build with -DBOARD_SIZE=4 (or less) and a matching -DWIN_LENGTH"
+#endif
+
+// Exhaustive solver for small boards. Positions are solved layer by layer
+// from the full board down to the empty one; a layer only reads the layer
+// above it, so each layer is split across threads without locking.
+typedef struct {
+    uint8_t *entries;
+    uint64_t entry_count;
+    int lines[WINDOW_COUNT][WIN_LENGTH];
+    int line_count;
+    int threads;
+    int layer;
+} Solver;
+
+typedef struct {
+    int index;
+    uint64_t solved;
+} SolverShard;
+
+Solver solver;
+
+void build_lines(void) {
+    static const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            for (int d = 0; d < 4; d++) {
+                int end_row = i + (WIN_LENGTH - 1) * directions[d][0];
+                int end_col = j + (WIN_LENGTH - 1) * directions[d][1];
+                if (end_row < 0 || end_row >= BOARD_SIZE || end_col < 0 || end_col >= BOARD_SIZE) {
+                    continue;
+                }
+                for (int k = 0; k < WIN_LENGTH; k++) {
+                    solver.lines[solver.line_count][k] = (i + k * directions[d][0]) * BOARD_SIZE + j + k * directions[d][1];
+                }
+                solver.line_count++;
+            }
+        }
+    }
+}
+
+// Lines through cell for the rule checks in caro-rules.h; the cell itself
+// counts as player's stone
+void fill_rule_lines(const int8_t *cells, int cell, int player, int8_t lines[4][RULE_LINE]) {
+    static const int steps[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    for (int d = 0; d < 4; d++) {
+        for (int t = -RULE_RADIUS; t <= RULE_RADIUS; t++) {
+            int i = cell / BOARD_SIZE + t * steps[d][0];
+            int j = cell % BOARD_SIZE + t * steps[d][1];
+            int8_t value = LINE_WALL;
+            if (t == 0) {
+                value = LINE_OWN;
+            } else if (i >= 0 && i < BOARD_SIZE && j >= 0 && j < BOARD_SIZE) {
+                int stone = cells[i * BOARD_SIZE + j];
+                value = stone == 0 ? LINE_EMPTY : stone == player ? LINE_OWN : LINE_OTHER;
+            }
+            lines[d][t + RULE_RADIUS] = value;
+        }
+    }
+}
+
+// Has player a row that wins under CARO_RULE? Under freestyle any full
+// window does; the other rules look at the run through each stone.
+int has_line(const int8_t *cells, int player) {
+#if RULES_WINDOW_WINS
+    for (int l = 0; l < solver.line_count; l++) {
+        int k = 0;
+        while (k < WIN_LENGTH && cells[solver.lines[l][k]] == player) {
+            k++;
+        }
+        if (k == WIN_LENGTH) {
+            return 1;
+        }
+    }
+#else
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        int8_t lines[4][RULE_LINE];
+        if (cells[c] != player) {
+            continue;
+        }
+        fill_rule_lines(cells, c, player, lines);
+        if (rules_is_win(lines, player)) {
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+// Renju forbids black some moves; the other rules none
+int is_forbidden(int8_t *cells, int cell, int side) {
+#if RULES_HAS_FORBIDDEN
+    int8_t lines[4][RULE_LINE];
+    if (side != 1) {
+        return 0;
+    }
+    fill_rule_lines(cells, cell, side, lines);
+    return rules_forbidden(lines);
+#else
+    (void)cells;
+    (void)cell;
+    (void)side;
+    return 0;
+#endif
+}
+
+uint8_t solve_position(int8_t *cells, int side) {
+    int last = 3 - side;
+    int has_last = has_line(cells, last);
+    int has_side = has_line(cells, side);
+
+    if (has_side) {
+        // The game would already have ended; unreachable
+        return SOLVED_UNKNOWN;
+    }
+    if (has_last) {
+        return SOLVED_ENTRY(SOLVED_LOSS, 0);
+    }
+    if (solver.layer == BOARD_CELLS) {
+        return SOLVED_ENTRY(SOLVED_DRAW, 0);
+    }
+
+    int best_win = -1;
+    int has_draw = 0;
+    int longest_loss = 0;
+    int moves = 0;
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        if (cells[c] != 0 || is_forbidden(cells, c, side)) {
+            continue;
+        }
+        moves++;
+        cells[c] = side;
+        uint8_t child = solver.entries[solved_canonical(cells)];
+        cells[c] = 0;
+
+        int distance = SOLVED_DISTANCE(child) + 1;
+        switch (SOLVED_RESULT(child)) {
+            case SOLVED_LOSS:
+                if (best_win < 0 || distance < best_win) {
+                    best_win = distance;
+                }
+                break;
+            case SOLVED_DRAW:
+                has_draw = 1;
+                break;
+            case SOLVED_WIN:
+                if (distance > longest_loss) {
+                    longest_loss = distance;
+                }
+                break;
+        }
+    }
+
+    if (best_win >= 0) {
+        return SOLVED_ENTRY(SOLVED_WIN, best_win);
+    }
+    // With every empty cell forbidden the game stops as on a full board
+    if (has_draw || moves == 0) {
+        return SOLVED_ENTRY(SOLVED_DRAW, 0);
+    }
+    return SOLVED_ENTRY(SOLVED_LOSS, longest_loss);
+}
+
+void *solver_worker(void *arg) {
+    SolverShard *shard = (SolverShard *)arg;
+    uint64_t begin = solver.entry_count * shard->index / solver.threads;
+    uint64_t end = solver.entry_count * (shard->index + 1) / solver.threads;
+    int8_t cells[BOARD_CELLS];
+    int counts[3] = {0, 0, 0};
+
+    // Walk the range as a base-3 odometer, keeping stone counts incrementally
+    uint64_t value = begin;
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        cells[c] = value % 3;
+        value /= 3;
+        counts[cells[c]]++;
+    }
+
+    shard->solved = 0;
+    for (uint64_t index = begin; index < end; index++) {
+        if (counts[1] + counts[2] == solver.layer && (counts[1] == counts[2] || counts[1] == counts[2] + 1) &&
+            solved_canonical(cells) == index) {
+            int side = counts[1] == counts[2] ? 1 : 2;
+            solver.entries[index] = solve_position(cells, side);
+            shard->solved++;
+        }
+
+        for (int c = 0; c < BOARD_CELLS; c++) {
+            counts[cells[c]]--;
+            cells[c] = (cells[c] + 1) % 3;
+            counts[cells[c]]++;
+            if (cells[c] != 0) {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "caro-solved.bin";
+    SolvedHeader header;
+
+    solved_init();
+    build_lines();
+    solver.threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (solver.threads < 1) {
+        solver.threads = 1;
+    }
+    solver.entry_count = 1;
+    for (int c = 0; c < BOARD_CELLS; c++) {
+        solver.entry_count *= 3;
+    }
+    solver.entries = calloc(solver.entry_count, 1);
+    if (solver.entries == NULL) {
+        fprintf(stderr, "Error: Not enough memory for %llu entries\n", (unsigned long long)solver.entry_count);
+        return 1;
+    }
+
+    pthread_t *threads = malloc(solver.threads * sizeof(pthread_t));
+    SolverShard *shards = malloc(solver.threads * sizeof(SolverShard));
+    long long start_ms = engine_now_ms();
+    for (solver.layer = BOARD_CELLS; solver.layer >= 0; solver.layer--) {
+        uint64_t solved = 0;
+        for (int t = 0; t < solver.threads; t++) {
+            shards[t].index = t;
+            pthread_create(&threads[t], NULL, solver_worker, &shards[t]);
+        }
+        for (int t = 0; t < solver.threads; t++) {
+            pthread_join(threads[t], NULL);
+            solved += shards[t].solved;
+        }
+        printf("Layer %2d: %llu positions\n", solver.layer, (unsigned long long)solved);
+    }
+
+    uint8_t root = solver.entries[0];
+    static const char *names[4] = {"unknown", "first player wins", "second player wins", "draw"};
+    printf("%dx%d, %d in a row, rule %d: %s in %d plies (%lld ms)\n", BOARD_SIZE, BOARD_SIZE, WIN_LENGTH,
+           CARO_RULE, names[SOLVED_RESULT(root)], SOLVED_DISTANCE(root), engine_now_ms() - start_ms);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SOLVED_MAGIC, 8);
+    header.board_size = BOARD_SIZE;
+    header.win_length = WIN_LENGTH;
+    header.rule = CARO_RULE;
+    header.entry_count = solver.entry_count;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(solver.entries, 1, solver.entry_count, file) != solver.entry_count || fclose(file) != 0) {
+        perror("Error: Could not write the table");
+        return 1;
+    }
+
+    free(shards);
+    free(threads);
+    free(solver.entries);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "caro-task-pool.h"
+
+// The worker running on this thread, or the deque it attached, NULL for
+// any other thread
+static __thread TaskWorker *current_worker;
+
+// Owner only. Returns 0 when the deque is full.
+static int deque_push(TaskWorker *worker, TaskFunc func, void *arg) {
+    long bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    if (bottom - top >= TASK_DEQUE_SIZE) {
+        return 0;
+    }
+    Task *task = &worker->tasks[bottom & (TASK_DEQUE_SIZE - 1)];
+    __atomic_store_n(&task->func, func, __ATOMIC_RELAXED);
+    __atomic_store_n(&task->arg, arg, __ATOMIC_RELAXED);
+    // Publishes the task to thieves, which load bottom with acquire
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_release);
+    return 1;
+}
+
+// Owner only, newest task first
+static int deque_take(TaskWorker *worker, Task *out) {
+    long bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+        return 0;
+    }
+    *out = worker->tasks[bottom & (TASK_DEQUE_SIZE - 1)];
+    if (top == bottom) {
+        // Last task: race the thieves for it
+        int won = atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1,
+                                                          memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+        return won;
+    }
+    return 1;
+}
+
+// Any thread, oldest task first
+static int deque_steal(TaskWorker *worker, Task *out) {
+    long top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&worker->bottom, memory_order_acquire);
+    if (top >= bottom) {
+        return 0;
+    }
+    // The slot can only be reused after top moves past it, and then the
+    // CAS below fails, so a torn read is never used
+    Task *task = &worker->tasks[top & (TASK_DEQUE_SIZE - 1)];
+    out->func = __atomic_load_n(&task->func, __ATOMIC_RELAXED);
+    out->arg = __atomic_load_n(&task->arg, __ATOMIC_RELAXED);
+    return atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1,
+                                                   memory_order_seq_cst, memory_order_relaxed);
+}
+
+static void wake_worker(TaskPool *pool) {
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_ready);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Own deque first, then the shared queue, then a sweep over the others,
+// attached submitters included, starting at a random victim
+static int find_task(TaskPool *pool, TaskWorker *worker, Task *task) {
+    if (deque_take(worker, task)) {
+        return 1;
+    }
+    Task *injected = queue_pop(&pool->inject);
+    if (injected != NULL) {
+        *task = *injected;
+        free(injected);
+        return 1;
+    }
+    int victims = pool->worker_count + atomic_load_explicit(&pool->attached, memory_order_acquire);
+    int start = (int)(rand_r(&worker->seed) % (unsigned int)victims);
+    for (int i = 0; i < victims; i++) {
+        TaskWorker *victim = &pool->workers[(start + i) % victims];
+        if (victim != worker && deque_steal(victim, task)) {
+            __atomic_store_n(&worker->stolen, worker->stolen + 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *task_worker_main(void *arg) {
+    TaskPool *pool = (TaskPool *)arg;
+    TaskWorker *worker = NULL;
+    Task task;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->worker_count; i++) {
+        if (pthread_equal(pool->workers[i].thread, pthread_self())) {
+            worker = &pool->workers[i];
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    current_worker = worker;
+
+    while (!atomic_load(&pool->shutdown)) {
+        if (find_task(pool, worker, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.func(task.arg);
+            __atomic_store_n(&worker->executed, worker->executed + 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // Nothing anywhere: sleep until a submission says otherwise. The
+        // sleeper count is raised before queued is checked, and submitters
+        // raise queued before they look at it, so no wakeup is lost.
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->shutdown)) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+int task_pool_init(TaskPool *pool, int worker_count) {
+    if (worker_count <= 0) {
+        worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (worker_count < 1) {
+            worker_count = 1;
+        }
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = calloc(worker_count + TASK_SUBMITTERS, sizeof(TaskWorker));
+    if (pool->workers == NULL || !queue_init(&pool->inject, TASK_INJECT_SIZE)) {
+        free(pool->workers);
+        return 0;
+    }
+    for (int i = 0; i < worker_count; i++) {
+        pool->workers[i].tasks = calloc(TASK_DEQUE_SIZE, sizeof(Task));
+        if (pool->workers[i].tasks == NULL) {
+            for (int j = 0; j < i; j++) {
+                free(pool->workers[j].tasks);
+            }
+            free(pool->workers);
+            queue_free(&pool->inject);
+            return 0;
+        }
+        pool->workers[i].seed = (unsigned int)i * 2654435761u + 1;
+    }
+    atomic_init(&pool->attached, 0);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->shutdown, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+
+    // Workers look themselves up by thread id, so hold the lock until all exist
+    pthread_mutex_lock(&pool->lock);
+    pool->worker_count = worker_count;
+    for (int i = 0; i < worker_count; i++) {
+        pthread_create(&pool->workers[i].thread, NULL, task_worker_main, pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
+
+// Gives the calling thread, which must not be one of the workers, a deque
+// of its own. What it submits from then on is pushed there without a
+// malloc and stolen by idle workers. Meant for a thread that feeds the
+// pool all the time, such as a poller. Returns 0 when none is left.
+int task_pool_attach(TaskPool *pool) {
+    int attached = 1;
+
+    pthread_mutex_lock(&pool->lock);
+    int slot = atomic_load(&pool->attached);
+    TaskWorker *worker = &pool->workers[pool->worker_count + slot];
+    if (slot == TASK_SUBMITTERS || (worker->tasks = calloc(TASK_DEQUE_SIZE, sizeof(Task))) == NULL) {
+        attached = 0;
+    } else {
+        worker->thread = pthread_self();
+        atomic_store_explicit(&pool->attached, slot + 1, memory_order_release);
+        current_worker = worker;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return attached;
+}
+
+// From a worker or an attached thread the task goes on its own deque,
+// where idle workers can steal it; from any other thread it goes through
+// the shared queue. Returns 0 when both are full, so the caller can hold
+// back or run the task itself.
+int task_pool_submit(TaskPool *pool, TaskFunc func, void *arg) {
+    TaskWorker *worker = current_worker;
+
+    atomic_fetch_add(&pool->queued, 1);
+    if (worker != NULL && deque_push(worker, func, arg)) {
+        wake_worker(pool);
+        return 1;
+    }
+    Task *task = malloc(sizeof(Task));
+    if (task != NULL) {
+        task->func = func;
+        task->arg = arg;
+        if (queue_push(&pool->inject, task)) {
+            wake_worker(pool);
+            return 1;
+        }
+        free(task);
+    }
+    atomic_fetch_sub(&pool->queued, 1);
+    return 0;
+}
+
+// Totals over all workers, each counter is only written by its worker
+void task_pool_stats(TaskPool *pool, long long *executed, long long *stolen) {
+    *executed = 0;
+    *stolen = 0;
+    for (int i = 0; i < pool->worker_count; i++) {
+        *executed += __atomic_load_n(&pool->workers[i].executed, __ATOMIC_RELAXED);
+        *stolen += __atomic_load_n(&pool->workers[i].stolen, __ATOMIC_RELAXED);
+    }
+}
+
+// Tasks still queued are dropped
+void task_pool_shutdown(TaskPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        free(pool->workers[i].tasks);
+    }
+    int attached = atomic_load(&pool->attached);
+    for (int i = 0; i < attached; i++) {
+        TaskWorker *worker = &pool->workers[pool->worker_count + i];
+        if (current_worker == worker) {
+            current_worker = NULL;
+        }
+        free(worker->tasks);
+    }
+    Task *task;
+    while ((task = queue_pop(&pool->inject)) != NULL) {
+        free(task);
+    }
+    queue_free(&pool->inject);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef CARO_TASK_POOL_H
+#define CARO_TASK_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "caro-queue.h"
+
+#define TASK_DEQUE_SIZE 4096      // per worker, a power of two
+#define TASK_INJECT_SIZE 65536    // submissions from threads outside the pool
+#define TASK_SUBMITTERS 4         // outside threads that may have a deque of their own
+
+typedef void (*TaskFunc)(void *arg);
+
+typedef struct {
+    TaskFunc func;
+    void *arg;
+} Task;
+
+// Chase-Lev deque: the owner pushes and takes at the bottom without
+// locking, idle workers steal from the top with one CAS.
+typedef struct {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    Task *tasks;
+    pthread_t thread;
+    unsigned int seed;        // picks steal victims
+    long long executed;
+    long long stolen;
+} TaskWorker;
+
+typedef struct {
+    TaskWorker *workers;      // the pool's threads, then the attached submitters
+    int worker_count;
+    atomic_int attached;      // submitters behind the workers
+    MpmcQueue inject;         // Task pointers from outside the pool
+    atomic_long queued;       // tasks submitted and not yet started
+    atomic_int sleepers;
+    pthread_mutex_t lock;     // only for putting idle workers to sleep
+    pthread_cond_t work_ready;
+    atomic_int shutdown;
+} TaskPool;
+
+int task_pool_init(TaskPool *pool, int worker_count);
+int task_pool_attach(TaskPool *pool);
+int task_pool_submit(TaskPool *pool, TaskFunc func, void *arg);
+void task_pool_stats(TaskPool *pool, long long *executed, long long *stolen);
+void task_pool_shutdown(TaskPool *pool);
+
+#endif
\ No newline at end of file
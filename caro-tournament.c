@@ -0,0 +1,434 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "caro-engine.h"
+
+#define TOURNAMENT_GRACE_MS 100
+#define TOURNAMENT_START_MS 5000
+#define MAX_OPENING_STONES 4
+
+// Engine-vs-engine matches between two Piskvork brains. Each opening is
+// played twice with colours swapped, games run in parallel and the match
+// stops as soon as the SPRT reaches a decision.
+typedef struct {
+    int count;
+    int stones[MAX_OPENING_STONES][2];  // row/col offsets from the centre
+} Opening;
+
+static const Opening openings[] = {
+    {2, {{0, 0}, {0, 1}}},
+    {2, {{0, 0}, {1, 1}}},
+    {3, {{0, 0}, {0, 1}, {1, 0}}},
+    {3, {{0, 0}, {1, 1}, {0, 2}}},
+    {3, {{0, 0}, {-1, 1}, {1, 1}}},
+    {3, {{0, 0}, {0, 2}, {2, 0}}},
+    {4, {{0, 0}, {1, 0}, {-1, 1}, {2, 2}}},
+    {4, {{0, 0}, {0, 1}, {1, -1}, {-1, 2}}},
+};
+#define OPENING_COUNT ((int)(sizeof(openings) / sizeof(openings[0])))
+
+typedef struct {
+    pid_t pid;
+    int to_brain;
+    int from_brain;
+    char buffer[4096];
+    int length;
+    long long time_left;
+} BrainProcess;
+
+typedef struct {
+    const char *engine_path[2];
+    int max_games;
+    int concurrency;
+    long long turn_ms;
+    long long match_ms;
+    double elo0, elo1, alpha, beta;
+    FILE *log;
+
+    pthread_mutex_t lock;
+    int next_game;
+    int finished;
+    int wins, draws, losses;   // from engine A's point of view
+    int stop;
+    double llr;
+} Tournament;
+
+Tournament tournament;
+
+// Games start brains from several threads at once, so the pipes are
+// close-on-exec from the start: a brain forked by another game must not
+// inherit them, or this game never sees EOF when its brain dies. dup2
+// clears the flag on the child's stdin and stdout.
+int brain_start(BrainProcess *brain, const char *path) {
+    int in_pipe[2], out_pipe[2];
+    if (pipe2(in_pipe, O_CLOEXEC) < 0 || pipe2(out_pipe, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return 0;
+    }
+
+    brain->pid = fork();
+    if (brain->pid < 0) {
+        perror("fork");
+        return 0;
+    }
+    if (brain->pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        dup2(in_pipe[0], STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDERR_FILENO);
+        }
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        execl(path, path, (char *)NULL);
+        _exit(127);
+    }
+
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    brain->to_brain = in_pipe[1];
+    brain->from_brain = out_pipe[0];
+    brain->length = 0;
+    return 1;
+}
+
+void brain_stop(BrainProcess *brain) {
+    if (write(brain->to_brain, "END\n", 4) < 0) {
+        // Already gone
+    }
+    close(brain->to_brain);
+    close(brain->from_brain);
+    for (int i = 0; i < 50; i++) {
+        if (waitpid(brain->pid, NULL, WNOHANG) == brain->pid) {
+            return;
+        }
+        usleep(10000);
+    }
+    kill(brain->pid, SIGKILL);
+    waitpid(brain->pid, NULL, 0);
+}
+
+int brain_send(BrainProcess *brain, const char *format, ...) {
+    char line[4096];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    line[length++] = '\n';
+
+    for (int sent = 0; sent < length;) {
+        ssize_t n = write(brain->to_brain, line + sent, length - sent);
+        if (n <= 0) {
+            return 0;
+        }
+        sent += n;
+    }
+    return 1;
+}
+
+// Returns 1 with a line, 0 on timeout and -1 when the brain has exited.
+int brain_read_line(BrainProcess *brain, char *line, size_t size, long long deadline_ms) {
+    while (1) {
+        char *newline = memchr(brain->buffer, '\n', brain->length);
+        if (newline != NULL) {
+            size_t length = newline - brain->buffer;
+            size_t copy = length < size - 1 ? length : size - 1;
+            memcpy(line, brain->buffer, copy);
+            line[copy] = '\0';
+            if (copy > 0 && line[copy - 1] == '\r') {
+                line[copy - 1] = '\0';
+            }
+            brain->length -= length + 1;
+            memmove(brain->buffer, newline + 1, brain->length);
+            return 1;
+        }
+        if (brain->length == (int)sizeof(brain->buffer)) {
+            brain->length = 0;  // Overlong line, drop it
+        }
+
+        long long wait_ms = deadline_ms - engine_now_ms();
+        if (wait_ms <= 0) {
+            return 0;
+        }
+        struct pollfd pfd = {brain->from_brain, POLLIN, 0};
+        int ready = poll(&pfd, 1, (int)wait_ms);
+        if (ready == 0) {
+            return 0;
+        }
+        if (ready < 0) {
+            return -1;
+        }
+        ssize_t n = read(brain->from_brain, brain->buffer + brain->length, sizeof(brain->buffer) - brain->length);
+        if (n <= 0) {
+            return -1;
+        }
+        brain->length += n;
+    }
+}
+
+// Waits for a reply that is not a MESSAGE/DEBUG line.
+int brain_expect(BrainProcess *brain, char *line, size_t size, long long deadline_ms) {
+    while (1) {
+        int status = brain_read_line(brain, line, size, deadline_ms);
+        if (status <= 0) {
+            return status;
+        }
+        if (strncasecmp(line, "MESSAGE", 7) != 0 && strncasecmp(line, "DEBUG", 5) != 0) {
+            return 1;
+        }
+    }
+}
+
+// Plays one game; returns the result for engine A (1 win, 0 draw, -1 loss).
+int play_game(int game, int *move_count, const char **reason) {
+    const Opening *opening = &openings[(game / 2) % OPENING_COUNT];
+    int a_moves_first = game % 2 == 0;
+    BrainProcess brains[2];   // brains[0] moves first
+    int seen_board[2] = {0, 0};
+    char line[4096];
+    Engine referee;
+    int result = 0;
+
+    engine_reset(&referee);
+    if (!brain_start(&brains[0], tournament.engine_path[a_moves_first ? 0 : 1])) {
+        exit(1);
+    }
+    if (!brain_start(&brains[1], tournament.engine_path[a_moves_first ? 1 : 0])) {
+        exit(1);
+    }
+
+    *reason = "full";
+    for (int b = 0; b < 2; b++) {
+        brains[b].time_left = tournament.match_ms;
+        brain_send(&brains[b], "START %d", BOARD_SIZE);
+        if (brain_expect(&brains[b], line, sizeof(line), engine_now_ms() + TOURNAMENT_START_MS) != 1 ||
+            strncasecmp(line, "OK", 2) != 0) {
+            *reason = "start";
+            result = (b == 0) == a_moves_first ? -1 : 1;
+            goto done;
+        }
+        brain_send(&brains[b], "INFO timeout_turn %lld", tournament.turn_ms);
+        brain_send(&brains[b], "INFO timeout_match %lld", tournament.match_ms);
+    }
+
+    for (int s = 0; s < opening->count; s++) {
+        engine_make_move(&referee, BOARD_SIZE / 2 + opening->stones[s][0], BOARD_SIZE / 2 + opening->stones[s][1]);
+    }
+
+    while (referee.winner == 0 && referee.move_count < BOARD_CELLS) {
+        int b = referee.side - 1;
+        BrainProcess *brain = &brains[b];
+        long long allowed = tournament.turn_ms > 0 ? tournament.turn_ms : 0;
+
+        if (tournament.match_ms > 0) {
+            brain_send(brain, "INFO time_left %lld", brain->time_left);
+            if (allowed == 0 || brain->time_left < allowed) {
+                allowed = brain->time_left;
+            }
+        }
+        if (allowed <= 0) {
+            allowed = TOURNAMENT_START_MS;
+        }
+
+        // First turn of each brain gets the whole position, later ones just the last move
+        if (!seen_board[b]) {
+            char board_text[8192];
+            int length = sprintf(board_text, "BOARD");
+            for (int m = 0; m < referee.move_count; m++) {
+                int cell = referee.moves[m];
+                int own = (m % 2) == b ? 1 : 2;
+                length += sprintf(board_text + length, "\n%d,%d,%d", cell % BOARD_SIZE, cell / BOARD_SIZE, own);
+            }
+            sprintf(board_text + length, "\nDONE");
+            brain_send(brain, "%s", board_text);
+            seen_board[b] = 1;
+        } else {
+            int last = referee.moves[referee.move_count - 1];
+            brain_send(brain, "TURN %d,%d", last % BOARD_SIZE, last / BOARD_SIZE);
+        }
+
+        long long start_ms = engine_now_ms();
+        int status = brain_expect(brain, line, sizeof(line), start_ms + allowed + TOURNAMENT_GRACE_MS);
+        long long used_ms = engine_now_ms() - start_ms;
+        brain->time_left -= used_ms;
+
+        int x, y;
+        int brain_is_a = (b == 0) == a_moves_first;
+        if (status != 1) {
+            *reason = status == 0 ? "time" : "crash";
+            result = brain_is_a ? -1 : 1;
+            goto done;
+        }
+        if (sscanf(line, "%d,%d", &x, &y) != 2 || !engine_is_legal(&referee, y, x)) {
+            *reason = "illegal";
+            result = brain_is_a ? -1 : 1;
+            goto done;
+        }
+        engine_make_move(&referee, y, x);
+        if (referee.winner != 0) {
+            *reason = "five";
+            result = brain_is_a ? 1 : -1;
+        }
+    }
+
+done:
+    *move_count = referee.move_count;
+    brain_stop(&brains[0]);
+    brain_stop(&brains[1]);
+    return result;
+}
+
+// Log-likelihood ratio of elo1 against elo0 using the normal approximation
+// of the per-game score distribution.
+double sprt_llr(int wins, int draws, int losses, double elo0, double elo1) {
+    int n = wins + draws + losses;
+    if (wins == 0 || losses == 0 || n == 0) {
+        return 0.0;
+    }
+    double score = (wins + 0.5 * draws) / n;
+    double variance = (wins * pow(1.0 - score, 2) + draws * pow(0.5 - score, 2) + losses * pow(score, 2)) / n;
+    double s0 = 1.0 / (1.0 + pow(10.0, -elo0 / 400.0));
+    double s1 = 1.0 / (1.0 + pow(10.0, -elo1 / 400.0));
+    return n * (s1 - s0) * (2.0 * score - s0 - s1) / (2.0 * variance);
+}
+
+double score_to_elo(double score) {
+    if (score <= 0.0) {
+        return -INFINITY;
+    }
+    if (score >= 1.0) {
+        return INFINITY;
+    }
+    return -400.0 * log10(1.0 / score - 1.0);
+}
+
+void *tournament_worker(void *arg) {
+    (void)arg;
+    double lower = log(tournament.beta / (1.0 - tournament.alpha));
+    double upper = log((1.0 - tournament.beta) / tournament.alpha);
+
+    while (1) {
+        pthread_mutex_lock(&tournament.lock);
+        if (tournament.stop || tournament.next_game >= tournament.max_games) {
+            pthread_mutex_unlock(&tournament.lock);
+            break;
+        }
+        int game = tournament.next_game++;
+        pthread_mutex_unlock(&tournament.lock);
+
+        int moves;
+        const char *reason;
+        int result = play_game(game, &moves, &reason);
+
+        pthread_mutex_lock(&tournament.lock);
+        if (result > 0) {
+            tournament.wins++;
+        } else if (result < 0) {
+            tournament.losses++;
+        } else {
+            tournament.draws++;
+        }
+        tournament.finished++;
+        tournament.llr = sprt_llr(tournament.wins, tournament.draws, tournament.losses, tournament.elo0, tournament.elo1);
+        if (tournament.llr <= lower || tournament.llr >= upper) {
+            tournament.stop = 1;
+        }
+
+        // game opening first-mover result moves reason, then the running totals
+        fprintf(tournament.log, "%d %d %c %c %d %s %d-%d-%d %.3f\n", game, (game / 2) % OPENING_COUNT,
+                game % 2 == 0 ? 'A' : 'B', result > 0 ? 'W' : result < 0 ? 'L' : 'D', moves, reason,
+                tournament.wins, tournament.draws, tournament.losses, tournament.llr);
+        fflush(tournament.log);
+        pthread_mutex_unlock(&tournament.lock);
+    }
+
+    return NULL;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s -a engine_a -b engine_b [-n games] [-j threads] [-t turn_ms] [-m match_ms]\n"
+                    "          [-e elo0] [-E elo1] [-p alpha] [-q beta] [-o results.log]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *log_path = "tournament.log";
+    int option;
+
+    tournament.max_games = 10000;
+    tournament.concurrency = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    tournament.turn_ms = 1000;
+    tournament.match_ms = 0;
+    tournament.elo0 = 0.0;
+    tournament.elo1 = 5.0;
+    tournament.alpha = 0.05;
+    tournament.beta = 0.05;
+
+    while ((option = getopt(argc, argv, "a:b:n:j:t:m:e:E:p:q:o:")) != -1) {
+        switch (option) {
+            case 'a': tournament.engine_path[0] = optarg; break;
+            case 'b': tournament.engine_path[1] = optarg; break;
+            case 'n': tournament.max_games = atoi(optarg); break;
+            case 'j': tournament.concurrency = atoi(optarg); break;
+            case 't': tournament.turn_ms = atoll(optarg); break;
+            case 'm': tournament.match_ms = atoll(optarg); break;
+            case 'e': tournament.elo0 = atof(optarg); break;
+            case 'E': tournament.elo1 = atof(optarg); break;
+            case 'p': tournament.alpha = atof(optarg); break;
+            case 'q': tournament.beta = atof(optarg); break;
+            case 'o': log_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (tournament.engine_path[0] == NULL || tournament.engine_path[1] == NULL) {
+        usage(argv[0]);
+    }
+    if (tournament.concurrency < 1) {
+        tournament.concurrency = 1;
+    }
+
+    tournament.log = fopen(log_path, "we");   // not inherited by the brains
+    if (tournament.log == NULL) {
+        perror("fopen");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    engine_init();
+    pthread_mutex_init(&tournament.lock, NULL);
+
+    pthread_t *threads = malloc(tournament.concurrency * sizeof(pthread_t));
+    for (int i = 0; i < tournament.concurrency; i++) {
+        pthread_create(&threads[i], NULL, tournament_worker, NULL);
+    }
+    for (int i = 0; i < tournament.concurrency; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int n = tournament.finished;
+    double score = n > 0 ? (tournament.wins + 0.5 * tournament.draws) / n : 0.5;
+    double lower = log(tournament.beta / (1.0 - tournament.alpha));
+    double upper = log((1.0 - tournament.beta) / tournament.alpha);
+    const char *verdict = tournament.llr >= upper ? "H1 accepted" : tournament.llr <= lower ? "H0 accepted" : "inconclusive";
+
+    printf("Games %d: +%d =%d -%d, score %.3f, elo %+.1f\n", n, tournament.wins, tournament.draws, tournament.losses,
+           score, score_to_elo(score));
+    printf("SPRT elo0=%.1f elo1=%.1f: LLR %.3f [%.3f, %.3f] %s\n", tournament.elo0, tournament.elo1,
+           tournament.llr, lower, upper, verdict);
+
+    fclose(tournament.log);
+    pthread_mutex_destroy(&tournament.lock);
+    free(threads);
+    return 0;
+}
\ No newline at end of file
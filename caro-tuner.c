@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "caro-engine.h"
+#include "caro-dataset.h"
+
+#define MAX_DATASETS 64
+#define PARAM_COUNT (2 * (WIN_LENGTH - 1))
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define ADAM_EPSILON 1e-8
+
+// Texel-style tuning of engine_weights: minimise the squared error between
+// sigmoid(K * eval) and the game result. Parameters are the own and opponent
+// weights for 1..WIN_LENGTH-1 stones; eval is linear in them.
+typedef struct {
+    DatasetReader readers[MAX_DATASETS];
+    int reader_count;
+    int threads;
+    double params[PARAM_COUNT];
+    double scale;
+} Tuner;
+
+typedef struct {
+    int index;
+    double gradient[PARAM_COUNT];
+    double error;
+    uint64_t positions;
+} TunerShard;
+
+Tuner tuner;
+
+// Returns 0 for positions the static eval is not meant to judge
+int extract_features(const PositionRecord *record, double features[PARAM_COUNT]) {
+    int board[BOARD_SIZE][BOARD_SIZE];
+    Engine engine;
+
+    dataset_unpack_board(record, board);
+    engine_setup(&engine, board, record->side);
+    int p = record->side - 1;
+    int o = p ^ 1;
+    if (engine.winner != 0 || engine.window_count[p][WIN_LENGTH - 1] > 0 || engine.window_count[o][WIN_LENGTH - 1] > 0) {
+        return 0;
+    }
+    for (int k = 1; k < WIN_LENGTH; k++) {
+        features[k - 1] = engine.window_count[p][k];
+        features[WIN_LENGTH - 1 + k - 1] = -engine.window_count[o][k];
+    }
+    return 1;
+}
+
+double sigmoid(double x) {
+    return 1.0 / (1.0 + exp(-x));
+}
+
+// Each thread takes its own slice of every file and accumulates privately
+void *tuner_worker(void *arg) {
+    TunerShard *shard = (TunerShard *)arg;
+    double features[PARAM_COUNT];
+
+    memset(shard->gradient, 0, sizeof(shard->gradient));
+    shard->error = 0.0;
+    shard->positions = 0;
+
+    for (int r = 0; r < tuner.reader_count; r++) {
+        const DatasetReader *reader = &tuner.readers[r];
+        uint64_t begin = reader->count * shard->index / tuner.threads;
+        uint64_t end = reader->count * (shard->index + 1) / tuner.threads;
+
+        for (uint64_t i = begin; i < end; i++) {
+            const PositionRecord *record = &reader->records[i];
+            if (!extract_features(record, features)) {
+                continue;
+            }
+            double eval = 0.0;
+            for (int j = 0; j < PARAM_COUNT; j++) {
+                eval += tuner.params[j] * features[j];
+            }
+            double predicted = sigmoid(tuner.scale * eval);
+            double target = (record->result + 1) * 0.5;
+            double difference = predicted - target;
+            double factor = 2.0 * difference * predicted * (1.0 - predicted) * tuner.scale;
+            for (int j = 0; j < PARAM_COUNT; j++) {
+                shard->gradient[j] += factor * features[j];
+            }
+            shard->error += difference * difference;
+            shard->positions++;
+        }
+    }
+    return NULL;
+}
+
+// One parallel pass; returns the mean error and fills the mean gradient
+double evaluate_dataset(double gradient[PARAM_COUNT], uint64_t *positions) {
+    pthread_t *threads = malloc(tuner.threads * sizeof(pthread_t));
+    TunerShard *shards = malloc(tuner.threads * sizeof(TunerShard));
+    double error = 0.0;
+
+    for (int t = 0; t < tuner.threads; t++) {
+        shards[t].index = t;
+        pthread_create(&threads[t], NULL, tuner_worker, &shards[t]);
+    }
+    memset(gradient, 0, PARAM_COUNT * sizeof(double));
+    *positions = 0;
+    for (int t = 0; t < tuner.threads; t++) {
+        pthread_join(threads[t], NULL);
+        for (int j = 0; j < PARAM_COUNT; j++) {
+            gradient[j] += shards[t].gradient[j];
+        }
+        error += shards[t].error;
+        *positions += shards[t].positions;
+    }
+    if (*positions > 0) {
+        for (int j = 0; j < PARAM_COUNT; j++) {
+            gradient[j] /= *positions;
+        }
+        error /= *positions;
+    }
+
+    free(shards);
+    free(threads);
+    return error;
+}
+
+// Picks the sigmoid scale that best fits the starting weights
+void fit_scale(void) {
+    double gradient[PARAM_COUNT];
+    uint64_t positions;
+    double best_scale = tuner.scale;
+    double best_error = 1e9;
+
+    for (double scale = 1e-4; scale <= 1e-1; scale *= 1.5) {
+        tuner.scale = scale;
+        double error = evaluate_dataset(gradient, &positions);
+        if (error < best_error) {
+            best_error = error;
+            best_scale = scale;
+        }
+    }
+    tuner.scale = best_scale;
+    printf("Scale K = %g, error %.6f\n", best_scale, best_error);
+}
+
+void params_to_weights(int weights[2][WIN_LENGTH]) {
+    for (int side = 0; side < 2; side++) {
+        weights[side][0] = 0;
+        for (int k = 1; k < WIN_LENGTH; k++) {
+            weights[side][k] = (int)lround(tuner.params[side * (WIN_LENGTH - 1) + k - 1]);
+        }
+    }
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-o weights.txt] [-w start.txt] [-e epochs] [-l rate] [-k scale] [-j threads] data.bin...\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = "caro-weights.txt";
+    int epochs = 200;
+    double rate = 1.0;
+    int option;
+
+    tuner.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    tuner.scale = 0.0;
+
+    engine_init();
+    while ((option = getopt(argc, argv, "o:w:e:l:k:j:")) != -1) {
+        switch (option) {
+            case 'o': output = optarg; break;
+            case 'w':
+                if (!engine_load_weights(optarg)) {
+                    fprintf(stderr, "Error: Could not load weights from %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e': epochs = atoi(optarg); break;
+            case 'l': rate = atof(optarg); break;
+            case 'k': tuner.scale = atof(optarg); break;
+            case 'j': tuner.threads = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+    }
+    if (tuner.threads < 1) {
+        tuner.threads = 1;
+    }
+
+    for (int i = optind; i < argc && tuner.reader_count < MAX_DATASETS; i++) {
+        if (!dataset_reader_open(&tuner.readers[tuner.reader_count], argv[i])) {
+            return 1;
+        }
+        tuner.reader_count++;
+    }
+
+    for (int side = 0; side < 2; side++) {
+        for (int k = 1; k < WIN_LENGTH; k++) {
+            tuner.params[side * (WIN_LENGTH - 1) + k - 1] = engine_weights[side][k];
+        }
+    }
+    if (tuner.scale <= 0.0) {
+        fit_scale();
+    }
+
+    // Adam; the raw gradients differ by orders of magnitude between stone counts
+    double m[PARAM_COUNT] = {0};
+    double v[PARAM_COUNT] = {0};
+    double gradient[PARAM_COUNT];
+    uint64_t positions = 0;
+    uint64_t total_positions = 0;
+    long long start_ms = engine_now_ms();
+
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        long long epoch_ms = engine_now_ms();
+        double error = evaluate_dataset(gradient, &positions);
+        long long elapsed_ms = engine_now_ms() - epoch_ms;
+        total_positions += positions;
+
+        for (int j = 0; j < PARAM_COUNT; j++) {
+            m[j] = ADAM_BETA1 * m[j] + (1.0 - ADAM_BETA1) * gradient[j];
+            v[j] = ADAM_BETA2 * v[j] + (1.0 - ADAM_BETA2) * gradient[j] * gradient[j];
+            double m_hat = m[j] / (1.0 - pow(ADAM_BETA1, epoch));
+            double v_hat = v[j] / (1.0 - pow(ADAM_BETA2, epoch));
+            tuner.params[j] -= rate * m_hat / (sqrt(v_hat) + ADAM_EPSILON);
+        }
+
+        if (epoch == 1 || epoch % 10 == 0 || epoch == epochs) {
+            printf("Epoch %d: error %.6f, %llu positions, %.0f positions/s\n", epoch, error,
+                   (unsigned long long)positions, elapsed_ms > 0 ? positions * 1000.0 / elapsed_ms : 0.0);
+        }
+    }
+
+    long long total_ms = engine_now_ms() - start_ms;
+    printf("Throughput: %.0f positions/s over %d threads\n",
+           total_ms > 0 ? total_positions * 1000.0 / total_ms : 0.0, tuner.threads);
+
+    int weights[2][WIN_LENGTH];
+    params_to_weights(weights);
+    if (!engine_save_weights(output, weights)) {
+        perror("Error: Could not write weights");
+        return 1;
+    }
+    printf("Weights written to %s\n", output);
+
+    for (int i = 0; i < tuner.reader_count; i++) {
+        dataset_reader_close(&tuner.readers[i]);
+    }
+    return 0;
+}
\ No newline at end of file
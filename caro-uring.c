@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "caro-uring.h"
+
+static int sys_setup(unsigned int entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned int opcode, void *arg, unsigned int count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// The ring is bound to the calling thread, which must be the only one to
+// submit to it
+int uring_init(Uring *ring, unsigned int entries, unsigned int cq_entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                   IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = cq_entries;
+    ring->fd = sys_setup(entries, &params);
+    if (ring->fd < 0) {
+        perror("io_uring_setup");
+        return 0;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        fprintf(stderr, "Error: Kernel too old for this io_uring backend\n");
+        close(ring->fd);
+        return 0;
+    }
+
+    // With SINGLE_MMAP the submission and completion rings share one mapping
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_map_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_map = mmap(NULL, ring->ring_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    ring->sqe_map_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqe_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->ring_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        perror("mmap");
+        close(ring->fd);
+        return 0;
+    }
+
+    char *base = (char *)ring->ring_map;
+    ring->sq_head = (unsigned int *)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(base + params.sq_off.tail);
+    ring->sq_array = (unsigned int *)(base + params.sq_off.array);
+    ring->sq_mask = *(unsigned int *)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned int *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+    // The index array never changes: slot i always holds SQE i
+    for (unsigned int i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    return 1;
+}
+
+void uring_free(Uring *ring) {
+    if (ring->buf_ring != NULL) {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = ring->buf_group;
+        sys_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(ring->buf_ring, ring->buf_count * sizeof(struct io_uring_buf));
+        free(ring->buffers);
+    }
+    munmap(ring->sqes, ring->sqe_map_size);
+    munmap(ring->ring_map, ring->ring_map_size);
+    close(ring->fd);
+}
+
+// Returns a zeroed SQE. When the ring is full the queued ones are
+// submitted first, so this only fails if the kernel refuses them.
+struct io_uring_sqe *uring_get_sqe(Uring *ring) {
+    unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries) {
+        if (uring_submit_and_wait(ring, 0) < 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    ring->sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// One system call: publishes every SQE filled in since the last call and
+// waits for at least wait_nr completions. Returns the SQEs consumed or -errno.
+int uring_submit_and_wait(Uring *ring, unsigned int wait_nr) {
+    unsigned int to_submit = ring->sq_local_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    __atomic_store_n(&ring->enters, ring->enters + 1, __ATOMIC_RELAXED);
+    int result = sys_enter(ring->fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    return result < 0 ? -errno : result;
+}
+
+struct io_uring_cqe *uring_peek_cqe(Uring *ring) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(Uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// Registers count buffers of size bytes as a provided buffer ring, so
+// receives pick a buffer when data arrives instead of pinning one each
+int uring_setup_buffers(Uring *ring, unsigned int count, unsigned int size, unsigned short group) {
+    struct io_uring_buf_reg reg;
+    size_t ring_size = count * sizeof(struct io_uring_buf);
+
+    ring->buf_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buffers = malloc((size_t)count * size);
+    if (ring->buf_ring == MAP_FAILED || ring->buffers == NULL) {
+        ring->buf_ring = NULL;
+        free(ring->buffers);
+        return 0;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (sys_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring_register");
+        munmap(ring->buf_ring, ring_size);
+        free(ring->buffers);
+        ring->buf_ring = NULL;
+        return 0;
+    }
+    ring->buf_count = count;
+    ring->buf_size = size;
+    ring->buf_group = group;
+    for (unsigned int id = 0; id < count; id++) {
+        uring_recycle_buffer(ring, id);
+    }
+    return 1;
+}
+
+char *uring_buffer(Uring *ring, unsigned int id) {
+    return ring->buffers + (size_t)id * ring->buf_size;
+}
+
+// Hands a buffer back to the kernel once its data has been used
+void uring_recycle_buffer(Uring *ring, unsigned int id) {
+    unsigned short tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (ring->buf_count - 1)];
+    buf->addr = (unsigned long)uring_buffer(ring, id);
+    buf->len = ring->buf_size;
+    buf->bid = (unsigned short)id;
+    __atomic_store_n(&ring->buf_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
\ No newline at end of file
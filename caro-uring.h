@@ -0,0 +1,45 @@
+#ifndef CARO_URING_H
+#define CARO_URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper on the raw system calls, so nothing beyond the
+// kernel headers is needed. One ring belongs to one thread.
+typedef struct {
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_local_tail;   // SQEs filled in but not yet published
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *ring_map;
+    size_t ring_map_size;
+    size_t sqe_map_size;
+
+    // Provided receive buffers, one group per ring
+    struct io_uring_buf_ring *buf_ring;
+    char *buffers;
+    unsigned int buf_count;
+    unsigned int buf_size;
+    unsigned short buf_group;
+    long long enters;             // io_uring_enter calls made, readable from other threads
+} Uring;
+
+int uring_init(Uring *ring, unsigned int entries, unsigned int cq_entries);
+void uring_free(Uring *ring);
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+int uring_submit_and_wait(Uring *ring, unsigned int wait_nr);
+struct io_uring_cqe *uring_peek_cqe(Uring *ring);
+void uring_cqe_seen(Uring *ring);
+int uring_setup_buffers(Uring *ring, unsigned int count, unsigned int size, unsigned short group);
+char *uring_buffer(Uring *ring, unsigned int id);
+void uring_recycle_buffer(Uring *ring, unsigned int id);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "caro-wire.h"
+
+#define TEST_MESSAGES 4096       // messages recorded per stream
+#define TEST_STREAM (1 << 21)
+#define TEST_BUFFER 2048         // a reader's storage, as large as the servers'
+#define TEST_MAX_READ 1200       // longest random read, more than two text boards
+
+// Unit checks for the readers in caro-wire.c. Streams of every kind are
+// cut at random and fed through wire_reader_next, as the epoll servers and
+// the clients read, and through wire_reader_split, as the io_uring reactor
+// does; every message must come back whole and in order. Server text is
+// split by its shapes alone, so every text message a server in this tree
+// sends is listed below. A new message goes into the table too, and the
+// test fails if the reader cannot tell it from the others.
+
+static const char *server_words[] = {
+    "1", "2",                                          // the player number, all servers
+    "WIN", "LOSE", "INVALID_MOVE",                     // all servers
+    "WAIT", "START",                                   // caro-server-1, caro-server-2
+    "TIMEOUT", "OVER 0", "OVER 1", "OVER 2",           // server-caro-epoll
+};
+
+// Boards are "<nickname>|<nickname>|<side>" and "|<cell>" for every cell
+static const char *server_nicknames[][2] = {
+    {"Player 1", "Player 2"},                          // all servers
+    {"Player 1", "Computer"},                          // server-caro-1 --ai
+};
+
+// Client lines, sent with "\n" or "\r\n"
+static const char *client_lines[] = {
+    "7,7", "0,14", "14,0", "RATING 1500", "WATCH", "WATCH 0:17", "WATCH 3:4294967295",
+};
+
+typedef struct {
+    const char *name;
+    int from_server;
+    int binary;                  // frames after the first message, the hello
+    size_t first_len;            // bytes of the first message
+    uint8_t data[TEST_STREAM];
+    size_t len;
+    int count;
+    int type[TEST_MESSAGES];
+    size_t payload[TEST_MESSAGES];   // where the expected payload starts in data
+    size_t payload_len[TEST_MESSAGES];
+} TestStream;
+
+typedef struct {
+    long long messages;
+    long long mismatches;
+    long long out_of_bounds;
+} TestResult;
+
+unsigned int seed = 12345;
+
+int random_below(int n) {
+    return rand_r(&seed) % n;
+}
+
+// Appends one message, with the payload a reader should hand out being
+// the payload_len bytes at payload_at of it
+void stream_add(TestStream *stream, int type, const void *message, size_t len, size_t payload_at, size_t payload_len) {
+    memcpy(stream->data + stream->len, message, len);
+    stream->type[stream->count] = type;
+    stream->payload[stream->count] = stream->len + payload_at;
+    stream->payload_len[stream->count] = payload_len;
+    stream->len += len;
+    stream->first_len = stream->count++ == 0 ? len : stream->first_len;
+}
+
+void stream_add_frame(TestStream *stream, int type, const uint8_t *payload, size_t len) {
+    uint8_t frame[WIRE_MAX_FRAME];
+    stream_add(stream, type, frame, wire_frame(frame, type, payload, len), 2, len);
+}
+
+size_t server_board(char *out) {
+    const char **names = server_nicknames[random_below(sizeof(server_nicknames) / sizeof(server_nicknames[0]))];
+    int len = sprintf(out, "%s|%s|%d", names[0], names[1], 1 + random_below(2));
+    for (int cell = 0; cell < BOARD_CELLS; cell++) {
+        out[len++] = '|';
+        out[len++] = (char)('0' + random_below(3));
+    }
+    return (size_t)len;
+}
+
+void record_server_text(TestStream *stream) {
+    char board[WIRE_TEXT_MAX];
+    int words = sizeof(server_words) / sizeof(server_words[0]);
+    while (stream->count < TEST_MESSAGES && stream->len + WIRE_TEXT_MAX < TEST_STREAM) {
+        int pick = random_below(words + 2);
+        if (pick < words) {
+            size_t len = strlen(server_words[pick]);
+            stream_add(stream, WIRE_TEXT, server_words[pick], len, 0, len);
+        } else {
+            size_t len = server_board(board);
+            stream_add(stream, WIRE_TEXT, board, len, 0, len);
+        }
+    }
+}
+
+void record_server_binary(TestStream *stream) {
+    uint8_t payload[8];
+    uint8_t frame[WIRE_MAX_FRAME];
+    int cells[BOARD_CELLS];
+
+    payload[0] = WIRE_VERSION;
+    stream_add_frame(stream, WIRE_HELLO, payload, 1);
+    while (stream->count < TEST_MESSAGES && stream->len + WIRE_MAX_FRAME < TEST_STREAM) {
+        switch (random_below(6)) {
+            case 0:
+                payload[0] = (uint8_t)('1' + random_below(2));
+                stream_add_frame(stream, WIRE_SEAT, payload, 1);
+                break;
+            case 1:
+                for (int cell = 0; cell < BOARD_CELLS; cell++) {
+                    cells[cell] = random_below(3);
+                }
+                stream_add(stream, WIRE_STATE, frame, wire_encode_state(frame, cells, 1 + random_below(2)), 2,
+                           WIRE_BOARD_BYTES);
+                break;
+            case 2:
+                stream_add(stream, WIRE_DELTA, frame,
+                           wire_encode_delta(frame, random_below(BOARD_CELLS), 1 + random_below(2), random_below(BOARD_CELLS)),
+                           2, WIRE_DELTA_FRAME - 2);
+                break;
+            case 3:
+                payload[0] = (uint8_t)random_below(3);
+                stream_add_frame(stream, WIRE_OVER, payload, 1);
+                break;
+            default: {
+                static const int bare[] = {WIRE_WIN, WIRE_LOSE, WIRE_INVALID, WIRE_TIMEOUT};
+                stream_add_frame(stream, bare[random_below(4)], NULL, 0);
+                break;
+            }
+        }
+    }
+}
+
+void record_client_text(TestStream *stream) {
+    char line[64];
+    int lines = sizeof(client_lines) / sizeof(client_lines[0]);
+    while (stream->count < TEST_MESSAGES && stream->len + sizeof(line) < TEST_STREAM) {
+        const char *text = client_lines[random_below(lines)];
+        size_t len = strlen(text);
+        int crlf = random_below(2);
+        memcpy(line, text, len);
+        memcpy(line + len, crlf ? "\r\n" : "\n", crlf ? 2 : 1);
+        stream_add(stream, WIRE_TEXT, line, len + 1 + crlf, 0, len);
+    }
+}
+
+void record_client_binary(TestStream *stream) {
+    uint8_t hello[WIRE_HELLO_LENGTH];
+    uint8_t payload[8];
+
+    stream_add(stream, WIRE_TEXT, hello, wire_hello(hello, WIRE_VERSION), 0, WIRE_HELLO_LENGTH);
+    while (stream->count < TEST_MESSAGES && stream->len + WIRE_MAX_FRAME < TEST_STREAM) {
+        switch (random_below(4)) {
+            case 0:
+                payload[0] = (uint8_t)random_below(BOARD_CELLS);
+                stream_add_frame(stream, WIRE_MOVE, payload, 1);
+                break;
+            case 1:
+                payload[0] = (uint8_t)random_below(8);
+                payload[1] = (uint8_t)random_below(256);
+                stream_add_frame(stream, WIRE_RATING, payload, 2);
+                break;
+            case 2:
+                stream_add_frame(stream, WIRE_RESYNC, NULL, 0);
+                break;
+            default:
+                for (int b = 0; b < 5; b++) {
+                    payload[b] = (uint8_t)random_below(256);
+                }
+                stream_add_frame(stream, WIRE_WATCH, payload, random_below(2) ? 5 : 0);
+                break;
+        }
+    }
+}
+
+// A reader set up as the receiving side of the stream would be
+void reader_open(const TestStream *stream, WireReader *reader, uint8_t *buffer) {
+    wire_reader_init(reader, buffer, TEST_BUFFER, stream->from_server);
+    if (stream->from_server) {
+        // Clients let the first byte of the answer decide
+        reader->binary = stream->binary ? -1 : 0;
+    }
+}
+
+// Checks one message handed out against the next one expected. A server
+// switches to frames once it has read a client's hello.
+void check_message(const TestStream *stream, WireReader *reader, const WireFrame *frame, int *next,
+                   const uint8_t *low, const uint8_t *high, TestResult *result) {
+    int n = (*next)++;
+    result->messages++;
+    if (frame->payload < low || frame->payload + frame->len > high) {
+        result->out_of_bounds++;
+        return;
+    }
+    if (n >= stream->count || frame->type != stream->type[n] || frame->len != stream->payload_len[n] ||
+        memcmp(frame->payload, stream->data + stream->payload[n], frame->len) != 0) {
+        result->mismatches++;
+    }
+    if (n == 0 && stream->binary && !stream->from_server) {
+        reader->binary = 1;
+    }
+}
+
+// Reads the stream in random pieces of up to max bytes. The first client
+// text line comes in a read of its own, as it does from a client that
+// writes one line at a time: until a line has ended, a read is a message.
+void feed_next(const TestStream *stream, int max, TestResult *result) {
+    uint8_t buffer[TEST_BUFFER];
+    WireReader reader;
+    WireFrame frame;
+    size_t at = 0;
+    int next = 0;
+    int got = 0;
+
+    reader_open(stream, &reader, buffer);
+    while (at < stream->len && got >= 0) {
+        size_t space;
+        uint8_t *to = wire_reader_space(&reader, &space);
+        size_t piece = at == 0 && !stream->from_server ? stream->first_len : 1 + (size_t)random_below(max);
+        piece = piece < space ? piece : space;
+        piece = piece < stream->len - at ? piece : stream->len - at;
+        memcpy(to, stream->data + at, piece);
+        wire_reader_filled(&reader, piece);
+        at += piece;
+        while ((got = wire_reader_next(&reader, &frame)) > 0) {
+            check_message(stream, &reader, &frame, &next, buffer, buffer + TEST_BUFFER, result);
+        }
+    }
+    result->mismatches += next != stream->count || got < 0;
+}
+
+// The io_uring way: whole messages are split where the read put them, and
+// only a piece cut off at the end is copied to the reader
+void feed_split(const TestStream *stream, int max, TestResult *result) {
+    uint8_t buffer[TEST_BUFFER];
+    WireReader reader;
+    WireFrame frame;
+    size_t at = 0;
+    int next = 0;
+    int used = 0;
+
+    reader_open(stream, &reader, buffer);
+    while (at < stream->len && used >= 0) {
+        const uint8_t *data = stream->data + at;
+        size_t len = at == 0 && !stream->from_server ? stream->first_len : 1 + (size_t)random_below(max);
+        len = len < stream->len - at ? len : stream->len - at;
+        at += len;
+        do {
+            if (reader.start == reader.end) {
+                while ((used = wire_reader_split(&reader, data, len, &frame)) > 0) {
+                    check_message(stream, &reader, &frame, &next, data, data + len, result);
+                    data += used;
+                    len -= (size_t)used;
+                }
+            }
+            size_t taken = wire_reader_take(&reader, data, len);
+            data += taken;
+            len -= taken;
+            if (used < 0) {
+                break;
+            }
+            while ((used = wire_reader_next(&reader, &frame)) > 0) {
+                check_message(stream, &reader, &frame, &next, buffer, buffer + TEST_BUFFER, result);
+            }
+        } while (used == 0 && len > 0);
+    }
+    result->mismatches += next != stream->count || used < 0;
+}
+
+// Every pair of server text messages, cut at every point: a message whose
+// shape reads as the start of another is split wrongly here first
+int check_server_pairs(int *cases) {
+    char messages[sizeof(server_words) / sizeof(server_words[0]) + 1][WIRE_TEXT_MAX];
+    int count = sizeof(server_words) / sizeof(server_words[0]);
+    int mismatches = 0;
+
+    for (int m = 0; m < count; m++) {
+        strcpy(messages[m], server_words[m]);
+    }
+    messages[count][server_board(messages[count])] = '\0';
+    *cases = 0;
+    for (int a = 0; a <= count; a++) {
+        for (int b = 0; b <= count; b++) {
+            uint8_t joined[2 * WIRE_TEXT_MAX];
+            size_t first = strlen(messages[a]);
+            size_t total = first + strlen(messages[b]);
+            memcpy(joined, messages[a], first);
+            memcpy(joined + first, messages[b], total - first);
+            for (size_t cut = 1; cut <= total; cut++) {
+                uint8_t buffer[TEST_BUFFER];
+                WireReader reader;
+                WireFrame frame;
+                size_t sizes[2] = {0, 0};
+                int got = 0;
+                int n = 0;
+
+                wire_reader_init(&reader, buffer, sizeof(buffer), 1);
+                wire_reader_append(&reader, joined, cut);
+                while (got >= 0 && n < 2 && (got = wire_reader_next(&reader, &frame)) > 0) {
+                    sizes[n++] = frame.len;
+                }
+                wire_reader_append(&reader, joined + cut, total - cut);
+                while (got >= 0 && n < 2 && (got = wire_reader_next(&reader, &frame)) > 0) {
+                    sizes[n++] = frame.len;
+                }
+                mismatches += got < 0 || n != 2 || sizes[0] != first || sizes[1] != total - first;
+                (*cases)++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+// Random bytes must be rejected or split without a view ever leaving the
+// data; whatever comes out is not compared
+void feed_garbage(const TestStream *stream, TestResult *result) {
+    static uint8_t noise[1 << 16];
+    uint8_t buffer[TEST_BUFFER];
+    WireReader reader;
+    WireFrame frame;
+    size_t at = 0;
+    int got = 0;
+
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        noise[i] = (uint8_t)rand_r(&seed);
+    }
+    reader_open(stream, &reader, buffer);
+    while (at < sizeof(noise) && got >= 0) {
+        size_t space;
+        uint8_t *to = wire_reader_space(&reader, &space);
+        size_t piece = 1 + (size_t)random_below(TEST_MAX_READ);
+        piece = piece < space ? piece : space;
+        piece = piece < sizeof(noise) - at ? piece : sizeof(noise) - at;
+        memcpy(to, noise + at, piece);
+        wire_reader_filled(&reader, piece);
+        at += piece;
+        while ((got = wire_reader_next(&reader, &frame)) > 0) {
+            result->messages++;
+            result->out_of_bounds += frame.payload < buffer || frame.payload + frame.len > buffer + TEST_BUFFER;
+        }
+    }
+}
+
+// ./caro-wire-test [iterations]: exits with 1 if any message came back
+// other than it went in
+int main(int argc, char *argv[]) {
+    static TestStream streams[4] = {
+        {.name = "server text", .from_server = 1, .binary = 0},
+        {.name = "server binary", .from_server = 1, .binary = 1},
+        {.name = "client text", .from_server = 0, .binary = 0},
+        {.name = "client binary", .from_server = 0, .binary = 1},
+    };
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    int failed = 0;
+
+    record_server_text(&streams[0]);
+    record_server_binary(&streams[1]);
+    record_client_text(&streams[2]);
+    record_client_binary(&streams[3]);
+
+    for (int s = 0; s < 4; s++) {
+        TestResult next = {0};
+        TestResult split = {0};
+        TestResult garbage = {0};
+        for (int n = 0; n < iterations; n++) {
+            int max = n % 2 == 0 ? 16 : TEST_MAX_READ;
+            feed_next(&streams[s], max, &next);
+            feed_split(&streams[s], max, &split);
+            feed_garbage(&streams[s], &garbage);
+        }
+        printf("%-13s next: %lld messages, %lld mismatches, %lld out of bounds  split: %lld, %lld, %lld  garbage: %lld out of bounds\n",
+               streams[s].name, next.messages, next.mismatches, next.out_of_bounds, split.messages, split.mismatches,
+               split.out_of_bounds, garbage.out_of_bounds);
+        failed |= next.mismatches + next.out_of_bounds + split.mismatches + split.out_of_bounds + garbage.out_of_bounds > 0;
+    }
+
+    int cases;
+    int pair_mismatches = check_server_pairs(&cases);
+    printf("server text pairs: %d cuts, %d mismatches\n", cases, pair_mismatches);
+    failed |= pair_mismatches > 0;
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
\ No newline at end of file
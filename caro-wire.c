@@ -0,0 +1,366 @@
+#include <string.h>
+#include "caro-wire.h"
+
+// A cell index must fit the one-byte move payload
+_Static_assert(BOARD_CELLS <= 256, "board too large for one-byte moves");
+
+static const uint8_t hello_magic[4] = {'C', 'A', 'R', 'O'};
+
+// Writes the client hello asking for up to the given version,
+// WIRE_HELLO_LENGTH bytes
+size_t wire_hello(uint8_t *out, int version) {
+    memcpy(out, hello_magic, sizeof(hello_magic));
+    out[4] = (uint8_t)version;
+    return WIRE_HELLO_LENGTH;
+}
+
+// Returns the version a hello at the start of data asks for, 0 if the
+// data does not start with a hello
+int wire_read_hello(const uint8_t *data, size_t len) {
+    if (len < WIRE_HELLO_LENGTH || memcmp(data, hello_magic, sizeof(hello_magic)) != 0 || data[4] == 0) {
+        return 0;
+    }
+    return data[4];
+}
+
+int wire_answered_in_text(uint8_t first_byte) {
+    return first_byte >= ' ';
+}
+
+// Writes a whole frame and returns its length
+size_t wire_frame(uint8_t *out, int type, const uint8_t *payload, size_t len) {
+    out[0] = (uint8_t)(len + 1);
+    out[1] = (uint8_t)type;
+    if (len > 0) {
+        memcpy(out + 2, payload, len);
+    }
+    return len + 2;
+}
+
+// Writes a WIRE_STATE frame for a board given as BOARD_CELLS values of 0, 1
+// or 2 and returns its length
+size_t wire_encode_state(uint8_t *out, const int *cells, int current_player) {
+    uint8_t *packed = out + 2;
+    int full = BOARD_CELLS / 4;
+
+    for (int i = 0; i < full; i++) {
+        const int *four = cells + 4 * i;
+        packed[i] = (uint8_t)(four[0] | four[1] << 2 | four[2] << 4 | four[3] << 6);
+    }
+    // The last byte takes the cells left over and the side to move
+    unsigned int bits = 0;
+    int shift = 0;
+    for (int cell = 4 * full; cell < BOARD_CELLS; cell++, shift += 2) {
+        bits |= (unsigned int)cells[cell] << shift;
+    }
+    packed[full] = (uint8_t)(bits | (unsigned int)current_player << shift);
+    out[0] = WIRE_BOARD_BYTES + 1;
+    out[1] = WIRE_STATE;
+    return WIRE_BOARD_BYTES + 2;
+}
+
+// Returns 0 if the frame is not a well-formed board
+int wire_decode_state(const WireFrame *frame, int *cells, int *current_player) {
+    if (frame->type != WIRE_STATE || frame->len != WIRE_BOARD_BYTES) {
+        return 0;
+    }
+    const uint8_t *packed = frame->payload;
+    int full = BOARD_CELLS / 4;
+    int bad = 0;
+
+    for (int i = 0; i < full; i++) {
+        unsigned int bits = packed[i];
+        int *four = cells + 4 * i;
+        bad |= bits & (bits >> 1) & 0x55;   // a 3 in any cell
+        four[0] = bits & 3;
+        four[1] = (bits >> 2) & 3;
+        four[2] = (bits >> 4) & 3;
+        four[3] = bits >> 6;
+    }
+    unsigned int bits = packed[full];
+    bad |= bits & (bits >> 1) & 0x55;
+    for (int cell = 4 * full; cell < BOARD_CELLS; cell++, bits >>= 2) {
+        cells[cell] = bits & 3;
+    }
+    *current_player = bits & 3;
+    return !bad;
+}
+
+// Writes a WIRE_DELTA frame, WIRE_DELTA_FRAME bytes
+size_t wire_encode_delta(uint8_t *out, int cell, int player, int move_number) {
+    out[0] = WIRE_DELTA_FRAME - 1;
+    out[1] = WIRE_DELTA;
+    out[2] = (uint8_t)cell;
+    out[3] = (uint8_t)player;
+    out[4] = (uint8_t)(move_number >> 8);
+    out[5] = (uint8_t)move_number;
+    return WIRE_DELTA_FRAME;
+}
+
+// Returns 0 if the frame is not a well-formed move
+int wire_decode_delta(const WireFrame *frame, int *cell, int *player, int *move_number) {
+    if (frame->type != WIRE_DELTA || frame->len != WIRE_DELTA_FRAME - 2 || frame->payload[0] >= BOARD_CELLS ||
+        frame->payload[1] < 1 || frame->payload[1] > 2) {
+        return 0;
+    }
+    *cell = frame->payload[0];
+    *player = frame->payload[1];
+    *move_number = frame->payload[2] << 8 | frame->payload[3];
+    return 1;
+}
+
+// Points frame at the frame starting at data without copying. Returns the
+// bytes it takes, 0 if it is not all there yet and -1 on garbage.
+int wire_next_frame(const uint8_t *data, size_t len, WireFrame *frame) {
+    if (len == 0) {
+        return 0;
+    }
+    if (data[0] == 0) {
+        return -1;
+    }
+    if (len < (size_t)data[0] + 1) {
+        return 0;
+    }
+    frame->type = data[1];
+    frame->payload = data + 2;
+    frame->len = (size_t)data[0] - 1;
+    return data[0] + 1;
+}
+
+// Reads an optionally negative decimal number. Returns 0 if there is none.
+static int read_number(const uint8_t **p, const uint8_t *end, int *value) {
+    const uint8_t *q = *p;
+    int negative = q < end && *q == '-';
+    long long number = 0;
+
+    q += negative;
+    if (q == end || *q < '0' || *q > '9') {
+        return 0;
+    }
+    while (q < end && *q >= '0' && *q <= '9') {
+        if (number < 1000000000) {
+            number = number * 10 + (*q - '0');
+        }
+        q++;
+    }
+    *value = (int)(negative ? -number : number);
+    *p = q;
+    return 1;
+}
+
+int wire_text_is(const WireFrame *frame, const char *word) {
+    size_t len = strlen(word);
+    return frame->type == WIRE_TEXT && frame->len == len && memcmp(frame->payload, word, len) == 0;
+}
+
+// "row,col" as clients send it
+int wire_text_move(const WireFrame *frame, int *row, int *col) {
+    const uint8_t *p = frame->payload;
+    const uint8_t *end = p + frame->len;
+    if (!read_number(&p, end, row) || p == end || *p++ != ',') {
+        return 0;
+    }
+    return read_number(&p, end, col) && p == end;
+}
+
+int wire_text_rating(const WireFrame *frame, int *rating) {
+    const uint8_t *p = frame->payload + 7;
+    if (frame->len < 8 || memcmp(frame->payload, "RATING ", 7) != 0) {
+        return 0;
+    }
+    return read_number(&p, frame->payload + frame->len, rating);
+}
+
+// The room a WIRE_WATCH frame asks for; *shard is -1 for the featured game
+int wire_decode_watch(const WireFrame *frame, int *shard, uint32_t *room) {
+    const uint8_t *p = frame->payload;
+    if (frame->type != WIRE_WATCH || (frame->len != 0 && frame->len != 5)) {
+        return 0;
+    }
+    *shard = frame->len == 0 ? -1 : p[0];
+    *room = frame->len == 0 ? 0 : (uint32_t)p[1] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 8 | p[4];
+    return 1;
+}
+
+// "WATCH" for the featured game or "WATCH shard:room"
+int wire_text_watch(const WireFrame *frame, int *shard, uint32_t *room) {
+    const uint8_t *p = frame->payload + 6;
+    const uint8_t *end = frame->payload + frame->len;
+    uint32_t id = 0;
+
+    if (frame->type != WIRE_TEXT || frame->len < 5 || memcmp(frame->payload, "WATCH", 5) != 0) {
+        return 0;
+    }
+    if (frame->len == 5) {
+        *shard = -1;
+        *room = 0;
+        return 1;
+    }
+    if (frame->payload[5] != ' ' || !read_number(&p, end, shard) || *shard < 0 || p == end || *p++ != ':' ||
+        p == end) {
+        return 0;
+    }
+    // Ids use all 32 bits, more than read_number takes
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        id = id * 10 + (uint32_t)(*p - '0');
+    }
+    *room = id;
+    return p == end;
+}
+
+// Text from the server: the player number, a few fixed words, or a board
+// of nicknames, side to move and one digit a cell, all split by '|'. Only
+// the first bytes tell them apart, so a board whose first nickname starts
+// with a digit or one of the words is misread. Returns the length of the
+// message at data, 0 if it is incomplete and -1 on garbage.
+static int server_text_length(const uint8_t *data, size_t len) {
+    static const char *words[] = {"WIN", "LOSE", "INVALID_MOVE", "TIMEOUT", "WAIT", "START", "OVER 0", "OVER 1", "OVER 2"};
+    int prefix = 0;
+
+    if (data[0] == '1' || data[0] == '2') {
+        return 1;
+    }
+    for (size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++) {
+        size_t word_len = strlen(words[w]);
+        if (len >= word_len && memcmp(data, words[w], word_len) == 0) {
+            return (int)word_len;
+        }
+        prefix |= len < word_len && memcmp(data, words[w], len) == 0;
+    }
+    if (prefix) {
+        return 0;
+    }
+
+    int bars = 0;
+    size_t limit = len < WIRE_TEXT_MAX ? len : WIRE_TEXT_MAX;
+    for (size_t i = 0; i < limit; i++) {
+        if (data[i] == '|' && ++bars == 2 + BOARD_CELLS) {
+            return i + 1 < len ? (int)(i + 2) : 0;
+        }
+    }
+    return len < WIRE_TEXT_MAX ? 0 : -1;
+}
+
+// Text from a client: the hello, or a line ending in '\n' or "\r\n".
+// The old clients end nothing and send one message a write, so until a
+// connection ends a line, whatever has arrived is one message, as each
+// read was before. Sets *message to the length without the line end and
+// returns the bytes used, 0 if incomplete and -1 if a line cannot fit.
+static int client_text_length(WireReader *reader, const uint8_t *data, size_t len, size_t *message) {
+    size_t limit = len < WIRE_TEXT_MAX ? len : WIRE_TEXT_MAX;
+    const uint8_t *newline = memchr(data, '\n', limit);
+
+    if (!reader->lines && memcmp(data, "CARO", len < 4 ? len : 4) == 0) {
+        *message = WIRE_HELLO_LENGTH;
+        return len >= WIRE_HELLO_LENGTH ? WIRE_HELLO_LENGTH : 0;
+    }
+    if (newline != NULL) {
+        reader->lines = 1;
+        *message = (size_t)(newline - data);
+        *message -= *message > 0 && data[*message - 1] == '\r';
+        return (int)(newline - data) + 1;
+    }
+    if (reader->lines) {
+        return len < WIRE_TEXT_MAX ? 0 : -1;
+    }
+    *message = limit;
+    return (int)limit;
+}
+
+void wire_reader_init(WireReader *reader, uint8_t *data, size_t capacity, int from_server) {
+    reader->data = data;
+    reader->capacity = capacity;
+    reader->start = 0;
+    reader->end = 0;
+    reader->binary = 0;
+    reader->from_server = from_server;
+    reader->lines = 0;
+}
+
+// Where the next read should go and how much fits. The views handed out
+// so far stay valid until this is called again.
+uint8_t *wire_reader_space(WireReader *reader, size_t *len) {
+    if (reader->start == reader->end) {
+        reader->start = 0;
+        reader->end = 0;
+    } else if (reader->start > 0 && reader->capacity - reader->end < reader->capacity / 2) {
+        memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    *len = reader->capacity - reader->end;
+    return reader->data + reader->end;
+}
+
+void wire_reader_filled(WireReader *reader, size_t len) {
+    reader->end += len;
+}
+
+// Copies data in behind what is there, for bytes that arrived somewhere
+// else. Returns 0 if they do not fit.
+int wire_reader_append(WireReader *reader, const uint8_t *data, size_t len) {
+    size_t space;
+    uint8_t *to = wire_reader_space(reader, &space);
+    if (len > space) {
+        return 0;
+    }
+    memcpy(to, data, len);
+    reader->end += len;
+    return 1;
+}
+
+// Copies in as much of data as fits behind what is there, moving that to
+// the front first if it makes room. Returns the bytes taken.
+size_t wire_reader_take(WireReader *reader, const uint8_t *data, size_t len) {
+    size_t space;
+    uint8_t *to = wire_reader_space(reader, &space);
+    if (space < len && reader->start > 0) {
+        memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        to = reader->data + reader->end;
+        space = reader->capacity - reader->end;
+    }
+    len = len < space ? len : space;
+    memcpy(to, data, len);
+    reader->end += len;
+    return len;
+}
+
+// Splits the message at the start of data the way this reader would.
+// Returns its length, 0 if it is incomplete and -1 on garbage.
+int wire_reader_split(WireReader *reader, const uint8_t *data, size_t len, WireFrame *frame) {
+    if (len == 0) {
+        return 0;
+    }
+    if (reader->binary < 0) {
+        reader->binary = !wire_answered_in_text(data[0]);
+    }
+    if (reader->binary) {
+        return wire_next_frame(data, len, frame);
+    }
+    size_t message = 0;
+    int used = reader->from_server ? server_text_length(data, len) : client_text_length(reader, data, len, &message);
+    if (used > 0) {
+        frame->type = WIRE_TEXT;
+        frame->payload = data;
+        frame->len = reader->from_server ? (size_t)used : message;
+    }
+    return used;
+}
+
+// Hands out the next complete message. Returns 1 if there was one, 0 if
+// more must be read first and -1 on garbage, after which the connection
+// cannot be trusted. A message that can never fit counts as garbage.
+int wire_reader_next(WireReader *reader, WireFrame *frame) {
+    size_t len = reader->end - reader->start;
+    int used = wire_reader_split(reader, reader->data + reader->start, len, frame);
+    if (used > 0) {
+        reader->start += (size_t)used;
+        return 1;
+    }
+    if (used == 0 && reader->start == 0 && reader->end == reader->capacity) {
+        return -1;
+    }
+    return used;
+}
\ No newline at end of file
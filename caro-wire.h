@@ -0,0 +1,103 @@
+#ifndef CARO_WIRE_H
+#define CARO_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef BOARD_SIZE
+#define BOARD_SIZE 15
+#endif
+
+#ifndef BOARD_CELLS
+#define BOARD_CELLS (BOARD_SIZE * BOARD_SIZE)
+#endif
+
+// Binary protocol. A client asks for it by sending the hello, "CARO" and
+// the version, as its very first message. A server that speaks it answers
+// with a WIRE_HELLO frame before anything else. Text messages are printable
+// and a frame starts with its length byte, so the first byte of the answer
+// tells the client which protocol it got. The older servers read every
+// message as a move, so clients send the hello only when asked to.
+//
+// After the hello every message is a frame: one byte giving the length of
+// the rest, one type byte, then the payload. A move is two bytes after the
+// length, and a board is 2 bits a cell with the side to move in the spare
+// bits at the end.
+//
+// From version 2 on, the server sends the whole board only when a player
+// is seated or asks with WIRE_RESYNC. Every move after that is a WIRE_DELTA
+// carrying its number, so a client that finds a gap asks for the board.
+//
+// A spectator sends WIRE_WATCH instead of playing, with no payload for the
+// server's featured game or a shard and room id for a given one. It gets
+// the board, the moves as a player of its version would, and WIRE_OVER
+// with the winner when the game ends, 0 if there was nothing to watch.
+#define WIRE_VERSION 2
+#define WIRE_DELTA_VERSION 2
+#define WIRE_HELLO_LENGTH 5
+#define WIRE_BOARD_BYTES ((2 * BOARD_CELLS + 2 + 7) / 8)
+#define WIRE_MAX_FRAME (2 + WIRE_BOARD_BYTES)
+#define WIRE_DELTA_FRAME 6
+#define WIRE_TEXT_MAX 1024   // longest text message, a board with long nicknames
+
+#define WIRE_HELLO 1        // server: version it will speak
+#define WIRE_SEAT 2         // server: player number
+#define WIRE_STATE 3        // server: packed board and side to move
+#define WIRE_MOVE 4         // client: cell, row * BOARD_SIZE + col
+#define WIRE_RATING 5       // client: matchmaking rating, two bytes big-endian
+#define WIRE_WIN 6
+#define WIRE_LOSE 7
+#define WIRE_INVALID 8      // the last move was refused
+#define WIRE_TIMEOUT 9      // nobody was found to play against
+#define WIRE_DELTA 10       // server: cell, player, move number two bytes big-endian
+#define WIRE_RESYNC 11      // client: send me the whole board
+#define WIRE_WATCH 12       // client: nothing, or shard and room id four bytes big-endian
+#define WIRE_OVER 13        // server, to spectators: winner
+#define WIRE_TEXT 0         // a text message handed out by a reader
+
+typedef struct {
+    int type;
+    const uint8_t *payload;   // points into the caller's buffer
+    size_t len;
+} WireFrame;
+
+// Receive buffer for one connection. Reads go in at the end and messages
+// are handed out as views into the buffer, so nothing is copied out. A
+// message split across reads stays where it is until the rest arrives;
+// only when the space behind it runs low is it moved to the front, so
+// every message is contiguous. Text has no lengths: the server's text is
+// split by its shapes and a client's at the end of each line.
+typedef struct {
+    uint8_t *data;            // the caller's storage
+    size_t capacity;
+    size_t start;             // first byte not handed out yet
+    size_t end;               // end of the bytes received
+    int binary;               // 1 frames, 0 text, -1 the first byte decides
+    int from_server;          // text shapes expected: the server's or the clients'
+    int lines;                // the client has ended a text message with '\n'
+} WireReader;
+
+size_t wire_hello(uint8_t *out, int version);
+int wire_read_hello(const uint8_t *data, size_t len);
+int wire_answered_in_text(uint8_t first_byte);
+size_t wire_frame(uint8_t *out, int type, const uint8_t *payload, size_t len);
+size_t wire_encode_state(uint8_t *out, const int *cells, int current_player);
+int wire_decode_state(const WireFrame *frame, int *cells, int *current_player);
+size_t wire_encode_delta(uint8_t *out, int cell, int player, int move_number);
+int wire_decode_delta(const WireFrame *frame, int *cell, int *player, int *move_number);
+int wire_next_frame(const uint8_t *data, size_t len, WireFrame *frame);
+int wire_text_is(const WireFrame *frame, const char *word);
+int wire_text_move(const WireFrame *frame, int *row, int *col);
+int wire_text_rating(const WireFrame *frame, int *rating);
+int wire_decode_watch(const WireFrame *frame, int *shard, uint32_t *room);
+int wire_text_watch(const WireFrame *frame, int *shard, uint32_t *room);
+
+void wire_reader_init(WireReader *reader, uint8_t *data, size_t capacity, int from_server);
+uint8_t *wire_reader_space(WireReader *reader, size_t *len);
+void wire_reader_filled(WireReader *reader, size_t len);
+int wire_reader_append(WireReader *reader, const uint8_t *data, size_t len);
+size_t wire_reader_take(WireReader *reader, const uint8_t *data, size_t len);
+int wire_reader_split(WireReader *reader, const uint8_t *data, size_t len, WireFrame *frame);
+int wire_reader_next(WireReader *reader, WireFrame *frame);
+
+#endif
\ No newline at end of file
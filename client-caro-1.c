@@ -10,6 +10,32 @@
 #define BOARD_SIZE 15
 #define SERVER_IP "127.0.0.1"
 #define SERVER_PORT 8888
+#define ANALYSIS_TT_MB 32
+
+#include "caro-engine.h"
+#include "caro-wire.h"
+
+// Background analysis of the current position. The search runs on its own
+// thread and hands each finished depth to the GTK main loop via g_idle_add.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int enabled;
+    int quit;
+    int board[BOARD_SIZE][BOARD_SIZE];
+    int side;
+    unsigned int generation;          // bumped on every board update
+    unsigned int searched_generation; // last generation picked up by the worker
+    atomic_int stop;
+    SearchInfo pending;
+    unsigned int pending_generation;
+    int idle_scheduled;
+    SearchInfo shown;
+    unsigned int shown_generation;
+    uint8_t threats[2][BOARD_CELLS];  // engine_threat for each player and cell
+    TransTable tt;
+} Analysis;
 
 typedef struct {
     int board[BOARD_SIZE][BOARD_SIZE];
@@ -18,10 +44,20 @@ typedef struct {
     char player_nickname[50];
     char opponent_nickname[50];
     int socket;
+    int binary;               // the server answered our hello, so frames both ways
+    int move_number;          // moves on our board, deltas must follow on from it
+    WireReader in;            // only the receiving thread reads, main before it starts
+    uint8_t in_buffer[2 * WIRE_TEXT_MAX];
     GtkWidget *drawing_area;
     pthread_mutex_t lock;
+    Analysis analysis;
 } GameState;
 
+typedef struct {
+    GameState *game_state;
+    unsigned int generation;
+} AnalysisJob;
+
 void initialize_board(int board[BOARD_SIZE][BOARD_SIZE]) {
     for (int i = 0; i < BOARD_SIZE; i++) {
         for (int j = 0; j < BOARD_SIZE; j++) {
@@ -71,9 +107,177 @@ gboolean on_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
         }
     }
 
+    // Draw the newest analysis result, if it still matches the board
+    Analysis *analysis = &game_state->analysis;
+    pthread_mutex_lock(&analysis->lock);
+    if (analysis->enabled && analysis->shown_generation == analysis->generation && analysis->shown.depth > 0) {
+        SearchInfo hint = analysis->shown;
+        char text[64];
+
+        cairo_set_source_rgb(cr, 0, 0.6, 0);
+        cairo_set_line_width(cr, 2);
+        cairo_arc(cr, (hint.col + 0.5) * width / BOARD_SIZE, (hint.row + 0.5) * height / BOARD_SIZE, 10, 0, 2 * G_PI);
+        cairo_stroke(cr);
+
+        sprintf(text, "depth %d  best %d,%d  score %d", hint.depth, hint.row, hint.col, hint.score);
+        cairo_move_to(cr, 4, 12);
+        cairo_show_text(cr, text);
+    }
+    if (analysis->enabled) {
+        // Mark cells where a player would make a four or better (filled) or
+        // a three (outlined), in that player's stone colour
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            for (int p = 0; p < 2; p++) {
+                int threat = analysis->threats[p][cell];
+                if (threat == THREAT_NONE) {
+                    continue;
+                }
+                double x = (cell % BOARD_SIZE + 0.5) * width / BOARD_SIZE + (p == 0 ? -6 : 2);
+                double y = (cell / BOARD_SIZE + 0.5) * height / BOARD_SIZE - 2;
+                if (p + 1 == game_state->player_num) {
+                    cairo_set_source_rgb(cr, 1, 0, 0);
+                } else {
+                    cairo_set_source_rgb(cr, 0, 0, 1);
+                }
+                cairo_set_line_width(cr, 1);
+                cairo_rectangle(cr, x, y, 4, 4);
+                if (threat >= THREAT_FOUR) {
+                    cairo_fill(cr);
+                } else {
+                    cairo_stroke(cr);
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&analysis->lock);
+
     return FALSE;
 }
 
+// Runs on the GTK main loop; publishes the latest result and repaints.
+gboolean analysis_idle(gpointer data) {
+    GameState *game_state = (GameState *)data;
+    Analysis *analysis = &game_state->analysis;
+    int changed = 0;
+
+    pthread_mutex_lock(&analysis->lock);
+    analysis->idle_scheduled = 0;
+    if (analysis->pending_generation == analysis->generation) {
+        analysis->shown = analysis->pending;
+        analysis->shown_generation = analysis->pending_generation;
+        changed = 1;
+    }
+    pthread_mutex_unlock(&analysis->lock);
+
+    if (changed) {
+        gtk_widget_queue_draw(game_state->drawing_area);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void analysis_progress(const SearchInfo *info, void *user_data) {
+    AnalysisJob *job = (AnalysisJob *)user_data;
+    Analysis *analysis = &job->game_state->analysis;
+
+    pthread_mutex_lock(&analysis->lock);
+    if (job->generation == analysis->generation) {
+        analysis->pending = *info;
+        analysis->pending_generation = job->generation;
+        // Only one idle callback is queued at a time; it picks up whatever is newest
+        if (!analysis->idle_scheduled) {
+            analysis->idle_scheduled = 1;
+            g_idle_add(analysis_idle, job->game_state);
+        }
+    }
+    pthread_mutex_unlock(&analysis->lock);
+}
+
+void *analysis_worker(void *arg) {
+    GameState *game_state = (GameState *)arg;
+    Analysis *analysis = &game_state->analysis;
+    Engine engine;
+    SearchLimits limits = {0};
+    limits.stop = &analysis->stop;
+
+    while (1) {
+        pthread_mutex_lock(&analysis->lock);
+        while (!analysis->quit && analysis->searched_generation == analysis->generation) {
+            pthread_cond_wait(&analysis->cond, &analysis->lock);
+        }
+        if (analysis->quit) {
+            pthread_mutex_unlock(&analysis->lock);
+            break;
+        }
+        AnalysisJob job = {game_state, analysis->generation};
+        analysis->searched_generation = analysis->generation;
+        atomic_store(&analysis->stop, 0);
+        engine_setup(&engine, analysis->board, analysis->side);
+        pthread_mutex_unlock(&analysis->lock);
+
+        engine_search(&engine, &analysis->tt, &limits, analysis_progress, &job, NULL);
+    }
+
+    return NULL;
+}
+
+// Cancels the running search and, if analysis is on, queues the given board.
+// Safe to call from any thread.
+void analysis_request(GameState *game_state) {
+    Analysis *analysis = &game_state->analysis;
+
+    pthread_mutex_lock(&analysis->lock);
+    analysis->generation++;
+    atomic_store(&analysis->stop, 1);
+    if (analysis->enabled) {
+        Engine engine;
+        memcpy(analysis->board, game_state->board, sizeof(analysis->board));
+        analysis->side = game_state->current_player;
+        engine_setup(&engine, analysis->board, analysis->side);
+        for (int cell = 0; cell < BOARD_CELLS; cell++) {
+            analysis->threats[0][cell] = engine_threat(&engine, cell, 1);
+            analysis->threats[1][cell] = engine_threat(&engine, cell, 2);
+        }
+        pthread_cond_signal(&analysis->cond);
+    } else {
+        analysis->searched_generation = analysis->generation;
+    }
+    pthread_mutex_unlock(&analysis->lock);
+}
+
+void analysis_start(GameState *game_state) {
+    Analysis *analysis = &game_state->analysis;
+
+    pthread_mutex_init(&analysis->lock, NULL);
+    pthread_cond_init(&analysis->cond, NULL);
+    analysis->enabled = 0;
+    analysis->quit = 0;
+    analysis->generation = 0;
+    analysis->searched_generation = 0;
+    analysis->pending_generation = 0;
+    analysis->shown_generation = 0;
+    analysis->idle_scheduled = 0;
+    atomic_init(&analysis->stop, 0);
+    if (!tt_init(&analysis->tt, ANALYSIS_TT_MB)) {
+        fprintf(stderr, "Error: Not enough memory for analysis\n");
+    }
+    pthread_create(&analysis->thread, NULL, analysis_worker, (void *)game_state);
+}
+
+void analysis_stop(GameState *game_state) {
+    Analysis *analysis = &game_state->analysis;
+
+    pthread_mutex_lock(&analysis->lock);
+    analysis->quit = 1;
+    atomic_store(&analysis->stop, 1);
+    pthread_cond_signal(&analysis->cond);
+    pthread_mutex_unlock(&analysis->lock);
+
+    pthread_join(analysis->thread, NULL);
+    tt_free(&analysis->tt);
+    pthread_cond_destroy(&analysis->cond);
+    pthread_mutex_destroy(&analysis->lock);
+}
+
 gboolean on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data) {
     GameState *game_state = (GameState *)data;
 
@@ -90,64 +294,191 @@ gboolean on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data
         pthread_mutex_lock(&game_state->lock);
         if (game_state->board[row][col] == 0 && game_state->player_num == game_state->current_player) {
             char buffer[50];
-            sprintf(buffer, "%d,%d", row, col);
-            send(game_state->socket, buffer, strlen(buffer), 0);
+            if (game_state->binary) {
+                uint8_t cell = (uint8_t)(row * BOARD_SIZE + col);
+                send(game_state->socket, buffer, wire_frame((uint8_t *)buffer, WIRE_MOVE, &cell, 1), 0);
+            } else {
+                sprintf(buffer, "%d,%d\n", row, col);
+                send(game_state->socket, buffer, strlen(buffer), 0);
+            }
         }
         pthread_mutex_unlock(&game_state->lock);
+    } else if (event->button == GDK_BUTTON_SECONDARY) {
+        // Right click toggles the analysis hint
+        pthread_mutex_lock(&game_state->analysis.lock);
+        game_state->analysis.enabled = !game_state->analysis.enabled;
+        pthread_mutex_unlock(&game_state->analysis.lock);
+
+        pthread_mutex_lock(&game_state->lock);
+        analysis_request(game_state);
+        pthread_mutex_unlock(&game_state->lock);
+        gtk_widget_queue_draw(widget);
     }
 
     return TRUE;
 }
 
-void update_game_state(GameState *game_state, char *buffer) {
-    char *token;
-    token = strtok(buffer, "|");
-    strcpy(game_state->player_nickname, token);
-    token = strtok(NULL, "|");
-    strcpy(game_state->opponent_nickname, token);
-    token = strtok(NULL, "|");
-    game_state->current_player = atoi(token);
+// A text board, read where it lies: both nicknames, the side to move and
+// one digit a cell, all split by '|'
+void update_game_state(GameState *game_state, const WireFrame *message) {
+    const char *p = (const char *)message->payload;
+    const char *end = p + message->len;
+    char *nicknames[2] = {game_state->player_nickname, game_state->opponent_nickname};
+
+    for (int n = 0; n < 2; n++) {
+        const char *bar = memchr(p, '|', (size_t)(end - p));
+        if (bar == NULL) {
+            fprintf(stderr, "Error: Unexpected end of game state data\n");
+            return;
+        }
+        size_t len = (size_t)(bar - p);
+        if (len >= sizeof(game_state->player_nickname)) {
+            len = sizeof(game_state->player_nickname) - 1;
+        }
+        memcpy(nicknames[n], p, len);
+        nicknames[n][len] = '\0';
+        p = bar + 1;
+    }
+    if (p == end) {
+        fprintf(stderr, "Error: Unexpected end of game state data\n");
+        return;
+    }
+    game_state->current_player = *p++ - '0';
     for (int i = 0; i < BOARD_SIZE; i++) {
         for (int j = 0; j < BOARD_SIZE; j++) {
-            token = strtok(NULL, "|");
-            if (token == NULL) {
+            if (end - p < 2 || p[0] != '|') {
                 fprintf(stderr, "Error: Unexpected end of game state data\n");
                 return;
             }
-            game_state->board[i][j] = atoi(token);
+            game_state->board[i][j] = p[1] - '0';
+            p += 2;
         }
     }
 
+    analysis_request(game_state);
     gtk_widget_queue_draw(game_state->drawing_area);
 }
 
-void *receive_messages(void *arg) {
-    GameState *game_state = (GameState *)arg;
-    char buffer[1024];
-
-    while (1) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_received = recv(game_state->socket, buffer, sizeof(buffer), 0);
-        if (bytes_received <= 0) {
-            break;
-        }
+int handle_text(GameState *game_state, const WireFrame *message) {
+    printf("Received data: %.*s\n", (int)message->len, (const char *)message->payload);
+
+    if (message->len == 1) {
+        game_state->player_num = message->payload[0] - '0';
+    } else if (wire_text_is(message, "INVALID_MOVE")) {
+        printf("Invalid move. Please try again.\n");
+    } else if (wire_text_is(message, "WIN")) {
+        printf("Congratulations! You won the game.\n");
+        return 0;
+    } else if (wire_text_is(message, "LOSE")) {
+        printf("Sorry, you lost the game.\n");
+        return 0;
+    } else if (wire_text_is(message, "TIMEOUT")) {
+        printf("Nobody was found to play against.\n");
+        return 0;
+    } else if (!wire_text_is(message, "WAIT") && !wire_text_is(message, "START")) {
+        pthread_mutex_lock(&game_state->lock);
+        update_game_state(game_state, message);
+        pthread_mutex_unlock(&game_state->lock);
+    }
+    return 1;
+}
 
-        printf("Received data: %s\n", buffer);
+// One message from the reader, a frame or text as the server first
+// answered. Returns 0 once the game is over.
+int handle_message(GameState *game_state, const WireFrame *message) {
+    int cell, player, move_number;
 
-        if (strcmp(buffer, "INVALID_MOVE") == 0) {
-            printf("Invalid move. Please try again.\n");
-        } else if (strcmp(buffer, "WIN") == 0) {
-            printf("Congratulations! You won the game.\n");
+    switch (message->type) {
+        case WIRE_TEXT:
+            return handle_text(game_state, message);
+        case WIRE_HELLO:
+            game_state->binary = 1;
             break;
-        } else if (strcmp(buffer, "LOSE") == 0) {
-            printf("Sorry, you lost the game.\n");
+        case WIRE_SEAT:
+            game_state->player_num = message->len == 1 ? message->payload[0] : 0;
             break;
-        } else {
+        case WIRE_STATE:
             pthread_mutex_lock(&game_state->lock);
-            update_game_state(game_state, buffer);
+            if (wire_decode_state(message, &game_state->board[0][0], &game_state->current_player)) {
+                // Every move adds a stone, so the board says how many were played
+                game_state->move_number = 0;
+                for (int i = 0; i < BOARD_SIZE; i++) {
+                    for (int j = 0; j < BOARD_SIZE; j++) {
+                        game_state->move_number += game_state->board[i][j] != 0;
+                    }
+                }
+                analysis_request(game_state);
+                gtk_widget_queue_draw(game_state->drawing_area);
+            } else {
+                fprintf(stderr, "Error: Bad game state frame\n");
+            }
             pthread_mutex_unlock(&game_state->lock);
+            break;
+        case WIRE_DELTA:
+            if (!wire_decode_delta(message, &cell, &player, &move_number)) {
+                fprintf(stderr, "Error: Bad move frame\n");
+                break;
+            }
+            pthread_mutex_lock(&game_state->lock);
+            if (move_number == game_state->move_number + 1) {
+                game_state->board[cell / BOARD_SIZE][cell % BOARD_SIZE] = player;
+                game_state->current_player = 3 - player;
+                game_state->move_number = move_number;
+                analysis_request(game_state);
+                gtk_widget_queue_draw(game_state->drawing_area);
+            } else {
+                // We missed a move; the whole board comes back
+                uint8_t request[2];
+                send(game_state->socket, request, wire_frame(request, WIRE_RESYNC, NULL, 0), 0);
+            }
+            pthread_mutex_unlock(&game_state->lock);
+            break;
+        case WIRE_INVALID:
+            printf("Invalid move. Please try again.\n");
+            break;
+        case WIRE_WIN:
+            printf("Congratulations! You won the game.\n");
+            return 0;
+        case WIRE_LOSE:
+            printf("Sorry, you lost the game.\n");
+            return 0;
+        case WIRE_TIMEOUT:
+            printf("Nobody was found to play against.\n");
+            return 0;
+    }
+    return 1;
+}
+
+// Reads once and handles every message that is now complete; the server
+// may send several in one go or one over several reads. Returns 0 once the
+// connection or the game is over.
+int read_messages(GameState *game_state) {
+    WireFrame message;
+    size_t space;
+    int got;
+
+    uint8_t *to = wire_reader_space(&game_state->in, &space);
+    int bytes_received = recv(game_state->socket, to, space, 0);
+    if (bytes_received <= 0) {
+        return 0;
+    }
+    wire_reader_filled(&game_state->in, (size_t)bytes_received);
+    while ((got = wire_reader_next(&game_state->in, &message)) > 0) {
+        if (!handle_message(game_state, &message)) {
+            return 0;
         }
     }
+    if (got < 0) {
+        fprintf(stderr, "Error: Garbled data from the server\n");
+    }
+    return got == 0;
+}
+
+void *receive_messages(void *arg) {
+    GameState *game_state = (GameState *)arg;
+
+    while (read_messages(game_state)) {
+    }
 
     gtk_main_quit();
     pthread_exit(NULL);
@@ -157,8 +488,12 @@ int main(int argc, char *argv[]) {
     GameState game_state;
     initialize_board(game_state.board);
     pthread_mutex_init(&game_state.lock, NULL);
+    game_state.current_player = 1;
+    analysis_start(&game_state);
 
     gtk_init(&argc, &argv);
+    // -b asks for the binary protocol; the older servers only speak text
+    int ask_binary = argc > 1 && strcmp(argv[1], "-b") == 0;
 
     // Create the main window
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -183,10 +518,21 @@ int main(int argc, char *argv[]) {
     server_address.sin_addr.s_addr = inet_addr(SERVER_IP);
     connect(game_state.socket, (struct sockaddr *)&server_address, sizeof(server_address));
 
+    // With -b, ask for the binary protocol. The reactor server answers with
+    // a hello frame; the other servers answer in text.
+    uint8_t hello[WIRE_HELLO_LENGTH];
+    game_state.binary = 0;
+    game_state.player_num = 0;
+    game_state.move_number = 0;
+    wire_reader_init(&game_state.in, game_state.in_buffer, sizeof(game_state.in_buffer), 1);
+    if (ask_binary) {
+        game_state.in.binary = -1;
+        send(game_state.socket, hello, wire_hello(hello, WIRE_VERSION), 0);
+    }
+
     // Receive player number
-    char buffer[50];
-    recv(game_state.socket, buffer, sizeof(buffer), 0);
-    game_state.player_num = atoi(buffer);
+    while (game_state.player_num == 0 && read_messages(&game_state)) {
+    }
 
     if (game_state.player_num == 1) {
         printf("Waiting for the second player to connect...\n");
@@ -200,6 +546,7 @@ int main(int argc, char *argv[]) {
     gtk_main();
 
     // Clean up
+    analysis_stop(&game_state);
     close(game_state.socket);
     pthread_mutex_destroy(&game_state.lock);
 
@@ -1,16 +1,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <unistd.h>
 
-#define MAX_CLIENTS 2
+#define LISTEN_BACKLOG 128
 #define SERVER_IP "127.0.0.1"
 #define SERVER_PORT 8888
 #define BOARD_SIZE 15
+#define AI_CLOCK_MS 300000
+#define AI_TT_MB 64
+#define ADJUDICATE_DEPTH 10
+#define ADJUDICATE_BUDGET_US 300
+#define POLL_EVENTS 256
+#define READ_BUFFER 1024
+#define STATE_BUFFER 2048
+#define OUTBOX_PARTS 4
+#define SEAT_BACKLOG (1 << 20)   // unsent bytes a player may fall behind before being dropped
+#define POLL_BACKOFF_US 100      // the poller's wait while the pool is full
+
+#include "caro-ai-pool.h"
+#include "caro-rules.h"
+#include "caro-rooms.h"
+#include "caro-task-pool.h"
+#include "caro-wire.h"
 
 typedef struct {
     int board[BOARD_SIZE][BOARD_SIZE];
@@ -20,8 +42,55 @@ typedef struct {
     int player1_socket;
     int player2_socket;
     pthread_mutex_t lock;
+    int ai_player;           // 2 when the computer plays the second seat, 0 otherwise
+    long long ai_clock_ms;   // computer's remaining thinking time for the game
+    int seated;              // players still connected to the room
+    struct Seat *seats[2];   // where each player's output goes, NULL once they left
 } GameState;
 
+// What an epoll event is about: a seat's reads or its writes
+typedef struct {
+    struct Seat *seat;
+    void (*task)(void *arg);
+} PollEntry;
+
+// A connected player: its room, its own socket, what it sent that has
+// not made a whole message yet and what it has not been sent yet. The
+// socket is non-blocking; output the kernel cannot take waits here for
+// EPOLLOUT on a dup of the socket, so the one-shot read registration is
+// never re-armed by anyone but the read task.
+typedef struct Seat {
+    GameState *game_state;
+    int client_socket;
+    int write_socket;         // the dup armed for EPOLLOUT, -1 until needed
+    int refs;                 // the room's, an armed writer's and each sender's
+    PollEntry reading;
+    PollEntry writing;
+    pthread_mutex_t out_lock; // the four fields below and every send on the socket
+    char *out;
+    size_t out_len;
+    size_t out_size;
+    int write_armed;
+    WireReader in;
+    uint8_t in_buffer[READ_BUFFER];
+} Seat;
+
+// Everything one move sends each player. It is queued on the seats with
+// the room locked, so moves keep their order, and written once the room
+// is unlocked, so a slow player never holds it.
+typedef struct {
+    struct iovec parts[2][OUTBOX_PARTS];
+    int count[2];
+    Seat *seats[2];             // queued to, with a reference each
+    char state[STATE_BUFFER];   // the board, shared by both players
+} Outbox;
+
+AiPool ai_pool;
+RoomTable room_table;   // every game in progress, recycled when both players leave
+TaskPool task_pool;     // runs reads and moves for every player
+int poll_fd;            // every player socket, armed one-shot
+int adjudicate = 0;   // --adjudicate: end games once a forced win is proven
+
 void initialize_board(int board[BOARD_SIZE][BOARD_SIZE]) {
     for (int i = 0; i < BOARD_SIZE; i++) {
         for (int j = 0; j < BOARD_SIZE; j++) {
@@ -44,159 +113,546 @@ void place_piece(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player
     board[row][col] = player;
 }
 
-int check_winner(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player) {
-    // Check horizontal
-    int count = 0;
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        if (board[row][i] == player) {
-            count++;
-            if (count == 5) {
-                return 1;
+// Lines through (row, col) for the rule checks in caro-rules.h; the cell
+// itself counts as the player's stone.
+void fill_rule_lines(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player, int8_t lines[4][RULE_LINE]) {
+    static const int steps[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    for (int d = 0; d < 4; d++) {
+        for (int t = -RULE_RADIUS; t <= RULE_RADIUS; t++) {
+            int i = row + t * steps[d][0];
+            int j = col + t * steps[d][1];
+            if (t == 0) {
+                lines[d][t + RULE_RADIUS] = LINE_OWN;
+            } else if (i < 0 || i >= BOARD_SIZE || j < 0 || j >= BOARD_SIZE) {
+                lines[d][t + RULE_RADIUS] = LINE_WALL;
+            } else if (board[i][j] == 0) {
+                lines[d][t + RULE_RADIUS] = LINE_EMPTY;
+            } else {
+                lines[d][t + RULE_RADIUS] = board[i][j] == player ? LINE_OWN : LINE_OTHER;
             }
-        } else {
-            count = 0;
         }
     }
+}
+
+// Whether the stone just placed at (row, col) wins under the rule variant
+// the server was built with (-DCARO_RULE, freestyle by default).
+int check_winner(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player) {
+    int8_t lines[4][RULE_LINE];
+    fill_rule_lines(board, row, col, player, lines);
+    return rules_is_win(lines, player);
+}
+
+// Renju forbids black overlines, double fours and double threes; every
+// other rule variant compiles this down to 0.
+int is_forbidden_move(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player) {
+#if RULES_HAS_FORBIDDEN
+    int8_t lines[4][RULE_LINE];
+    if (player != 1) {
+        return 0;
+    }
+    fill_rule_lines(board, row, col, player, lines);
+    return rules_forbidden(lines);
+#else
+    (void)board;
+    (void)row;
+    (void)col;
+    (void)player;
+    return 0;
+#endif
+}
 
-    // Check vertical
-    count = 0;
+// Returns the length of the text. Cells are single digits, so they are
+// written directly instead of through sprintf and strlen.
+size_t serialize_game_state(GameState *game_state, char *buffer) {
+    int len = sprintf(buffer, "%s|%s|%d", game_state->player1_nickname, game_state->player2_nickname, game_state->current_player);
     for (int i = 0; i < BOARD_SIZE; i++) {
-        if (board[i][col] == player) {
-            count++;
-            if (count == 5) {
-                return 1;
-            }
-        } else {
-            count = 0;
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            buffer[len++] = '|';
+            buffer[len++] = (char)('0' + game_state->board[i][j]);
         }
     }
+    buffer[len] = '\0';
+    return (size_t)len;
+}
 
-    // Check diagonal (top-left to bottom-right)
-    count = 0;
-    int i = row - col;
-    int j = 0;
-    if (i < 0) {
-        j = -i;
-        i = 0;
+void seat_release(Seat *seat) {
+    if (__atomic_sub_fetch(&seat->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
     }
-    while (i < BOARD_SIZE && j < BOARD_SIZE) {
-        if (board[i][j] == player) {
-            count++;
-            if (count == 5) {
-                return 1;
+    close(seat->client_socket);
+    if (seat->write_socket >= 0) {
+        close(seat->write_socket);
+    }
+    pthread_mutex_destroy(&seat->out_lock);
+    free(seat->out);
+    free(seat);
+}
+
+// Call with out_lock held. A player too far behind, or one the writer
+// cannot be armed for, is cut off; the read task then sees the hangup.
+void seat_drop_output(Seat *seat) {
+    seat->out_len = 0;
+    shutdown(seat->client_socket, SHUT_RDWR);
+}
+
+// Call with out_lock held. The armed writer holds a reference until its
+// task has run.
+void seat_arm_writer(Seat *seat) {
+    struct epoll_event event;
+    int op = EPOLL_CTL_MOD;
+
+    if (seat->write_socket < 0) {
+        seat->write_socket = dup(seat->client_socket);
+        op = EPOLL_CTL_ADD;
+    }
+    event.events = EPOLLOUT | EPOLLONESHOT;
+    event.data.ptr = &seat->writing;
+    __atomic_add_fetch(&seat->refs, 1, __ATOMIC_ACQ_REL);
+    seat->write_armed = 1;
+    if (seat->write_socket < 0 || epoll_ctl(poll_fd, op, seat->write_socket, &event) < 0) {
+        seat->write_armed = 0;
+        __atomic_sub_fetch(&seat->refs, 1, __ATOMIC_ACQ_REL);
+        seat_drop_output(seat);
+    }
+}
+
+// Sends what the socket takes now and leaves the rest to the writer. While
+// the writer is armed it owns the sending, which keeps the bytes in order.
+void seat_write(Seat *seat) {
+    pthread_mutex_lock(&seat->out_lock);
+    if (seat->out_len > 0 && !seat->write_armed) {
+        ssize_t sent = send(seat->client_socket, seat->out, seat->out_len, MSG_NOSIGNAL);
+        if (sent > 0) {
+            seat->out_len -= (size_t)sent;
+            memmove(seat->out, seat->out + sent, seat->out_len);
+        } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            seat->out_len = 0;   // gone; the read task notices
+        }
+        if (seat->out_len > 0) {
+            seat_arm_writer(seat);
+        }
+    }
+    pthread_mutex_unlock(&seat->out_lock);
+}
+
+// Task: a player who could not take everything can take more
+void write_task(void *arg) {
+    Seat *seat = (Seat *)arg;
+
+    pthread_mutex_lock(&seat->out_lock);
+    seat->write_armed = 0;
+    pthread_mutex_unlock(&seat->out_lock);
+    seat_write(seat);
+    seat_release(seat);
+}
+
+// Appends a player's messages behind what they have not been sent yet
+void seat_queue(Seat *seat, const struct iovec *parts, int count) {
+    pthread_mutex_lock(&seat->out_lock);
+    for (int i = 0; i < count; i++) {
+        size_t need = seat->out_len + parts[i].iov_len;
+        if (need > SEAT_BACKLOG) {
+            seat_drop_output(seat);
+            break;
+        }
+        if (need > seat->out_size) {
+            size_t size = seat->out_size > 0 ? seat->out_size : STATE_BUFFER;
+            while (size < need) {
+                size *= 2;
             }
-        } else {
-            count = 0;
+            char *out = (char *)realloc(seat->out, size);
+            if (out == NULL) {
+                seat_drop_output(seat);
+                break;
+            }
+            seat->out = out;
+            seat->out_size = size;
         }
-        i++;
-        j++;
+        memcpy(seat->out + seat->out_len, parts[i].iov_base, parts[i].iov_len);
+        seat->out_len = need;
     }
+    pthread_mutex_unlock(&seat->out_lock);
+}
+
+void outbox_init(Outbox *outbox) {
+    outbox->count[0] = 0;
+    outbox->count[1] = 0;
+    outbox->seats[0] = NULL;
+    outbox->seats[1] = NULL;
+}
+
+// Queues data for a player; it must stay put until the flush
+void outbox_add(Outbox *outbox, int player, const char *data, size_t len) {
+    struct iovec *part = &outbox->parts[player - 1][outbox->count[player - 1]++];
+    part->iov_base = (void *)data;
+    part->iov_len = len;
+}
 
-    // Check diagonal (top-right to bottom-left)
-    count = 0;
-    i = row + col;
-    j = 0;
-    if (i >= BOARD_SIZE) {
-        j = i - BOARD_SIZE + 1;
-        i = BOARD_SIZE - 1;
+// Call with the room locked, so nothing from another thread gets between
+// the messages of one move or ahead of an earlier move's
+void outbox_queue(Outbox *outbox, GameState *game_state) {
+    for (int p = 0; p < 2; p++) {
+        Seat *seat = game_state->seats[p];
+        if (outbox->count[p] > 0 && seat != NULL) {
+            seat_queue(seat, outbox->parts[p], outbox->count[p]);
+            __atomic_add_fetch(&seat->refs, 1, __ATOMIC_ACQ_REL);
+            outbox->seats[p] = seat;
+        }
+        outbox->count[p] = 0;
     }
-    while (i >= 0 && j < BOARD_SIZE) {
-        if (board[i][j] == player) {
-            count++;
-            if (count == 5) {
-                return 1;
+}
+
+// Task: one player's share of a move, sent apart from the mover's
+void send_task(void *arg) {
+    Seat *seat = (Seat *)arg;
+    seat_write(seat);
+    seat_release(seat);
+}
+
+// Call with the room unlocked: one send per player. The mover, if any, is
+// answered here; the other player's send is a task of its own, which an
+// idle worker can steal from this one, or sent here too if the pool is full.
+void outbox_send(Outbox *outbox, int mover) {
+    for (int p = 0; p < 2; p++) {
+        if (outbox->seats[p] == NULL) {
+            continue;
+        }
+        if (mover != 0 && p != mover - 1) {
+            if (!task_pool_submit(&task_pool, send_task, outbox->seats[p])) {
+                send_task(outbox->seats[p]);
             }
         } else {
-            count = 0;
+            send_task(outbox->seats[p]);
         }
-        i--;
-        j++;
+        outbox->seats[p] = NULL;
     }
+}
 
-    return 0;
+void send_game_state(GameState *game_state, Outbox *outbox) {
+    size_t len = serialize_game_state(game_state, outbox->state);
+    outbox_add(outbox, 1, outbox->state, len);
+    outbox_add(outbox, 2, outbox->state, len);
 }
 
-void serialize_game_state(GameState *game_state, char *buffer) {
-    sprintf(buffer, "%s|%s|%d", game_state->player1_nickname, game_state->player2_nickname, game_state->current_player);
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            sprintf(buffer + strlen(buffer), "|%d", game_state->board[i][j]);
-        }
+// The one way a game ends: tells both players and stops all further
+// moves, including a computer reply still being thought about. Call with
+// the room locked, after the final board has been queued.
+void end_game(GameState *game_state, Outbox *outbox, int winner) {
+    outbox_add(outbox, winner, "WIN", 3);
+    outbox_add(outbox, 3 - winner, "LOSE", 4);
+    game_state->current_player = 0;
+}
+
+// Ends the game early when the player to move has a forced win by
+// continuous fours. The check is capped at ADJUDICATE_BUDGET_US, so an
+// unproven win simply lets the game go on. Call with the room locked,
+// after the move has been queued.
+int adjudicate_game(GameState *game_state, Outbox *outbox) {
+    Engine engine;
+    int row, col;
+
+    if (!adjudicate) {
+        return 0;
     }
+    engine_setup(&engine, game_state->board, game_state->current_player);
+    if (!engine_vcf(&engine, ADJUDICATE_DEPTH, ADJUDICATE_BUDGET_US, &row, &col)) {
+        return 0;
+    }
+
+    printf("Adjudicated: player %d wins starting with %d,%d\n", game_state->current_player, row, col);
+    end_game(game_state, outbox, game_state->current_player);
+    return 1;
 }
 
-void send_game_state(GameState *game_state) {
-    char buffer[2048];
-    serialize_game_state(game_state, buffer);
-    send(game_state->player1_socket, buffer, strlen(buffer), 0);
-    send(game_state->player2_socket, buffer, strlen(buffer), 0);
+// Called from an AI pool thread once the computer has picked its reply.
+void ai_move_ready(void *room, int row, int col, long long elapsed_ms) {
+    GameState *game_state = (GameState *)room;
+    Outbox outbox;
+
+    outbox_init(&outbox);
+    pthread_mutex_lock(&game_state->lock);
+    game_state->ai_clock_ms -= elapsed_ms;
+    if (game_state->current_player == 2 && is_valid_move(game_state->board, row, col)) {
+        place_piece(game_state->board, row, col, 2);
+        if (check_winner(game_state->board, row, col, 2)) {
+            send_game_state(game_state, &outbox);
+            end_game(game_state, &outbox, 2);
+        } else {
+            game_state->current_player = 1;
+            send_game_state(game_state, &outbox);
+            adjudicate_game(game_state, &outbox);
+        }
+    }
+    outbox_queue(&outbox, game_state);
+    pthread_mutex_unlock(&game_state->lock);
+    outbox_send(&outbox, 0);
 }
 
-void handle_move(GameState *game_state, int client_socket, char *buffer) {
+// Anything that is not a move, such as the binary hello newer clients
+// send, is ignored; those clients then stay on text
+void handle_move(GameState *game_state, int client_socket, const WireFrame *message) {
+    Outbox outbox;
+    int mover = 0;
     int row, col;
-    sscanf(buffer, "%d,%d", &row, &col);
+    if (!wire_text_move(message, &row, &col)) {
+        return;
+    }
 
+    outbox_init(&outbox);
     pthread_mutex_lock(&game_state->lock);
 
     if (client_socket == game_state->player1_socket && game_state->current_player == 1) {
-        if (is_valid_move(game_state->board, row, col)) {
+        mover = 1;
+        if (is_valid_move(game_state->board, row, col) && !is_forbidden_move(game_state->board, row, col, 1)) {
             place_piece(game_state->board, row, col, 1);
             if (check_winner(game_state->board, row, col, 1)) {
-                send_game_state(game_state);
-                send(game_state->player1_socket, "WIN", 3, 0);
-                send(game_state->player2_socket, "LOSE", 4, 0);
+                send_game_state(game_state, &outbox);
+                end_game(game_state, &outbox, 1);
             } else {
                 game_state->current_player = 2;
-                send_game_state(game_state);
+                send_game_state(game_state, &outbox);
+                if (!adjudicate_game(game_state, &outbox) && game_state->ai_player == 2) {
+                    long long clock_ms = game_state->ai_clock_ms > 0 ? game_state->ai_clock_ms : 0;
+                    ai_pool_submit(&ai_pool, game_state, game_state->board, 2, clock_ms, ai_move_ready);
+                }
             }
         } else {
-            send(game_state->player1_socket, "INVALID_MOVE", 12, 0);
+            outbox_add(&outbox, 1, "INVALID_MOVE", 12);
         }
     } else if (client_socket == game_state->player2_socket && game_state->current_player == 2) {
+        mover = 2;
         if (is_valid_move(game_state->board, row, col)) {
             place_piece(game_state->board, row, col, 2);
             if (check_winner(game_state->board, row, col, 2)) {
-                send_game_state(game_state);
-                send(game_state->player2_socket, "WIN", 3, 0);
-                send(game_state->player1_socket, "LOSE", 4, 0);
+                send_game_state(game_state, &outbox);
+                end_game(game_state, &outbox, 2);
             } else {
                 game_state->current_player = 1;
-                send_game_state(game_state);
+                send_game_state(game_state, &outbox);
+                adjudicate_game(game_state, &outbox);
             }
         } else {
-            send(game_state->player2_socket, "INVALID_MOVE", 12, 0);
+            outbox_add(&outbox, 2, "INVALID_MOVE", 12);
         }
     }
 
+    outbox_queue(&outbox, game_state);
+    pthread_mutex_unlock(&game_state->lock);
+    outbox_send(&outbox, mover);
+}
+
+void arm_seat(Seat *seat, int op) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = &seat->reading;
+    epoll_ctl(poll_fd, op, seat->client_socket, &event);
+}
+
+// The last player out hands the room back. The socket stays open until
+// the last sender is done with it, so no output can reach whoever is
+// given the same descriptor next.
+void leave_room(Seat *seat) {
+    GameState *game_state = seat->game_state;
+    int client_socket = seat->client_socket;
+
+    epoll_ctl(poll_fd, EPOLL_CTL_DEL, client_socket, NULL);
+    if (game_state->ai_player != 0) {
+        // No pool thread may touch the room after this
+        ai_pool_cancel(&ai_pool, game_state);
+    }
+
+    pthread_mutex_lock(&game_state->lock);
+    if (game_state->player1_socket == client_socket) {
+        game_state->player1_socket = -1;
+    } else if (game_state->player2_socket == client_socket) {
+        game_state->player2_socket = -1;
+    }
+    for (int p = 0; p < 2; p++) {
+        if (game_state->seats[p] == seat) {
+            game_state->seats[p] = NULL;
+        }
+    }
+    int seated = --game_state->seated;
     pthread_mutex_unlock(&game_state->lock);
+
+    // Wakes an armed writer, whose send then fails and lets go
+    shutdown(client_socket, SHUT_RDWR);
+    if (seated == 0) {
+        pthread_mutex_destroy(&game_state->lock);
+        rooms_release(&room_table, game_state);
+    }
+    seat_release(seat);
 }
 
-void *handle_client(void *arg) {
-    GameState *game_state = (GameState *)arg;
-    int client_socket = (game_state->current_player == 1) ? game_state->player1_socket : game_state->player2_socket;
-    char buffer[1024];
+// Task: the socket is readable. One-shot arming means no other read task
+// runs for the same player until this one re-arms it.
+void read_task(void *arg) {
+    Seat *seat = (Seat *)arg;
+    WireFrame message;
+    size_t space;
+    int got = 0;
+
+    uint8_t *to = wire_reader_space(&seat->in, &space);
+    int bytes_received = recv(seat->client_socket, to, space, MSG_DONTWAIT);
+    if (bytes_received == 0 || (bytes_received < 0 && errno != EAGAIN && errno != EINTR)) {
+        leave_room(seat);
+        return;
+    }
+    if (bytes_received > 0) {
+        wire_reader_filled(&seat->in, (size_t)bytes_received);
+        while ((got = wire_reader_next(&seat->in, &message)) > 0) {
+            handle_move(seat->game_state, seat->client_socket, &message);
+        }
+    }
+    if (got < 0) {
+        leave_room(seat);
+        return;
+    }
+    arm_seat(seat, EPOLL_CTL_MOD);
+}
+
+// Turns readiness into tasks; it never reads or plays anything itself.
+// The tasks go on the poller's own deque, which idle workers steal from.
+// When the pool is full the poller waits for it before polling again: the
+// sockets of the events it holds stay unarmed, so readers are slowed down
+// instead of the poller running their tasks itself.
+void *poll_main(void *arg) {
+    struct epoll_event events[POLL_EVENTS];
+    (void)arg;
+
+    if (!task_pool_attach(&task_pool)) {
+        fprintf(stderr, "Error: No deque for the poller, submitting through the shared queue\n");
+    }
 
     while (1) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
-        if (bytes_received <= 0) {
+        int count = epoll_wait(poll_fd, events, POLL_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            perror("epoll_wait");
             break;
         }
+        for (int i = 0; i < count; i++) {
+            PollEntry *entry = (PollEntry *)events[i].data.ptr;
+            while (!task_pool_submit(&task_pool, entry->task, entry->seat)) {
+                usleep(POLL_BACKOFF_US);
+            }
+        }
+    }
+    return NULL;
+}
 
-        handle_move(game_state, client_socket, buffer);
+// Gives a player a seat in the room, to be sent to at once and read from
+// once seat_player arms it. Returns 0, with the socket closed, if there
+// is no memory for one.
+int open_seat(GameState *game_state, int player, int client_socket) {
+    Seat *seat = (Seat *)calloc(1, sizeof(Seat));
+
+    if (seat == NULL) {
+        close(client_socket);
+        return 0;
     }
+    seat->game_state = game_state;
+    seat->client_socket = client_socket;
+    seat->write_socket = -1;
+    seat->refs = 1;
+    seat->reading.seat = seat;
+    seat->reading.task = read_task;
+    seat->writing.seat = seat;
+    seat->writing.task = write_task;
+    pthread_mutex_init(&seat->out_lock, NULL);
+    wire_reader_init(&seat->in, seat->in_buffer, sizeof(seat->in_buffer), 0);
+    game_state->seats[player - 1] = seat;
+    return 1;
+}
 
-    close(client_socket);
-    pthread_exit(NULL);
+void seat_player(GameState *game_state, int player) {
+    arm_seat(game_state->seats[player - 1], EPOLL_CTL_ADD);
 }
 
-int main() {
+// Takes a fresh room from the table, NULL when none can be had
+GameState *open_room(void) {
+    uint32_t id;
+    GameState *game_state = (GameState *)rooms_acquire(&room_table, &id);
+
+    if (game_state == NULL) {
+        fprintf(stderr, "Error: Out of rooms\n");
+        return NULL;
+    }
+    initialize_board(game_state->board);
+    pthread_mutex_init(&game_state->lock, NULL);
+    game_state->current_player = 1;
+    game_state->seats[0] = NULL;
+    game_state->seats[1] = NULL;
+    return game_state;
+}
+
+void start_ai_game(int client_socket) {
+    GameState *game_state = open_room();
+
+    if (game_state == NULL || !open_seat(game_state, 1, client_socket)) {
+        if (game_state == NULL) {
+            close(client_socket);
+        } else {
+            pthread_mutex_destroy(&game_state->lock);
+            rooms_release(&room_table, game_state);
+        }
+        return;
+    }
+    game_state->player1_socket = client_socket;
+    game_state->player2_socket = -1;
+    game_state->ai_player = 2;
+    game_state->ai_clock_ms = AI_CLOCK_MS;
+    strcpy(game_state->player1_nickname, "Player 1");
+    strcpy(game_state->player2_nickname, "Computer");
+
+    Outbox outbox;
+    outbox_init(&outbox);
+    outbox_add(&outbox, 1, "1", 1);
+    send_game_state(game_state, &outbox);
+    outbox_queue(&outbox, game_state);
+    outbox_send(&outbox, 0);
+    printf("Player connected, playing against the computer\n");
+
+    game_state->seated = 1;
+    seat_player(game_state, 1);
+}
+
+int main(int argc, char *argv[]) {
     int server_socket, client_socket;
     struct sockaddr_in server_address, client_address;
-    pthread_t thread_id[MAX_CLIENTS];
-    GameState game_state;
+    GameState *waiting = NULL;   // room whose first player has no opponent yet
+    pthread_t poll_thread;
+    int ai_mode = 0;
+    int workers = 0;             // --workers n, one per core by default
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ai") == 0) {
+            ai_mode = 1;
+        } else if (strcmp(argv[i], "--adjudicate") == 0) {
+            adjudicate = 1;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        }
+    }
+
+    // A player who hangs up must not take the whole server down
+    signal(SIGPIPE, SIG_IGN);
+    rooms_init(&room_table, sizeof(GameState));
 
-    pthread_mutex_init(&game_state.lock, NULL);
+    // Players are not threads: one poller hands readable sockets to a
+    // fixed pool of workers
+    poll_fd = epoll_create1(0);
+    if (poll_fd < 0 || !task_pool_init(&task_pool, workers)) {
+        fprintf(stderr, "Error: Could not start the worker pool\n");
+        return 1;
+    }
+    pthread_create(&poll_thread, NULL, poll_main, NULL);
+
+    // In --ai mode every connection gets its own game against the computer,
+    // and all games share one pool of engine threads.
+    if (ai_mode && !ai_pool_init(&ai_pool, 0, AI_TT_MB)) {
+        fprintf(stderr, "Error: Could not start the AI workers\n");
+        return 1;
+    }
 
     // Create a socket for the server
     server_socket = socket(AF_INET, SOCK_STREAM, 0);
@@ -210,36 +666,68 @@ int main() {
     bind(server_socket, (struct sockaddr *)&server_address, sizeof(server_address));
 
     // Listen for incoming connections
-    listen(server_socket, MAX_CLIENTS);
+    listen(server_socket, LISTEN_BACKLOG);
 
     while (1) {
         // Accept client connections
         socklen_t client_address_length = sizeof(client_address);
         client_socket = accept(server_socket, (struct sockaddr *)&client_address, &client_address_length);
+        if (client_socket < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(client_socket, F_SETFL, fcntl(client_socket, F_GETFL) | O_NONBLOCK);
 
-        if (game_state.player1_socket == 0) {
-            game_state.player1_socket = client_socket;
-            initialize_board(game_state.board);
-            game_state.current_player = 1;
-            strcpy(game_state.player1_nickname, "Player 1");
-            send(game_state.player1_socket, "1", 1, 0);
+        if (ai_mode) {
+            start_ai_game(client_socket);
+        } else if (waiting == NULL) {
+            // Every pair of connections gets its own room
+            Outbox outbox;
+            waiting = open_room();
+            if (waiting == NULL) {
+                close(client_socket);
+                continue;
+            }
+            if (!open_seat(waiting, 1, client_socket)) {
+                pthread_mutex_destroy(&waiting->lock);
+                rooms_release(&room_table, waiting);
+                waiting = NULL;
+                continue;
+            }
+            waiting->player1_socket = client_socket;
+            strcpy(waiting->player1_nickname, "Player 1");
+            outbox_init(&outbox);
+            outbox_add(&outbox, 1, "1", 1);
+            outbox_queue(&outbox, waiting);
+            outbox_send(&outbox, 0);
             printf("Player 1 connected\n");
-        } else if (game_state.player2_socket == 0) {
-            game_state.player2_socket = client_socket;
-            strcpy(game_state.player2_nickname, "Player 2");
-            send(game_state.player2_socket, "2", 1, 0);
+        } else {
+            GameState *game_state = waiting;
+            Outbox outbox;
+            if (!open_seat(game_state, 2, client_socket)) {
+                continue;
+            }
+            waiting = NULL;
+            game_state->player2_socket = client_socket;
+            strcpy(game_state->player2_nickname, "Player 2");
             printf("Player 2 connected\n");
 
-            // Send initial game state to both players
-            send_game_state(&game_state);
+            // The player number and the initial game state go out together
+            outbox_init(&outbox);
+            outbox_add(&outbox, 2, "2", 1);
+            send_game_state(game_state, &outbox);
+            outbox_queue(&outbox, game_state);
+            outbox_send(&outbox, 0);
 
-            // Create separate threads for each player
-            pthread_create(&thread_id[0], NULL, handle_client, (void *)&game_state);
-            pthread_create(&thread_id[1], NULL, handle_client, (void *)&game_state);
+            // From here on the pool serves both players
+            game_state->seated = 2;
+            seat_player(game_state, 1);
+            seat_player(game_state, 2);
         }
     }
 
-    pthread_mutex_destroy(&game_state.lock);
+    rooms_destroy(&room_table);
     close(server_socket);
     return 0;
 }
\ No newline at end of file
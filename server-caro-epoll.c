@@ -0,0 +1,2020 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/time_types.h>
+
+#define SERVER_IP "127.0.0.1"
+#define SERVER_PORT 8888
+#define BOARD_SIZE 15
+#define LISTEN_BACKLOG 4096
+#define MAX_EVENTS 256
+#define READ_BUFFER 512
+#define STATE_BUFFER 2048
+#define MATCH_QUEUE_CAPACITY 65536
+#define MATCH_DEFAULT_RATING 1500
+#define MATCH_BANDS 32
+#define MATCH_WIDEN_US 2000000   // a lone player may cross one more band per this much waiting
+#define MATCH_TICK_US 1000
+#define MATCH_FORWARD_US 20000   // a lone player is sent on to shard 0 after this long
+#define HELLO_WAIT_US 2000       // how long a silent new player may still ask for the binary protocol
+#define URING_ENTRIES 4096
+#define URING_CQ_ENTRIES 65536
+#define URING_BUFFERS 4096         // provided receive buffers per reactor, a power of two
+#define WAKE_CAPACITY 65536       // connections other threads hand over for sending
+#define WATCH_QUEUE_CAPACITY 65536   // spectators passed on to the shard that has their room
+#define SPECTATOR_BACKLOG 64      // shared messages a spectator may have queued before it falls behind
+#define SPECTATOR_DROP_US 10000000   // a spectator still behind after this long is dropped
+
+// The low bits of an io_uring user_data say what completed
+#define TAG_ACCEPT 0
+#define TAG_RECV 1
+#define TAG_SEND 2
+#define TAG_WAKE 3
+#define TAG_TICK 4
+#define TAG_MASK 7
+
+// What found the submission queue full, armed again on the next loop
+#define STALL_RECV 1
+#define STALL_SEND 2
+#define STALL_ACCEPT 1
+#define STALL_WAKE 2
+
+// Messages a room encodes once for all its spectators
+#define SHARED_TEXT_BOARD 0
+#define SHARED_STATE 1
+#define SHARED_DELTA 2
+#define SHARED_TEXT_OVER 3
+#define SHARED_OVER 4
+#define SHARED_KINDS 5
+
+#include "caro-rules.h"
+#include "caro-rooms.h"
+#include "caro-queue.h"
+#include "caro-uring.h"
+#include "caro-wire.h"
+
+// Event-driven server: one reactor thread per core, each with its own
+// SO_REUSEPORT listening socket, epoll set or io_uring (-u), room table and
+// matchmaking, multiplexes every connection. A connection is a small state
+// machine instead of a blocked thread, so idle players only cost their
+// buffers. Output is queued per connection and sent once per loop
+// iteration. Only the flush and the reactor loops know the backend.
+// Spectators subscribe to a room and are sent references to messages the
+// room encodes once, instead of copies.
+typedef enum {
+    CONN_WAITING,    // connected, owned by a shard's matchmaking until seated
+    CONN_PLAYING,    // seated in a room
+    CONN_DONE,       // game over, waiting for the client to hang up
+    CONN_WATCHING    // subscribed to a room as a spectator
+} ConnState;
+
+typedef struct Room Room;
+typedef struct Reactor Reactor;
+
+typedef struct Connection Connection;
+
+// A message encoded once for every spectator of a room. It never changes
+// once made; each queue holding it has a reference and the last frees it.
+typedef struct {
+    int refs;
+    size_t len;
+    char data[];
+} SharedBuffer;
+
+// Output of a spectator: references to shared messages, sent straight from
+// their buffers after any private output. A spectator whose queue fills up
+// falls behind: what it has not started sending is dropped, moves are
+// skipped, and once it has sent the rest it gets the board as it is then.
+typedef struct {
+    SharedBuffer *queued[SPECTATOR_BACKLOG];   // a ring, oldest first
+    int head;
+    int count;
+    size_t done;             // bytes of the oldest already sent, epoll only
+    int in_flight;           // io_uring: the oldest this many are the kernel's
+    int slot;                // in the room's spectators, under the room lock
+    int behind;
+    long long behind_us;
+    int dropped;
+    struct iovec iov[SPECTATOR_BACKLOG + 1];   // io_uring: what the kernel is sending
+    struct msghdr msg;
+} Watch;
+
+struct Connection {
+    int fd;
+    int epoll_fd;            // epoll set of the reactor that owns the connection
+    Reactor *reactor;
+    int refs;                // the game logic holds one, io_uring work in flight another
+    ConnState state;
+    int player;              // 1 or 2 once seated
+    Room *room;              // published once by seat_pair or watch_room, read atomically
+    int rating;              // matchmaking rating, a "RATING n" message sets it
+    int binary;              // binary protocol version agreed before being seated, 0 for text
+    int spoke;               // sent anything while waiting, so it is ready to be seated
+    int gone;                // closed while waiting; matchmaking frees it
+    int expired;             // timed out while waiting, being closed
+    int watching;            // asked to watch; matchmaking passes it to the room's shard
+    int watch_shard;
+    uint32_t watch_id;       // ROOM_NONE for the featured game
+    Watch *watch;            // set under the lock once subscribed
+    Connection *next_idle;   // shard only, waiting for the next featured game or held
+    long long queued_us;
+    unsigned long accepted_poll;   // the owner's poll count when it was accepted
+    pthread_mutex_t lock;    // guards the output queue, peers write to it too
+    char *out;
+    size_t out_len;
+    size_t out_capacity;
+    int want_write;
+
+    // io_uring only: the buffer the kernel is sending from while out fills up
+    char *sending;
+    size_t sending_len;
+    size_t sending_done;
+    size_t sending_capacity;
+    int send_busy;
+    int recv_armed;
+    int closing;             // the receive side has ended
+    int flush_queued;        // on the owner's flush list or wake queue, or waiting for it
+    Connection *next_flush;  // owner only, or the thread holding it for a full wake queue
+    int stalled;             // io_uring: STALL_RECV and STALL_SEND, waiting for an SQE
+    Connection *next_stalled;
+
+    // Only the owning reactor reads; a message cut off by a read waits here
+    WireReader in;
+    uint8_t in_buffer[READ_BUFFER];
+};
+
+struct Room {
+    pthread_mutex_t lock;
+    Reactor *shard;          // that seated it, the only one that frees it
+    uint32_t id;             // handle in the table
+    int board[BOARD_SIZE][BOARD_SIZE];
+    int current_player;      // 0 once the game is over
+    int move_number;         // moves played, the last delta carries it
+    int last_cell;
+    int winner;
+    Connection *players[2];
+    int seated;              // connections still pointing at the room, spectators too
+
+    // Spectators, and the messages for them as the room is now; each is
+    // encoded the first time one is needed after a move
+    Connection **spectators;
+    int spectator_count;
+    int spectator_capacity;
+    SharedBuffer *shared[SHARED_KINDS];
+    Room *next_retired;      // held by a thread that found the shard's queue full
+};
+
+// Counted for the stats line by the reactor doing the work and summed over
+// the shards when printed; io_uring_enter calls are counted by the rings.
+// Spectators may leave on another shard than they joined on, so one shard's
+// watching count can go below zero.
+enum {
+    COUNT_SYSCALLS, COUNT_MOVES, COUNT_WATCHING, COUNT_SHARED_MADE,
+    COUNT_SHARED_QUEUED, COUNT_BEHIND, COUNT_DROPPED, COUNTERS
+};
+
+// One shard per core; nothing in it is shared except the queues
+struct Reactor {
+    int index;
+    int listen_fd;           // own SO_REUSEPORT socket, the kernel spreads connections
+    int epoll_fd;
+    pthread_t thread;
+    RoomTable rooms;
+
+    // Matchmaking: players other shards pass on arrive on the inbox, and
+    // only this thread touches pending
+    MpmcQueue inbox;
+    Connection **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    long long next_match_us;
+    long long waiting;       // for the stats line
+
+    // Spectators matchmaking passed on, and rooms other threads left empty:
+    // only this thread frees its rooms, so one it looks up stays valid
+    MpmcQueue watchers;
+    MpmcQueue retired;
+    Room *featured;          // the game a WATCH naming no room gets, shard 0's
+    uint32_t featured_id;    // for the stats line
+    Connection *idle;        // spectators that came between featured games
+    Connection *held;        // players add_pending had no memory for
+
+    // Connections given output during this iteration, sent before the next
+    // wait. Other threads hand theirs over through the wake queue and kick
+    // the eventfd if the reactor sleeps.
+    Connection *flushes;
+    int wake_fd;
+    uint64_t wake_value;
+    int sleeping;
+    Uring ring;
+    MpmcQueue wake_queue;
+    struct __kernel_timespec tick;
+    int tick_armed;
+    int stalled_arms;        // STALL_ACCEPT and STALL_WAKE, waiting for an SQE
+    Connection *stalled;     // connections waiting for an SQE
+
+    // What another shard's full queue did not take yet, tried again every
+    // loop instead of spinning: connections for their owners' wake queues
+    // and empty rooms for their shards
+    Connection *hand_overs;
+    Room *retiring;
+    unsigned long polls;     // waits for events so far, matchmaking reads it
+    long long counts[COUNTERS];   // for the stats line, only this thread writes them
+};
+
+Reactor *reactors;
+int reactor_count;
+int use_uring = 0;                 // -u
+__thread Reactor *current_reactor;
+
+
+// Matchmaking runs on every shard between event batches: it buckets the
+// shard's waiting players by rating band and seats pairs in its own rooms.
+// A player still alone after MATCH_FORWARD_US is passed to shard 0 over a
+// lock-free queue, so leftovers from all shards meet there.
+int match_band_width = 0;          // -b: rating points per band, 0 pairs in arrival order
+long long match_timeout_us = 0;    // -w: drop players nobody was found for, 0 waits forever
+
+long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void initialize_board(int board[BOARD_SIZE][BOARD_SIZE]) {
+    memset(board, 0, sizeof(int) * BOARD_SIZE * BOARD_SIZE);
+}
+
+int is_valid_move(int board[BOARD_SIZE][BOARD_SIZE], int row, int col) {
+    if (row < 0 || row >= BOARD_SIZE || col < 0 || col >= BOARD_SIZE) {
+        return 0;
+    }
+    return board[row][col] == 0;
+}
+
+void fill_rule_lines(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player, int8_t lines[4][RULE_LINE]) {
+    static const int steps[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    for (int d = 0; d < 4; d++) {
+        for (int t = -RULE_RADIUS; t <= RULE_RADIUS; t++) {
+            int i = row + t * steps[d][0];
+            int j = col + t * steps[d][1];
+            if (t == 0) {
+                lines[d][t + RULE_RADIUS] = LINE_OWN;
+            } else if (i < 0 || i >= BOARD_SIZE || j < 0 || j >= BOARD_SIZE) {
+                lines[d][t + RULE_RADIUS] = LINE_WALL;
+            } else if (board[i][j] == 0) {
+                lines[d][t + RULE_RADIUS] = LINE_EMPTY;
+            } else {
+                lines[d][t + RULE_RADIUS] = board[i][j] == player ? LINE_OWN : LINE_OTHER;
+            }
+        }
+    }
+}
+
+int check_winner(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player) {
+    int8_t lines[4][RULE_LINE];
+    fill_rule_lines(board, row, col, player, lines);
+    return rules_is_win(lines, player);
+}
+
+int is_forbidden_move(int board[BOARD_SIZE][BOARD_SIZE], int row, int col, int player) {
+#if RULES_HAS_FORBIDDEN
+    int8_t lines[4][RULE_LINE];
+    if (player != 1) {
+        return 0;
+    }
+    fill_rule_lines(board, row, col, player, lines);
+    return rules_forbidden(lines);
+#else
+    (void)board;
+    (void)row;
+    (void)col;
+    (void)player;
+    return 0;
+#endif
+}
+
+// Only reactor threads count, each into its own shard; the store is atomic
+// only so the stats thread never reads a torn value
+void count(int counter, int delta) {
+    long long *value = &current_reactor->counts[counter];
+    __atomic_store_n(value, *value + delta, __ATOMIC_RELAXED);
+}
+
+long long total_count(int counter) {
+    long long total = 0;
+    for (int i = 0; i < reactor_count; i++) {
+        total += __atomic_load_n(&reactors[i].counts[counter], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+void count_syscall(void) {
+    count(COUNT_SYSCALLS, 1);
+}
+
+void update_interest(Connection *conn) {
+    struct epoll_event event;
+    count_syscall();
+    event.events = EPOLLIN | EPOLLRDHUP | (conn->want_write ? EPOLLOUT : 0);
+    event.data.ptr = conn;
+    epoll_ctl(conn->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+// Call with the connection locked. Returns 0 when out of memory.
+int conn_append(Connection *conn, const char *data, size_t len) {
+    if (conn->out_len + len > conn->out_capacity) {
+        size_t capacity = conn->out_capacity > 0 ? conn->out_capacity : STATE_BUFFER;
+        while (capacity < conn->out_len + len) {
+            capacity *= 2;
+        }
+        char *out = realloc(conn->out, capacity);
+        if (out == NULL) {
+            return 0;
+        }
+        conn->out = out;
+        conn->out_capacity = capacity;
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+    return 1;
+}
+
+void conn_hand_over(Connection *conn);
+void watch_catch_up(Connection *conn);
+
+// Call with the connection locked: puts it on its owner's flush list once.
+// Returns 1 when it must be handed over with conn_hand_over once unlocked.
+int conn_schedule(Connection *conn) {
+    if (conn->flush_queued) {
+        return 0;
+    }
+    conn->flush_queued = 1;
+    __atomic_add_fetch(&conn->refs, 1, __ATOMIC_RELAXED);
+    if (conn->reactor != current_reactor) {
+        return 1;
+    }
+    conn->next_flush = conn->reactor->flushes;
+    conn->reactor->flushes = conn;
+    return 0;
+}
+
+// Call with the connection locked. Nothing is sent here: the owner sends
+// everything a connection was given during one loop iteration in a single
+// call before it waits again, so a board and the WIN behind it share one
+// send. Returns 1 when the connection must be handed to its owner with
+// conn_hand_over once unlocked.
+int conn_queue(Connection *conn, const char *data, size_t len) {
+    return conn_append(conn, data, len) && conn_schedule(conn);
+}
+
+// Safe to call from any thread
+void conn_send(Connection *conn, const char *data, size_t len) {
+    pthread_mutex_lock(&conn->lock);
+    int hand_over = conn_queue(conn, data, len);
+    pthread_mutex_unlock(&conn->lock);
+    if (hand_over) {
+        conn_hand_over(conn);
+    }
+}
+
+// Sends a message without a payload in the protocol the player speaks.
+// WIRE_OVER carries winner 0: there was nothing to watch.
+void conn_signal(Connection *conn, int type) {
+    static const char *words[] = {
+        [WIRE_WIN] = "WIN", [WIRE_LOSE] = "LOSE", [WIRE_INVALID] = "INVALID_MOVE", [WIRE_TIMEOUT] = "TIMEOUT",
+        [WIRE_OVER] = "OVER 0"
+    };
+    if (conn->binary) {
+        uint8_t frame[3];
+        uint8_t nobody = 0;
+        conn_send(conn, (const char *)frame, wire_frame(frame, type, &nobody, type == WIRE_OVER));
+    } else {
+        conn_send(conn, words[type], strlen(words[type]));
+    }
+}
+
+// Returns NULL when out of memory
+SharedBuffer *shared_new(const void *data, size_t len) {
+    SharedBuffer *buffer = malloc(sizeof(SharedBuffer) + len);
+    if (buffer != NULL) {
+        buffer->refs = 1;
+        buffer->len = len;
+        memcpy(buffer->data, data, len);
+        count(COUNT_SHARED_MADE, 1);
+    }
+    return buffer;
+}
+
+void shared_release(SharedBuffer *buffer) {
+    if (__atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(buffer);
+    }
+}
+
+// Call with the connection locked: lets go of the queued messages from the
+// first one nothing has been sent of yet
+void watch_drop_queued(Watch *watch) {
+    int kept = use_uring ? watch->in_flight : watch->done > 0;
+    for (int i = kept; i < watch->count; i++) {
+        shared_release(watch->queued[(watch->head + i) % SPECTATOR_BACKLOG]);
+    }
+    watch->count = kept;
+}
+
+// Call with the connection locked. Queues a reference to a shared message;
+// a spectator that has fallen behind skips it, and one that stays behind
+// too long is dropped. Returns 1 when the connection must be handed to its
+// owner, as conn_queue does.
+int watch_queue(Connection *conn, SharedBuffer *buffer) {
+    Watch *watch = conn->watch;
+    if (buffer == NULL || watch->dropped) {
+        return 0;
+    }
+    if (!watch->behind && watch->count == SPECTATOR_BACKLOG) {
+        watch_drop_queued(watch);
+        watch->behind = 1;
+        watch->behind_us = now_us();
+        count(COUNT_BEHIND, 1);
+    }
+    if (watch->behind) {
+        if (now_us() - watch->behind_us > SPECTATOR_DROP_US) {
+            watch->dropped = 1;
+            count(COUNT_DROPPED, 1);
+            count_syscall();
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+        return 0;
+    }
+    __atomic_add_fetch(&buffer->refs, 1, __ATOMIC_RELAXED);
+    count(COUNT_SHARED_QUEUED, 1);
+    watch->queued[(watch->head + watch->count++) % SPECTATOR_BACKLOG] = buffer;
+    return conn_schedule(conn);
+}
+
+// Safe to call from any thread
+void watch_send(Connection *conn, SharedBuffer *buffer) {
+    pthread_mutex_lock(&conn->lock);
+    int hand_over = watch_queue(conn, buffer);
+    pthread_mutex_unlock(&conn->lock);
+    if (hand_over) {
+        conn_hand_over(conn);
+    }
+}
+
+// Call with the connection locked: a spectator that fell behind has sent
+// everything it had and may catch up
+int watch_caught_up(Connection *conn) {
+    return conn->watch != NULL && conn->watch->behind && !conn->watch->dropped && conn->watch->count == 0;
+}
+
+// Call with the connection locked. Points iov at the private output given,
+// then at a spectator's shared messages. Returns how many it used.
+int conn_gather(Connection *conn, char *data, size_t len, struct iovec *iov) {
+    Watch *watch = conn->watch;
+    int used = 0;
+    if (len > 0) {
+        iov[used].iov_base = data;
+        iov[used++].iov_len = len;
+    }
+    for (int i = 0; watch != NULL && i < watch->count; i++) {
+        SharedBuffer *buffer = watch->queued[(watch->head + i) % SPECTATOR_BACKLOG];
+        size_t skip = i == 0 ? watch->done : 0;
+        iov[used].iov_base = buffer->data + skip;
+        iov[used++].iov_len = buffer->len - skip;
+    }
+    return used;
+}
+
+// Call with the connection locked: drops what was sent from the front
+void conn_consume(Connection *conn, size_t sent) {
+    Watch *watch = conn->watch;
+    size_t own = sent < conn->out_len ? sent : conn->out_len;
+    if (own > 0) {
+        memmove(conn->out, conn->out + own, conn->out_len - own);
+        conn->out_len -= own;
+        sent -= own;
+    }
+    while (sent > 0) {
+        SharedBuffer *buffer = watch->queued[watch->head];
+        size_t left = buffer->len - watch->done;
+        if (sent < left) {
+            watch->done += sent;
+            return;
+        }
+        sent -= left;
+        watch->done = 0;
+        shared_release(buffer);
+        watch->head = (watch->head + 1) % SPECTATOR_BACKLOG;
+        watch->count--;
+    }
+}
+
+// Call with the connection locked. Writes what the socket takes and waits
+// for EPOLLOUT to write the rest.
+void conn_write(Connection *conn) {
+    struct iovec iov[SPECTATOR_BACKLOG + 1];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    while ((msg.msg_iovlen = (size_t)conn_gather(conn, conn->out, conn->out_len, iov)) > 0) {
+        count_syscall();
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent <= 0) {
+            break;
+        }
+        conn_consume(conn, (size_t)sent);
+    }
+    int left = conn->out_len > 0 || (conn->watch != NULL && conn->watch->count > 0);
+    if (left != conn->want_write) {
+        conn->want_write = left;
+        update_interest(conn);
+    }
+}
+
+void conn_flush(Connection *conn) {
+    pthread_mutex_lock(&conn->lock);
+    conn_write(conn);
+    int catch_up = watch_caught_up(conn);
+    pthread_mutex_unlock(&conn->lock);
+    if (catch_up) {
+        watch_catch_up(conn);
+    }
+}
+
+// Returns the length of the text
+size_t serialize_game_state(Room *room, char *buffer) {
+    int len = sprintf(buffer, "Player 1|Player 2|%d", room->current_player);
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        for (int j = 0; j < BOARD_SIZE; j++) {
+            buffer[len++] = '|';
+            buffer[len++] = (char)('0' + room->board[i][j]);
+        }
+    }
+    buffer[len] = '\0';
+    return (size_t)len;
+}
+
+// Call with the room locked. The message of a kind for the room as it is
+// now, encoded the first time a spectator needs it after a move. NULL when
+// out of memory.
+SharedBuffer *room_shared(Room *room, int kind) {
+    char buffer[STATE_BUFFER];
+    uint8_t *frame = (uint8_t *)buffer;
+    uint8_t winner = (uint8_t)room->winner;
+    size_t len = 0;
+
+    if (room->shared[kind] != NULL) {
+        return room->shared[kind];
+    }
+    switch (kind) {
+        case SHARED_TEXT_BOARD:
+            len = serialize_game_state(room, buffer);
+            break;
+        case SHARED_STATE:
+            len = wire_encode_state(frame, &room->board[0][0], room->current_player);
+            break;
+        case SHARED_DELTA:
+            len = wire_encode_delta(frame, room->last_cell, room->board[room->last_cell / BOARD_SIZE][room->last_cell % BOARD_SIZE],
+                                    room->move_number);
+            break;
+        case SHARED_TEXT_OVER:
+            len = (size_t)sprintf(buffer, "OVER %d", room->winner);
+            break;
+        case SHARED_OVER:
+            len = wire_frame(frame, WIRE_OVER, &winner, 1);
+            break;
+    }
+    room->shared[kind] = shared_new(buffer, len);
+    return room->shared[kind];
+}
+
+// Call with the room locked, when it changes. Queues keep theirs.
+void room_forget_shared(Room *room) {
+    for (int kind = 0; kind < SHARED_KINDS; kind++) {
+        if (room->shared[kind] != NULL) {
+            shared_release(room->shared[kind]);
+            room->shared[kind] = NULL;
+        }
+    }
+}
+
+// What a spectator gets for the board and for a move
+int board_kind(Connection *conn) {
+    return conn->binary ? SHARED_STATE : SHARED_TEXT_BOARD;
+}
+
+int move_kind(Connection *conn) {
+    return conn->binary >= WIRE_DELTA_VERSION ? SHARED_DELTA : board_kind(conn);
+}
+
+int over_kind(Connection *conn) {
+    return conn->binary ? SHARED_OVER : SHARED_TEXT_OVER;
+}
+
+// Call with the room locked. Returns 0 when out of memory.
+int room_add_spectator(Room *room, Connection *conn, Watch *watch) {
+    if (room->spectator_count == room->spectator_capacity) {
+        int capacity = room->spectator_capacity > 0 ? room->spectator_capacity * 2 : 16;
+        Connection **spectators = realloc(room->spectators, capacity * sizeof(Connection *));
+        if (spectators == NULL) {
+            return 0;
+        }
+        room->spectators = spectators;
+        room->spectator_capacity = capacity;
+    }
+    watch->slot = room->spectator_count;
+    room->spectators[room->spectator_count++] = conn;
+    count(COUNT_WATCHING, 1);
+    return 1;
+}
+
+// Call with the room locked
+void room_remove_spectator(Room *room, Connection *conn) {
+    Connection *last = room->spectators[--room->spectator_count];
+    room->spectators[conn->watch->slot] = last;
+    last->watch->slot = conn->watch->slot;
+    count(COUNT_WATCHING, -1);
+}
+
+// The board in each protocol, encoded on first use
+typedef struct {
+    char text[STATE_BUFFER];
+    size_t text_len;
+    uint8_t frame[WIRE_MAX_FRAME];
+    size_t frame_len;
+} BoardMessages;
+
+// Call with the room locked. A spectator gets the shared board.
+void send_board(Connection *conn, Room *room, BoardMessages *messages) {
+    if (conn->watch != NULL) {
+        watch_send(conn, room_shared(room, board_kind(conn)));
+    } else if (conn->binary) {
+        if (messages->frame_len == 0) {
+            messages->frame_len = wire_encode_state(messages->frame, &room->board[0][0], room->current_player);
+        }
+        conn_send(conn, (const char *)messages->frame, messages->frame_len);
+    } else {
+        if (messages->text_len == 0) {
+            messages->text_len = serialize_game_state(room, messages->text);
+        }
+        conn_send(conn, messages->text, messages->text_len);
+    }
+}
+
+// Call with the room locked
+void broadcast_game_state(Room *room) {
+    BoardMessages messages;
+    messages.text_len = 0;
+    messages.frame_len = 0;
+    for (int p = 0; p < 2; p++) {
+        if (room->players[p] != NULL) {
+            send_board(room->players[p], room, &messages);
+        }
+    }
+}
+
+// Call with the room locked, after the move is on the board. Players who
+// take deltas get the move alone, older clients the whole board.
+// Spectators share one encoding of each.
+void broadcast_move(Room *room, int row, int col, int player) {
+    BoardMessages messages;
+    uint8_t delta[WIRE_DELTA_FRAME];
+    messages.text_len = 0;
+    messages.frame_len = 0;
+    wire_encode_delta(delta, row * BOARD_SIZE + col, player, room->move_number);
+    room->last_cell = row * BOARD_SIZE + col;
+    room_forget_shared(room);
+
+    for (int p = 0; p < 2; p++) {
+        Connection *conn = room->players[p];
+        if (conn == NULL) {
+            continue;
+        }
+        if (conn->binary >= WIRE_DELTA_VERSION) {
+            conn_send(conn, (const char *)delta, sizeof(delta));
+        } else {
+            send_board(conn, room, &messages);
+        }
+    }
+    for (int s = 0; s < room->spectator_count; s++) {
+        Connection *conn = room->spectators[s];
+        watch_send(conn, room_shared(room, move_kind(conn)));
+    }
+}
+
+// Call with the room locked
+void finish_game(Room *room, int winner) {
+    room->current_player = 0;
+    room->winner = winner;
+    room_forget_shared(room);
+    for (int p = 0; p < 2; p++) {
+        Connection *conn = room->players[p];
+        if (conn != NULL) {
+            conn->state = CONN_DONE;
+            conn_signal(conn, p + 1 == winner ? WIRE_WIN : WIRE_LOSE);
+        }
+    }
+    // OVER ends a watch. Ending the read side lets each owner close its
+    // spectator once OVER is out, so viewers do not keep the room, featured
+    // or not, from being retired; the room lock keeps the fds open here.
+    for (int s = 0; s < room->spectator_count; s++) {
+        Connection *conn = room->spectators[s];
+        watch_send(conn, room_shared(room, over_kind(conn)));
+        count_syscall();
+        shutdown(conn->fd, SHUT_RD);
+    }
+}
+
+void handle_move(Connection *conn, Room *room, int row, int col) {
+    pthread_mutex_lock(&room->lock);
+    if (conn->state == CONN_PLAYING && room->current_player == conn->player) {
+        if (is_valid_move(room->board, row, col) && !is_forbidden_move(room->board, row, col, conn->player)) {
+            count(COUNT_MOVES, 1);
+            room->board[row][col] = conn->player;
+            room->move_number++;
+            if (check_winner(room->board, row, col, conn->player)) {
+                broadcast_move(room, row, col, conn->player);
+                finish_game(room, conn->player);
+            } else {
+                room->current_player = 3 - conn->player;
+                broadcast_move(room, row, col, conn->player);
+            }
+        } else {
+            conn_signal(conn, WIRE_INVALID);
+        }
+    }
+    pthread_mutex_unlock(&room->lock);
+}
+
+// Switches a waiting player to the binary protocol. The reply is queued
+// under the lock, so it goes out before anything seat_pair sends.
+void accept_hello(Connection *conn, int version) {
+    uint8_t reply[3];
+    uint8_t chosen = (uint8_t)(version < WIRE_VERSION ? version : WIRE_VERSION);
+    int hand_over = 0;
+
+    pthread_mutex_lock(&conn->lock);
+    if (conn->room == NULL && !conn->binary) {
+        conn->binary = chosen;
+        conn->in.binary = 1;
+        hand_over = conn_queue(conn, (const char *)reply, wire_frame(reply, WIRE_HELLO, &chosen, 1));
+    }
+    pthread_mutex_unlock(&conn->lock);
+    if (hand_over) {
+        conn_hand_over(conn);
+    }
+}
+
+void expire_connection(Connection *conn, int type);
+
+// A waiting connection asks to watch instead of play; matchmaking passes it
+// on to the shard that has the room
+void request_watch(Connection *conn, int shard, uint32_t id) {
+    if (shard >= reactor_count) {
+        expire_connection(conn, WIRE_OVER);
+        return;
+    }
+    pthread_mutex_lock(&conn->lock);
+    if (conn->room == NULL && !conn->watching) {
+        conn->watch_shard = shard < 0 ? 0 : shard;
+        conn->watch_id = shard < 0 ? ROOM_NONE : id;
+        __atomic_store_n(&conn->watching, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+void handle_frame(Connection *conn, Room *room, const WireFrame *frame) {
+    int shard;
+    uint32_t id;
+
+    if (frame->type == WIRE_MOVE && frame->len == 1 && room != NULL) {
+        handle_move(conn, room, frame->payload[0] / BOARD_SIZE, frame->payload[0] % BOARD_SIZE);
+    } else if (frame->type == WIRE_RESYNC && room != NULL) {
+        BoardMessages messages;
+        messages.text_len = 0;
+        messages.frame_len = 0;
+        pthread_mutex_lock(&room->lock);
+        send_board(conn, room, &messages);
+        pthread_mutex_unlock(&room->lock);
+    } else if (frame->type == WIRE_RATING && frame->len == 2 && room == NULL) {
+        __atomic_store_n(&conn->rating, frame->payload[0] << 8 | frame->payload[1], __ATOMIC_RELAXED);
+    } else if (room == NULL && wire_decode_watch(frame, &shard, &id)) {
+        request_watch(conn, shard, id);
+    }
+}
+
+// One message as the reader split it off, still in the receive buffer
+void handle_message(Connection *conn, const WireFrame *message) {
+    Room *room = __atomic_load_n(&conn->room, __ATOMIC_ACQUIRE);
+    int version, rating, row, col, shard;
+    uint32_t id;
+
+    if (message->type != WIRE_TEXT) {
+        handle_frame(conn, room, message);
+    } else if (room == NULL && (version = wire_read_hello(message->payload, message->len)) > 0) {
+        accept_hello(conn, version);
+    } else if (room == NULL && wire_text_rating(message, &rating)) {
+        __atomic_store_n(&conn->rating, rating, __ATOMIC_RELAXED);
+    } else if (room == NULL && wire_text_watch(message, &shard, &id)) {
+        request_watch(conn, shard, id);
+    } else if (room != NULL && wire_text_move(message, &row, &col)) {
+        handle_move(conn, room, row, col);
+    }
+    if (room == NULL) {
+        __atomic_store_n(&conn->spoke, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Handles every complete message in the receive buffer. Returns 0 on
+// garbage.
+int read_messages(Connection *conn) {
+    WireFrame message;
+    int got;
+
+    while ((got = wire_reader_next(&conn->in, &message)) > 0) {
+        handle_message(conn, &message);
+    }
+    return got == 0;
+}
+
+// Drops one reference; the last closes the socket and frees the memory
+void release_connection(Connection *conn) {
+    if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->lock);
+    if (conn->watch != NULL) {
+        conn->watch->in_flight = 0;
+        conn->watch->done = 0;
+        watch_drop_queued(conn->watch);
+        free(conn->watch);
+    }
+    free(conn->out);
+    free(conn->sending);
+    free(conn);
+}
+
+void retire_room(Room *room);
+
+// Runs on the owning reactor. A player who leaves mid-game forfeits it.
+void close_connection(Connection *conn) {
+    if (!use_uring) {
+        count_syscall();
+        epoll_ctl(conn->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    Room *room = conn->room;
+    if (room == NULL) {
+        // Still waiting: matchmaking may be looking at it, so it frees it
+        __atomic_store_n(&conn->gone, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&conn->lock);
+        return;
+    }
+    Watch *watch = conn->watch;
+    if (watch != NULL) {
+        // Nothing may catch up on the room after this
+        __atomic_store_n(&conn->room, NULL, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    pthread_mutex_lock(&room->lock);
+    if (watch != NULL) {
+        room_remove_spectator(room, conn);
+    } else {
+        room->players[conn->player - 1] = NULL;
+        if (room->current_player != 0) {
+            finish_game(room, 3 - conn->player);
+        }
+    }
+    int seated = --room->seated;
+    pthread_mutex_unlock(&room->lock);
+    if (seated == 0) {
+        retire_room(room);
+    }
+    release_connection(conn);
+}
+
+// Matchmaking only. Returns 0 when either player has gone or no room is free.
+int seat_pair(Reactor *shard, Connection *first, Connection *second) {
+    uint32_t id;
+    Room *room;
+
+    // Holding both locks keeps close_connection from running halfway
+    pthread_mutex_lock(&first->lock);
+    pthread_mutex_lock(&second->lock);
+    if (first->gone || second->gone || first->watching || second->watching ||
+        (room = rooms_acquire(&shard->rooms, &id)) == NULL) {
+        pthread_mutex_unlock(&second->lock);
+        pthread_mutex_unlock(&first->lock);
+        return 0;
+    }
+    pthread_mutex_init(&room->lock, NULL);
+    room->shard = shard;
+    room->id = id;
+    initialize_board(room->board);
+    room->current_player = 1;
+    room->move_number = 0;
+    room->players[0] = first;
+    room->players[1] = second;
+    room->seated = 2;
+    first->player = 1;
+    first->state = CONN_PLAYING;
+    second->player = 2;
+    second->state = CONN_PLAYING;
+    // The featured game runs until it ends, then the next one seated takes over
+    if (shard->featured == NULL || __atomic_load_n(&shard->featured->current_player, __ATOMIC_RELAXED) == 0) {
+        shard->featured = room;
+        __atomic_store_n(&shard->featured_id, id, __ATOMIC_RELAXED);
+    }
+
+    // Nobody can reach the room before the pointers are published, and the
+    // lock makes moves wait for the opening messages
+    pthread_mutex_lock(&room->lock);
+    __atomic_store_n(&first->room, room, __ATOMIC_RELEASE);
+    __atomic_store_n(&second->room, room, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&second->lock);
+    pthread_mutex_unlock(&first->lock);
+
+    for (int p = 0; p < 2; p++) {
+        Connection *conn = room->players[p];
+        uint8_t frame[3];
+        uint8_t player = (uint8_t)(p + 1);
+        if (conn->binary) {
+            conn_send(conn, (const char *)frame, wire_frame(frame, WIRE_SEAT, &player, 1));
+        } else {
+            conn_send(conn, p == 0 ? "1" : "2", 1);
+        }
+    }
+    broadcast_game_state(room);
+    pthread_mutex_unlock(&room->lock);
+    return 1;
+}
+
+// Tells a player nobody was found, or a spectator there is nothing to
+// watch, and ends the receive side. The reactor sees the end and marks the
+// connection gone, then matchmaking frees it.
+void expire_connection(Connection *conn, int type) {
+    pthread_mutex_lock(&conn->lock);
+    int gone = conn->gone;
+    conn->expired = 1;
+    pthread_mutex_unlock(&conn->lock);
+    if (!gone) {
+        conn_signal(conn, type);
+        count_syscall();
+        shutdown(conn->fd, SHUT_RD);
+    }
+}
+
+int rating_band(Connection *conn) {
+    if (match_band_width <= 0) {
+        return 0;
+    }
+    int band = __atomic_load_n(&conn->rating, __ATOMIC_RELAXED) / match_band_width;
+    return band < 0 ? 0 : band >= MATCH_BANDS ? MATCH_BANDS - 1 : band;
+}
+
+void wake_reactor(Reactor *reactor) {
+    if (__atomic_exchange_n(&reactor->sleeping, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        count_syscall();
+        if (write(reactor->wake_fd, &one, sizeof(one)) < 0) {
+            perror("eventfd");
+        }
+    }
+}
+
+// Called on a reactor other than the owner; conn_schedule took the reference
+// the owner's flush lets go of
+void conn_hand_over(Connection *conn) {
+    Reactor *owner = conn->reactor;
+    if (!queue_push(&owner->wake_queue, conn)) {
+        conn->next_flush = current_reactor->hand_overs;
+        current_reactor->hand_overs = conn;
+        return;
+    }
+    wake_reactor(owner);
+}
+
+// Puts the connections other threads handed over on the flush list.
+// Returns how many there were.
+int drain_wakes(Reactor *reactor) {
+    Connection *conn;
+    int count = 0;
+    while ((conn = queue_pop(&reactor->wake_queue)) != NULL) {
+        conn->next_flush = reactor->flushes;
+        reactor->flushes = conn;
+        count++;
+    }
+    return count;
+}
+
+void uring_start_send(Reactor *reactor, Connection *conn);
+
+// Sends what each connection on the flush list was given, one call per
+// connection: a send under epoll, one send on the ring under io_uring
+void flush_connections(Reactor *reactor) {
+    Connection *conn;
+    while ((conn = reactor->flushes) != NULL) {
+        reactor->flushes = conn->next_flush;
+        pthread_mutex_lock(&conn->lock);
+        conn->flush_queued = 0;
+        if (use_uring) {
+            uring_start_send(reactor, conn);
+        } else if (!conn->want_write) {
+            conn_write(conn);
+        }
+        int catch_up = watch_caught_up(conn);
+        pthread_mutex_unlock(&conn->lock);
+        if (catch_up) {
+            watch_catch_up(conn);
+        }
+        release_connection(conn);
+    }
+}
+
+// Owner only, with nothing locked: a spectator that fell behind has sent
+// what it had left, so it gets the board as it is now and the moves after
+// it. The connection's reference keeps the room until it is closed, which
+// happens on this thread too.
+void watch_catch_up(Connection *conn) {
+    Room *room = __atomic_load_n(&conn->room, __ATOMIC_ACQUIRE);
+    int hand_over = 0;
+    if (room == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&room->lock);
+    pthread_mutex_lock(&conn->lock);
+    if (watch_caught_up(conn)) {
+        conn->watch->behind = 0;
+        hand_over = watch_queue(conn, room_shared(room, board_kind(conn)));
+        if (room->current_player == 0) {
+            hand_over |= watch_queue(conn, room_shared(room, over_kind(conn)));
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_unlock(&room->lock);
+    if (hand_over) {
+        conn_hand_over(conn);
+    }
+}
+
+// Shard thread only
+void free_room(Reactor *shard, Room *room) {
+    if (shard->featured == room) {
+        shard->featured = NULL;
+    }
+    room_forget_shared(room);
+    free(room->spectators);
+    pthread_mutex_destroy(&room->lock);
+    rooms_release(&shard->rooms, room);
+}
+
+// The last connection left the room. Its shard frees it, so that a room
+// the shard looks up for a spectator cannot go away under it.
+void retire_room(Room *room) {
+    Reactor *shard = room->shard;
+    if (shard == current_reactor) {
+        free_room(shard, room);
+        return;
+    }
+    if (!queue_push(&shard->retired, room)) {
+        room->next_retired = current_reactor->retiring;
+        current_reactor->retiring = room;
+        return;
+    }
+    wake_reactor(shard);
+}
+
+// Tries again what conn_hand_over and retire_room could not queue. Returns
+// 1 while anything is still held, so the reactor only naps.
+int retry_hand_overs(Reactor *reactor) {
+    Connection *conn = reactor->hand_overs;
+    Room *room = reactor->retiring;
+    reactor->hand_overs = NULL;
+    reactor->retiring = NULL;
+    while (conn != NULL) {
+        Connection *next = conn->next_flush;
+        conn_hand_over(conn);
+        conn = next;
+    }
+    while (room != NULL) {
+        Room *next = room->next_retired;
+        retire_room(room);
+        room = next;
+    }
+    return reactor->hand_overs != NULL || reactor->retiring != NULL;
+}
+
+// Shard thread only. Returns 0 when out of memory.
+int add_pending(Reactor *shard, Connection *conn) {
+    if (shard->pending_count == shard->pending_capacity) {
+        size_t capacity = shard->pending_capacity > 0 ? shard->pending_capacity * 2 : 1024;
+        Connection **pending = realloc(shard->pending, capacity * sizeof(Connection *));
+        if (pending == NULL) {
+            return 0;
+        }
+        shard->pending = pending;
+        shard->pending_capacity = capacity;
+    }
+    shard->pending[shard->pending_count++] = conn;
+    shard->next_match_us = 0;
+    return 1;
+}
+
+// Shard thread only: a player add_pending had no memory for waits on a
+// list of the shard's own, so nothing is lost to a full inbox
+void hold_pending(Reactor *shard, Connection *conn) {
+    conn->next_idle = shard->held;
+    shard->held = conn;
+}
+
+// Shard thread only. A spectator matchmaking passed on joins the room it
+// asked for, or the featured game. Only this thread frees the shard's
+// rooms, so one it looks up stays valid while it takes the lock.
+void watch_room(Reactor *shard, Connection *conn) {
+    Room *room = conn->watch_id == ROOM_NONE ? shard->featured : rooms_lookup(&shard->rooms, conn->watch_id);
+    int joined = 0;
+    int hand_over = 0;
+
+    // Between featured games, wait for the next one to be seated
+    if (conn->watch_id == ROOM_NONE &&
+        (room == NULL || __atomic_load_n(&room->current_player, __ATOMIC_RELAXED) == 0)) {
+        conn->next_idle = shard->idle;
+        shard->idle = conn;
+        return;
+    }
+    Watch *watch = calloc(1, sizeof(Watch));
+    if (room != NULL) {
+        pthread_mutex_lock(&room->lock);
+    }
+    pthread_mutex_lock(&conn->lock);
+    int gone = conn->gone;
+    if (!gone && room != NULL && room->current_player != 0 && watch != NULL && room_add_spectator(room, conn, watch)) {
+        conn->watch = watch;
+        conn->state = CONN_WATCHING;
+        room->seated++;
+        __atomic_store_n(&conn->room, room, __ATOMIC_RELEASE);
+        hand_over = watch_queue(conn, room_shared(room, board_kind(conn)));
+        joined = 1;
+    }
+    pthread_mutex_unlock(&conn->lock);
+    if (room != NULL) {
+        pthread_mutex_unlock(&room->lock);
+    }
+
+    if (joined) {
+        if (hand_over) {
+            conn_hand_over(conn);
+        }
+        return;
+    }
+    free(watch);
+    if (gone) {
+        release_connection(conn);
+        return;
+    }
+    // Nothing to watch: it ends like a player nobody was found for, and
+    // matchmaking frees it once it is gone
+    __atomic_store_n(&conn->watching, 0, __ATOMIC_RELEASE);
+    expire_connection(conn, WIRE_OVER);
+    if (!add_pending(shard, conn)) {
+        hold_pending(shard, conn);
+    }
+}
+
+// One matchmaking pass over the shard's players in arrival order. Players
+// in the same band are paired oldest first; the one left over in each band
+// is paired across bands once it has waited long enough, or passed on to
+// shard 0. Seated and passed on players are dropped from the list.
+void match_pending(Reactor *shard, long long now) {
+    Connection **pending = shard->pending;
+    size_t count = shard->pending_count;
+    size_t oldest[MATCH_BANDS];
+    for (int b = 0; b < MATCH_BANDS; b++) {
+        oldest[b] = count;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Connection *conn = pending[i];
+        if (__atomic_load_n(&conn->gone, __ATOMIC_ACQUIRE)) {
+            release_connection(conn);
+            pending[i] = NULL;
+            continue;
+        }
+        if (conn->expired) {
+            continue;
+        }
+        if (match_timeout_us > 0 && now - conn->queued_us > match_timeout_us) {
+            expire_connection(conn, WIRE_TIMEOUT);
+            continue;
+        }
+        if (__atomic_load_n(&conn->watching, __ATOMIC_ACQUIRE)) {
+            // A spectator goes to the shard that has its room
+            Reactor *target = &reactors[conn->watch_shard];
+            if (queue_push(&target->watchers, conn)) {
+                pending[i] = NULL;
+                if (target != shard) {
+                    wake_reactor(target);
+                }
+            }
+            continue;
+        }
+        // The hello follows the connect at once; give it time to arrive,
+        // and the owner a poll to read it, before the player is seated in text
+        if (!__atomic_load_n(&conn->spoke, __ATOMIC_ACQUIRE) &&
+            (now - conn->queued_us < HELLO_WAIT_US ||
+             __atomic_load_n(&conn->reactor->polls, __ATOMIC_ACQUIRE) == conn->accepted_poll)) {
+            continue;
+        }
+        int band = rating_band(conn);
+        if (oldest[band] == count) {
+            oldest[band] = i;
+        } else if (seat_pair(shard, pending[oldest[band]], conn)) {
+            pending[oldest[band]] = NULL;
+            pending[i] = NULL;
+            oldest[band] = count;
+        }
+    }
+
+    // Widen the search for whoever is still alone in their band
+    int previous = -1;
+    for (int band = 0; band < MATCH_BANDS; band++) {
+        if (oldest[band] == count) {
+            continue;
+        }
+        if (previous >= 0) {
+            Connection *low = pending[oldest[previous]];
+            Connection *high = pending[oldest[band]];
+            long long waited = now - (low->queued_us < high->queued_us ? low->queued_us : high->queued_us);
+            if (waited >= MATCH_WIDEN_US * (band - previous) && seat_pair(shard, low, high)) {
+                pending[oldest[previous]] = NULL;
+                pending[oldest[band]] = NULL;
+                previous = -1;
+                continue;
+            }
+        }
+        previous = band;
+    }
+
+    // Nobody here for the rest: let shard 0 try them against everyone else's
+    if (shard->index > 0) {
+        int forwarded = 0;
+        for (int band = 0; band < MATCH_BANDS; band++) {
+            size_t i = oldest[band];
+            if (i < count && pending[i] != NULL && now - pending[i]->queued_us > MATCH_FORWARD_US &&
+                queue_push(&reactors[0].inbox, pending[i])) {
+                pending[i] = NULL;
+                forwarded = 1;
+            }
+        }
+        if (forwarded) {
+            wake_reactor(&reactors[0]);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pending[i] != NULL) {
+            pending[kept++] = pending[i];
+        }
+    }
+    shard->pending_count = kept;
+}
+
+// Runs on the shard's thread between event batches. Returns how long the
+// reactor may sleep in milliseconds, -1 for as long as it likes.
+int run_matchmaking(Reactor *shard) {
+    Connection *conn;
+    Room *room;
+    while ((room = queue_pop(&shard->retired)) != NULL) {
+        free_room(shard, room);
+    }
+    // Out of memory: a player is held for a later pass
+    Connection *held = shard->held;
+    shard->held = NULL;
+    while ((conn = held) != NULL) {
+        held = conn->next_idle;
+        if (!add_pending(shard, conn)) {
+            hold_pending(shard, conn);
+        }
+    }
+    while (shard->held == NULL && (conn = queue_pop(&shard->inbox)) != NULL) {
+        if (!add_pending(shard, conn)) {
+            hold_pending(shard, conn);
+        }
+    }
+    long long now = now_us();
+    if (shard->pending_count > 0 && now >= shard->next_match_us) {
+        match_pending(shard, now);
+        shard->next_match_us = now + MATCH_TICK_US;
+    }
+    while ((conn = queue_pop(&shard->watchers)) != NULL) {
+        watch_room(shard, conn);
+    }
+    if (shard->idle != NULL && shard->featured != NULL &&
+        __atomic_load_n(&shard->featured->current_player, __ATOMIC_RELAXED) != 0) {
+        Connection *idle = shard->idle;
+        shard->idle = NULL;
+        while ((conn = idle) != NULL) {
+            idle = conn->next_idle;
+            watch_room(shard, conn);
+        }
+    }
+    __atomic_store_n(&shard->waiting, (long long)shard->pending_count, __ATOMIC_RELAXED);
+    return shard->pending_count > 0 || shard->held != NULL ? MATCH_TICK_US / 1000 : -1;
+}
+
+// Keeps a shard on one core, so its rooms and connections stay in that cache
+void pin_to_core(int index) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % (int)sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+Connection *open_connection(int fd, Reactor *reactor) {
+    int one = 1;
+    count_syscall();
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (conn == NULL) {
+        close(fd);
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->epoll_fd = reactor->epoll_fd;
+    conn->reactor = reactor;
+    conn->refs = use_uring ? 2 : 1;
+    conn->state = CONN_WAITING;
+    conn->rating = MATCH_DEFAULT_RATING;
+    conn->queued_us = now_us();
+    conn->accepted_poll = reactor->polls;
+    wire_reader_init(&conn->in, conn->in_buffer, sizeof(conn->in_buffer), 0);
+    pthread_mutex_init(&conn->lock, NULL);
+    return conn;
+}
+
+void accept_connections(Reactor *reactor) {
+    while (1) {
+        count_syscall();
+        int fd = accept4(reactor->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept4");
+            }
+            return;
+        }
+
+        Connection *conn = open_connection(fd, reactor);
+        if (conn == NULL) {
+            continue;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = conn;
+        count_syscall();
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            perror("epoll_ctl");
+            release_connection(conn);
+            continue;
+        }
+        if (!add_pending(reactor, conn)) {
+            epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            release_connection(conn);
+        }
+    }
+}
+
+// Returns 0 when the connection should be closed
+int read_connection(Connection *conn) {
+    size_t space;
+    uint8_t *to = wire_reader_space(&conn->in, &space);
+    count_syscall();
+    ssize_t received = recv(conn->fd, to, space, 0);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (received == 0) {
+        return 0;
+    }
+
+    wire_reader_filled(&conn->in, (size_t)received);
+    return read_messages(conn);
+}
+
+void *reactor_main(void *arg) {
+    Reactor *reactor = (Reactor *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    current_reactor = reactor;
+    pin_to_core(reactor->index);
+    while (1) {
+        // Sleep only if nothing arrived after the flag went up; a thread
+        // that sees the flag writes the eventfd
+        drain_wakes(reactor);
+        run_matchmaking(reactor);
+        __atomic_store_n(&reactor->sleeping, 1, __ATOMIC_SEQ_CST);
+        int wait = drain_wakes(reactor) == 0;
+        int timeout = run_matchmaking(reactor);
+        flush_connections(reactor);
+        // What a full queue of another shard did not take is tried again
+        // after a tick, rather than spinning on it
+        if (retry_hand_overs(reactor) && timeout < 0) {
+            timeout = MATCH_TICK_US / 1000;
+        }
+
+        count_syscall();
+        int count = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, wait ? timeout : 0);
+        __atomic_store_n(&reactor->sleeping, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&reactor->polls, reactor->polls + 1, __ATOMIC_RELEASE);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_connections(reactor);
+                continue;
+            }
+            if (events[i].data.ptr == reactor) {
+                count_syscall();
+                if (read(reactor->wake_fd, &reactor->wake_value, sizeof(reactor->wake_value)) < 0) {
+                    perror("eventfd");
+                }
+                continue;
+            }
+            Connection *conn = (Connection *)events[i].data.ptr;
+            int keep = 1;
+            if (events[i].events & EPOLLOUT) {
+                conn_flush(conn);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                keep = read_connection(conn);
+            }
+            if (!keep) {
+                close_connection(conn);
+            }
+        }
+    }
+    return NULL;
+}
+
+// io_uring backend. Everything that touches a ring runs on the reactor that
+// owns it; a connection keeps the ring's reference until no receive or send
+// for it is left in flight.
+
+// A receive or send that got no SQE stays armed as far as the connection
+// knows, so it keeps the ring's reference until it is submitted
+void uring_stall(Reactor *reactor, Connection *conn, int what) {
+    if (conn->stalled == 0) {
+        conn->next_stalled = reactor->stalled;
+        reactor->stalled = conn;
+    }
+    conn->stalled |= what;
+}
+
+// Call with the connection locked
+void uring_submit_send(Reactor *reactor, Connection *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    conn->send_busy = 1;
+    if (sqe == NULL) {
+        uring_stall(reactor, conn, STALL_SEND);
+        return;
+    }
+    if (conn->watch != NULL) {
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = (unsigned long)&conn->watch->msg;
+        sqe->len = 1;
+    } else {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = (unsigned long)(conn->sending + conn->sending_done);
+        sqe->len = (unsigned int)(conn->sending_len - conn->sending_done);
+    }
+    sqe->fd = conn->fd;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | TAG_SEND;
+}
+
+// Owner only, with the connection locked: swaps the queued output into the
+// sending buffer, so out can keep filling while the kernel sends. A
+// spectator's shared messages go along in one sendmsg, from their buffers.
+void uring_start_send(Reactor *reactor, Connection *conn) {
+    Watch *watch = conn->watch;
+    if (conn->send_busy || conn->closing || (conn->out_len == 0 && (watch == NULL || watch->count == 0))) {
+        return;
+    }
+    char *buffer = conn->sending;
+    size_t capacity = conn->sending_capacity;
+    conn->sending = conn->out;
+    conn->sending_capacity = conn->out_capacity;
+    conn->sending_len = conn->out_len;
+    conn->sending_done = 0;
+    conn->out = buffer;
+    conn->out_capacity = capacity;
+    conn->out_len = 0;
+    if (watch != NULL) {
+        watch->in_flight = watch->count;
+        memset(&watch->msg, 0, sizeof(watch->msg));
+        watch->msg.msg_iov = watch->iov;
+        watch->msg.msg_iovlen = (size_t)conn_gather(conn, conn->sending, conn->sending_len, watch->iov);
+    }
+    uring_submit_send(reactor, conn);
+}
+
+// With the connection locked: moves a spectator's sendmsg on past what the
+// kernel took. Returns 1 once all of it has gone, and lets go of the shared
+// messages that went with it.
+int uring_watch_sent(Connection *conn, int res) {
+    Watch *watch = conn->watch;
+    struct msghdr *msg = &watch->msg;
+    size_t sent = res > 0 ? (size_t)res : 0;
+
+    while (msg->msg_iovlen > 0 && sent >= msg->msg_iov->iov_len) {
+        sent -= msg->msg_iov->iov_len;
+        msg->msg_iov++;
+        msg->msg_iovlen--;
+    }
+    if (res <= 0) {
+        msg->msg_iovlen = 0;   // the socket is dead, drop the rest
+    }
+    if (msg->msg_iovlen > 0) {
+        msg->msg_iov->iov_base = (char *)msg->msg_iov->iov_base + sent;
+        msg->msg_iov->iov_len -= sent;
+        return 0;
+    }
+    for (; watch->in_flight > 0; watch->in_flight--) {
+        shared_release(watch->queued[watch->head]);
+        watch->head = (watch->head + 1) % SPECTATOR_BACKLOG;
+        watch->count--;
+    }
+    conn->sending_done = conn->sending_len;
+    return 1;
+}
+
+void uring_arm_accept(Reactor *reactor) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    if (sqe == NULL) {
+        reactor->stalled_arms |= STALL_ACCEPT;
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = TAG_ACCEPT;
+}
+
+void uring_arm_wake(Reactor *reactor) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    if (sqe == NULL) {
+        reactor->stalled_arms |= STALL_WAKE;
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = reactor->wake_fd;
+    sqe->addr = (unsigned long)&reactor->wake_value;
+    sqe->len = sizeof(reactor->wake_value);
+    sqe->user_data = TAG_WAKE;
+}
+
+// One multishot receive keeps delivering messages into provided buffers
+// until it fails or the buffers run out
+void uring_arm_recv(Reactor *reactor, Connection *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    conn->recv_armed = 1;
+    if (sqe == NULL) {
+        uring_stall(reactor, conn, STALL_RECV);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = reactor->ring.buf_group;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | TAG_RECV;
+}
+
+// Arms again what found the submission queue full on the last loop.
+// Returns 1 while anything is still waiting for an SQE.
+int uring_retry_stalled(Reactor *reactor) {
+    Connection *conn = reactor->stalled;
+    int arms = reactor->stalled_arms;
+    reactor->stalled = NULL;
+    reactor->stalled_arms = 0;
+    if (arms & STALL_ACCEPT) {
+        uring_arm_accept(reactor);
+    }
+    if (arms & STALL_WAKE) {
+        uring_arm_wake(reactor);
+    }
+    while (conn != NULL) {
+        Connection *next = conn->next_stalled;
+        int what = conn->stalled;
+        conn->stalled = 0;
+        if (what & STALL_RECV) {
+            uring_arm_recv(reactor, conn);
+        }
+        if (what & STALL_SEND) {
+            pthread_mutex_lock(&conn->lock);
+            uring_submit_send(reactor, conn);
+            pthread_mutex_unlock(&conn->lock);
+        }
+        conn = next;
+    }
+    return reactor->stalled != NULL || reactor->stalled_arms != 0;
+}
+
+// A timeout on the ring bounds the wait while players are waiting for a match
+void uring_arm_tick(Reactor *reactor, int timeout_ms) {
+    if (reactor->tick_armed || timeout_ms < 0) {
+        return;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(&reactor->ring);
+    if (sqe != NULL) {
+        reactor->tick.tv_sec = timeout_ms / 1000;
+        reactor->tick.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = (unsigned long)&reactor->tick;
+        sqe->len = 1;
+        sqe->user_data = TAG_TICK;
+        reactor->tick_armed = 1;
+    }
+}
+
+// Gives up the ring's reference once nothing is in flight for a closed connection
+void uring_retire(Connection *conn) {
+    pthread_mutex_lock(&conn->lock);
+    int idle = conn->closing == 1 && !conn->recv_armed && !conn->send_busy;
+    if (idle) {
+        conn->closing = 2;
+    }
+    pthread_mutex_unlock(&conn->lock);
+    if (idle) {
+        release_connection(conn);
+    }
+}
+
+// Whole messages are handled where the kernel put them; only a piece cut
+// off at the end is copied to the connection to wait for the rest. While
+// a piece waits, the read goes in as the messages before it make room, as
+// a whole read may not fit behind it. Returns 0 on garbage.
+int uring_read_messages(Connection *conn, const uint8_t *data, size_t len) {
+    WireFrame message;
+    int used = 0;
+
+    do {
+        if (conn->in.start == conn->in.end) {
+            while ((used = wire_reader_split(&conn->in, data, len, &message)) > 0) {
+                handle_message(conn, &message);
+                data += used;
+                len -= (size_t)used;
+            }
+        }
+        // Garbage is kept too, so the reader stays stuck on it
+        size_t taken = wire_reader_take(&conn->in, data, len);
+        data += taken;
+        len -= taken;
+        if (used < 0 || !read_messages(conn)) {
+            return 0;
+        }
+    } while (len > 0);
+    return 1;
+}
+
+void uring_accept(Reactor *reactor, int fd) {
+    Connection *conn = open_connection(fd, reactor);
+    if (conn == NULL) {
+        return;
+    }
+    if (!add_pending(reactor, conn)) {
+        release_connection(conn);
+        release_connection(conn);
+        return;
+    }
+    uring_arm_recv(reactor, conn);
+}
+
+void uring_complete(Reactor *reactor, const struct io_uring_cqe *cqe) {
+    Connection *conn = (Connection *)(uintptr_t)(cqe->user_data & ~(uint64_t)TAG_MASK);
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    int sent_all, catch_up;
+
+    switch (cqe->user_data & TAG_MASK) {
+        case TAG_ACCEPT:
+            if (cqe->res >= 0) {
+                uring_accept(reactor, cqe->res);
+            }
+            if (!more) {
+                uring_arm_accept(reactor);
+            }
+            break;
+
+        case TAG_WAKE:
+            uring_arm_wake(reactor);
+            break;
+
+        case TAG_TICK:
+            reactor->tick_armed = 0;
+            break;
+
+        case TAG_RECV:
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                unsigned int id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe->res > 0 && !uring_read_messages(conn, (const uint8_t *)uring_buffer(&reactor->ring, id), (size_t)cqe->res)) {
+                    // Garbage: end the receive side and close as on a hang-up
+                    count_syscall();
+                    shutdown(conn->fd, SHUT_RD);
+                }
+                uring_recycle_buffer(&reactor->ring, id);
+            }
+            if (!more) {
+                conn->recv_armed = 0;
+                if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+                    uring_arm_recv(reactor, conn);
+                } else {
+                    pthread_mutex_lock(&conn->lock);
+                    conn->closing = 1;
+                    pthread_mutex_unlock(&conn->lock);
+                    close_connection(conn);
+                    uring_retire(conn);
+                }
+            }
+            break;
+
+        case TAG_SEND:
+            pthread_mutex_lock(&conn->lock);
+            if (conn->watch != NULL) {
+                sent_all = uring_watch_sent(conn, cqe->res);
+            } else {
+                if (cqe->res > 0) {
+                    conn->sending_done += (size_t)cqe->res;
+                } else {
+                    conn->sending_done = conn->sending_len;   // the socket is dead, drop the rest
+                }
+                sent_all = conn->sending_done >= conn->sending_len;
+            }
+            if (!sent_all) {
+                uring_submit_send(reactor, conn);
+            } else {
+                conn->send_busy = 0;
+                uring_start_send(reactor, conn);
+            }
+            catch_up = watch_caught_up(conn);
+            pthread_mutex_unlock(&conn->lock);
+            if (catch_up) {
+                watch_catch_up(conn);
+            }
+            uring_retire(conn);
+            break;
+    }
+}
+
+void *uring_reactor_main(void *arg) {
+    Reactor *reactor = (Reactor *)arg;
+    current_reactor = reactor;
+    pin_to_core(reactor->index);
+
+    // The ring belongs to the thread that creates it
+    if (!uring_init(&reactor->ring, URING_ENTRIES, URING_CQ_ENTRIES) ||
+        !uring_setup_buffers(&reactor->ring, URING_BUFFERS, READ_BUFFER, 0)) {
+        fprintf(stderr, "Error: Could not set up io_uring\n");
+        exit(1);
+    }
+    uring_arm_accept(reactor);
+    uring_arm_wake(reactor);
+
+    while (1) {
+        // Sleep only if nothing was handed over after the flag went up;
+        // a thread that sees the flag writes the eventfd
+        drain_wakes(reactor);
+        run_matchmaking(reactor);
+        __atomic_store_n(&reactor->sleeping, 1, __ATOMIC_SEQ_CST);
+        int wait = drain_wakes(reactor) == 0;
+        int timeout = run_matchmaking(reactor);
+        flush_connections(reactor);
+        if (retry_hand_overs(reactor) && timeout < 0) {
+            timeout = MATCH_TICK_US / 1000;
+        }
+        // The submission queue freed up on the last enter
+        if (uring_retry_stalled(reactor)) {
+            wait = 0;
+        }
+        if (wait) {
+            uring_arm_tick(reactor, timeout);
+        }
+
+        int result = uring_submit_and_wait(&reactor->ring, wait ? 1 : 0);
+        __atomic_store_n(&reactor->sleeping, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&reactor->polls, reactor->polls + 1, __ATOMIC_RELEASE);
+        if (result < 0 && result != -EINTR && result != -EBUSY) {
+            fprintf(stderr, "Error: io_uring_enter: %s\n", strerror(-result));
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&reactor->ring)) != NULL) {
+            struct io_uring_cqe copy = *cqe;
+            uring_cqe_seen(&reactor->ring);
+            uring_complete(reactor, &copy);
+        }
+    }
+    return NULL;
+}
+
+long long total_syscalls(void) {
+    long long total = total_count(COUNT_SYSCALLS);
+    for (int i = 0; use_uring && i < reactor_count; i++) {
+        total += __atomic_load_n(&reactors[i].ring.enters, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+long long total_waiting(void) {
+    long long total = 0;
+    for (int i = 0; i < reactor_count; i++) {
+        total += __atomic_load_n(&reactors[i].waiting, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// Sums the room tables of all shards; the peak is the sum of shard peaks
+void total_room_stats(RoomStats *total) {
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < reactor_count; i++) {
+        RoomStats shard;
+        rooms_stats(&reactors[i].rooms, &shard);
+        total->active += shard.active;
+        total->peak += shard.peak;
+        total->created += shard.created;
+        total->recycled += shard.recycled;
+    }
+}
+
+// Prints the room tables and the I/O cost once per interval, so churn and
+// the backends can be measured
+void *stats_main(void *arg) {
+    int seconds = *(int *)arg;
+    RoomStats last;
+    total_room_stats(&last);
+    long long last_syscalls = total_syscalls();
+    long long last_moves = total_count(COUNT_MOVES);
+    long long last_made = 0;
+    long long last_queued = 0;
+
+    while (1) {
+        RoomStats now;
+        sleep(seconds);
+        total_room_stats(&now);
+        long long syscalls = total_syscalls();
+        long long moves = total_count(COUNT_MOVES);
+        printf("io: moves/s %lld  syscalls/move %.2f\n", (moves - last_moves) / seconds,
+               moves > last_moves ? (double)(syscalls - last_syscalls) / (moves - last_moves) : 0.0);
+        last_syscalls = syscalls;
+        last_moves = moves;
+        long long opened = now.created + now.recycled - last.created - last.recycled;
+        printf("rooms: active %lld  peak %lld  opened/s %lld  allocated %lld  recycled %lld  waiting %lld\n",
+               now.active, now.peak, opened / seconds, now.created, now.recycled,
+               total_waiting());
+        // Messages encoded for spectators against references queued to them
+        long long made = total_count(COUNT_SHARED_MADE);
+        long long queued = total_count(COUNT_SHARED_QUEUED);
+        if (queued > 0) {
+            printf("spectators: watching %lld  encoded/s %lld  queued/s %lld  fell behind %lld  dropped %lld  featured 0:%u\n",
+                   total_count(COUNT_WATCHING), (made - last_made) / seconds,
+                   (queued - last_queued) / seconds, total_count(COUNT_BEHIND), total_count(COUNT_DROPPED),
+                   __atomic_load_n(&reactors[0].featured_id, __ATOMIC_RELAXED));
+        }
+        last_made = made;
+        last_queued = queued;
+        fflush(stdout);
+        last = now;
+    }
+    return NULL;
+}
+
+// Every shard binds its own socket to the same port; the kernel hashes new
+// connections across them, so no accept queue is shared between cores
+int open_listener(int port) {
+    struct sockaddr_in server_address;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+    server_address.sin_addr.s_addr = inet_addr(SERVER_IP);
+    if (bind(fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0 ||
+        listen(fd, LISTEN_BACKLOG) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void raise_file_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-p port] [-t threads] [-s stats_seconds] [-b rating_band] [-w wait_seconds] [-u]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int port = SERVER_PORT;
+    int stats_seconds = 0;
+    int option;
+
+    reactor_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((option = getopt(argc, argv, "p:t:s:b:w:u")) != -1) {
+        switch (option) {
+            case 'p': port = atoi(optarg); break;
+            case 't': reactor_count = atoi(optarg); break;
+            case 's': stats_seconds = atoi(optarg); break;
+            case 'b': match_band_width = atoi(optarg); break;
+            case 'w': match_timeout_us = atoll(optarg) * 1000000; break;
+            case 'u': use_uring = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (reactor_count < 1) {
+        reactor_count = 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    raise_file_limit();
+
+    reactors = calloc(reactor_count, sizeof(Reactor));
+    for (int i = 0; i < reactor_count; i++) {
+        Reactor *reactor = &reactors[i];
+        reactor->index = i;
+        reactor->listen_fd = open_listener(port);
+        reactor->wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (reactor->listen_fd < 0 || reactor->wake_fd < 0 || !rooms_init(&reactor->rooms, sizeof(Room)) ||
+            !queue_init(&reactor->inbox, MATCH_QUEUE_CAPACITY) || !queue_init(&reactor->wake_queue, WAKE_CAPACITY) ||
+            !queue_init(&reactor->watchers, WATCH_QUEUE_CAPACITY) || !queue_init(&reactor->retired, WAKE_CAPACITY)) {
+            fprintf(stderr, "Error: Could not set up shard %d\n", i);
+            return 1;
+        }
+        if (use_uring) {
+            // Each ring keeps its own multishot accept on the listener
+            reactor->epoll_fd = -1;
+            continue;
+        }
+
+        // A NULL pointer marks the listener and the reactor itself the eventfd
+        struct epoll_event event;
+        reactor->epoll_fd = epoll_create1(0);
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        int ok = reactor->epoll_fd >= 0 && epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &event) == 0;
+        event.data.ptr = reactor;
+        if (!ok || epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &event) < 0) {
+            perror("epoll");
+            return 1;
+        }
+    }
+    printf("Listening on port %d with %d %s reactor threads\n", port, reactor_count, use_uring ? "io_uring" : "epoll");
+
+    if (stats_seconds > 0) {
+        pthread_t stats_thread;
+        pthread_create(&stats_thread, NULL, stats_main, &stats_seconds);
+    }
+    void *(*run)(void *) = use_uring ? uring_reactor_main : reactor_main;
+    for (int i = 1; i < reactor_count; i++) {
+        pthread_create(&reactors[i].thread, NULL, run, &reactors[i]);
+    }
+    run(&reactors[0]);
+    return 0;
+}
\ No newline at end of file